@@ -0,0 +1,101 @@
+// Micro-benchmark: reserved word classification in lookup_ident on identifier-heavy input
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include "Token.hpp"
+
+// previous implementation: tree lookup in a keyword map, then a linear scan of the type keywords.
+// Both are filled from RESERVED_WORDS, so the expected classification follows the language
+std::map<std::string, TokenType> LEGACY_KEYWORDS = {};
+std::vector<std::string> LEGACY_TYPE_KEYWORDS = {};
+
+void fill_legacy_tables(){
+    for (const ReservedWord& reserved : RESERVED_WORDS){
+        if (reserved.type == TokenType::TYPE){
+            LEGACY_TYPE_KEYWORDS.push_back(std::string(reserved.word));
+        } else {
+            LEGACY_KEYWORDS[std::string(reserved.word)] = reserved.type;
+        }
+    }
+}
+
+TokenType legacy_lookup_ident(std::string ident){
+    if (LEGACY_KEYWORDS.find(ident) != LEGACY_KEYWORDS.end()){
+        return LEGACY_KEYWORDS[ident];
+    }
+
+    if (std::find(LEGACY_TYPE_KEYWORDS.begin(), LEGACY_TYPE_KEYWORDS.end(), ident) != LEGACY_TYPE_KEYWORDS.end()){
+        return TokenType::TYPE;
+    }
+
+    return TokenType::IDENT;
+}
+
+// identifier-heavy workload: roughly one reserved word for every three plain identifiers
+std::vector<std::string> make_workload(size_t count){
+    std::mt19937 rng(42);
+    std::vector<std::string> words;
+    words.reserve(count);
+
+    const std::string alphabet = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    for (size_t i = 0; i < count; i++){
+        if (rng() % 4 == 0){
+            words.push_back(std::string(RESERVED_WORDS[rng() % RESERVED_WORD_COUNT].word));
+            continue;
+        }
+
+        std::string ident(1, alphabet[rng() % 26]);
+        size_t length = 1 + rng() % 10;
+        for (size_t j = 0; j < length; j++){
+            ident += alphabet[rng() % alphabet.size()];
+        }
+        words.push_back(ident);
+    }
+    return words;
+}
+
+template <typename F>
+double time_ns_per_lookup(const std::vector<std::string>& words, int rounds, F lookup, size_t& checksum){
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++){
+        for (const std::string& word : words){
+            checksum += static_cast<size_t>(lookup(word));
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (double(words.size()) * rounds);
+}
+
+int main(int argc, char** argv){
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    fill_legacy_tables();
+    std::vector<std::string> words = make_workload(count);
+
+    // both implementations must agree before timing them
+    for (const std::string& word : words){
+        if (legacy_lookup_ident(word) != lookup_ident(word)){
+            std::cout << "mismatch on " << word << std::endl;
+            return 1;
+        }
+    }
+
+    size_t legacy_checksum = 0;
+    size_t hashed_checksum = 0;
+    double legacy_ns = time_ns_per_lookup(words, rounds, [](const std::string& w){ return legacy_lookup_ident(w); }, legacy_checksum);
+    double hashed_ns = time_ns_per_lookup(words, rounds, [](const std::string& w){ return lookup_ident(w); }, hashed_checksum);
+
+    std::cout << "identifiers:      " << words.size() << " x " << rounds << " rounds" << std::endl;
+    std::cout << "map + find:       " << legacy_ns << " ns/lookup" << std::endl;
+    std::cout << "perfect hash:     " << hashed_ns << " ns/lookup" << std::endl;
+    std::cout << "speedup:          " << legacy_ns / hashed_ns << "x" << std::endl;
+
+    return legacy_checksum == hashed_checksum ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// Micro-benchmark: the runtime's map against std::unordered_map on the same workload, with int and
+// with string keys: insert every key, look each one up, look up as many missing keys, remove half
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#include "ligma_runtime.h"
+
+struct Timings{
+    double insert_ns = 0;
+    double hit_ns = 0;
+    double miss_ns = 0;
+    double remove_ns = 0;
+    int64_t checksum = 0;
+};
+
+template <typename F>
+double time_ns_per_op(size_t ops, F body){
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(ops);
+}
+
+// distinct keys, shuffled, the second half are the misses
+std::vector<uint32_t> make_int_keys(size_t count){
+    std::mt19937 rng(42);
+    std::vector<uint32_t> keys(2 * count);
+    for (size_t i = 0; i < keys.size(); i++){
+        keys[i] = uint32_t(i) * 2654435761u;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+std::vector<std::string> make_string_keys(size_t count){
+    std::vector<uint32_t> ints = make_int_keys(count);
+    std::vector<std::string> keys;
+    keys.reserve(ints.size());
+    for (size_t i = 0; i < ints.size(); i++){
+        // a mix of inline and heap strings
+        keys.push_back((i % 2 ? "identifier_" : "k") + std::to_string(ints[i]));
+    }
+    return keys;
+}
+
+// the keys as runtime strings, long ones in a heap buffer of their own
+std::vector<ligma_string> to_ligma_strings(const std::vector<std::string>& keys){
+    std::vector<ligma_string> strings;
+    strings.reserve(keys.size());
+    for (const std::string& key : keys){
+        ligma_string s = {};
+        if (key.size() <= LIGMA_STRING_INLINE){
+            std::memcpy(s.small.bytes, key.data(), key.size());
+            s.small.length = uint8_t(key.size());
+        } else {
+            ligma_buffer* buffer = static_cast<ligma_buffer*>(ligma_alloc(sizeof(ligma_buffer) + key.size()));
+            buffer->refcount = 1;
+            buffer->capacity = buffer->used = uint32_t(key.size());
+            std::memcpy(buffer->data, key.data(), key.size());
+            s.heap.buffer = buffer;
+            s.heap.offset = 0;
+            s.heap.length = uint32_t(key.size()) | LIGMA_STRING_HEAP;
+        }
+        strings.push_back(s);
+    }
+    return strings;
+}
+
+template <typename K>
+Timings run_std(const std::vector<K>& keys, size_t count){
+    Timings t;
+    std::unordered_map<K, int32_t> map;
+    t.insert_ns = time_ns_per_op(count, [&](){
+        for (size_t i = 0; i < count; i++){
+            map[keys[i]] = int32_t(i);
+        }
+    });
+    t.hit_ns = time_ns_per_op(count, [&](){
+        for (size_t i = 0; i < count; i++){
+            t.checksum += map.find(keys[i])->second;
+        }
+    });
+    t.miss_ns = time_ns_per_op(count, [&](){
+        for (size_t i = count; i < 2 * count; i++){
+            t.checksum += map.count(keys[i]);
+        }
+    });
+    t.remove_ns = time_ns_per_op(count / 2, [&](){
+        for (size_t i = 0; i < count; i += 2){
+            t.checksum += map.erase(keys[i]);
+        }
+    });
+    t.checksum += map.size();
+    return t;
+}
+
+template <typename K, typename Find, typename Insert, typename Remove>
+Timings run_ligma(const std::vector<K>& keys, size_t count, uint32_t flags, Find find, Insert insert, Remove remove){
+    Timings t;
+    ligma_map* map = ligma_map_new(flags, sizeof(int32_t));
+    t.insert_ns = time_ns_per_op(count, [&](){
+        for (size_t i = 0; i < count; i++){
+            *static_cast<int32_t*>(insert(map, keys[i])) = int32_t(i);
+        }
+    });
+    t.hit_ns = time_ns_per_op(count, [&](){
+        for (size_t i = 0; i < count; i++){
+            t.checksum += *static_cast<int32_t*>(find(map, keys[i]));
+        }
+    });
+    t.miss_ns = time_ns_per_op(count, [&](){
+        for (size_t i = count; i < 2 * count; i++){
+            t.checksum += find(map, keys[i]) != nullptr;
+        }
+    });
+    t.remove_ns = time_ns_per_op(count / 2, [&](){
+        for (size_t i = 0; i < count; i += 2){
+            t.checksum += remove(map, keys[i]);
+        }
+    });
+    t.checksum += ligma_map_size(map);
+    ligma_map_free(map);
+    return t;
+}
+
+void report(const std::string& name, const Timings& std_t, const Timings& ligma_t){
+    std::cout << name << " (ns/op)      std::unordered_map   ligma_map" << std::endl;
+    std::cout << "  insert:              " << std_t.insert_ns << "\t" << ligma_t.insert_ns << std::endl;
+    std::cout << "  lookup hit:          " << std_t.hit_ns << "\t" << ligma_t.hit_ns << std::endl;
+    std::cout << "  lookup miss:         " << std_t.miss_ns << "\t" << ligma_t.miss_ns << std::endl;
+    std::cout << "  remove:              " << std_t.remove_ns << "\t" << ligma_t.remove_ns << std::endl;
+}
+
+int main(int argc, char** argv){
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    std::vector<uint32_t> int_keys = make_int_keys(count);
+    Timings std_int = run_std(int_keys, count);
+    Timings ligma_int = run_ligma(int_keys, count, 0,
+        [](ligma_map* m, uint32_t k){ return ligma_map_find_word(m, k); },
+        [](ligma_map* m, uint32_t k){ return ligma_map_insert_word(m, k); },
+        [](ligma_map* m, uint32_t k){ return ligma_map_remove_word(m, k); });
+
+    std::vector<std::string> string_keys = make_string_keys(count);
+    std::vector<ligma_string> ligma_keys = to_ligma_strings(string_keys);
+    Timings std_string = run_std(string_keys, count);
+    Timings ligma_string_t = run_ligma(ligma_keys, count, LIGMA_MAP_STRING_KEYS,
+        [](ligma_map* m, ligma_string k){ return ligma_map_find_string(m, k); },
+        [](ligma_map* m, ligma_string k){ return ligma_map_insert_string(m, k); },
+        [](ligma_map* m, ligma_string k){ return ligma_map_remove_string(m, k); });
+    for (ligma_string key : ligma_keys){
+        ligma_string_release(key);
+    }
+
+    std::cout << "keys:                  " << count << std::endl;
+    report("int keys   ", std_int, ligma_int);
+    report("string keys", std_string, ligma_string_t);
+
+    // both maps must have seen the same contents
+    return std_int.checksum == ligma_int.checksum && std_string.checksum == ligma_string_t.checksum ? 0 : 1;
+}
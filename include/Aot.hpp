@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#if LLVM_VERSION_MAJOR >= 17
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
+
+#include "Optimizer.hpp"
+#include "Runtime.hpp"
+
+extern char** environ;
+
+// Ahead-of-time backend: native object files for the host through TargetMachine::addPassesToEmitFile,
+// optionally linked by the system C compiler driver, with the runtime library, into an executable
+// whose entry point is the ligma main.
+class Aot{
+    public:
+        // target machine for the host triple and CPU, returns nullptr (and reports why) if there is none
+        static std::unique_ptr<llvm::TargetMachine> host_target_machine(OptLevel level){
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+
+            std::string triple = llvm::sys::getDefaultTargetTriple();
+            std::string error;
+            const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+            if (!target){
+                std::cerr << "AOT error: " << error << '\n';
+                return nullptr;
+            }
+
+            // position independent code, so the default (PIE) link works
+            llvm::TargetOptions options;
+            return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+                triple, llvm::sys::getHostCPUName(), "", options, llvm::Reloc::PIC_, std::nullopt, codegen_level(level)));
+        }
+
+        // stamp the module with the target's triple and data layout, do this before optimizing it
+        static void prepare_module(llvm::Module& module, llvm::TargetMachine& target){
+            module.setTargetTriple(target.getTargetTriple().str());
+            module.setDataLayout(target.createDataLayout());
+        }
+
+        // write the module as a native object file, false on failure
+        static bool emit_object(llvm::Module& module, llvm::TargetMachine& target, const std::string& path){
+            std::error_code ec;
+            llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+            if (ec){
+                std::cerr << "AOT error: unable to open " << path << ": " << ec.message() << '\n';
+                return false;
+            }
+
+            llvm::legacy::PassManager passes;
+            if (target.addPassesToEmitFile(passes, out, nullptr, OBJECT_FILE)){
+                std::cerr << "AOT error: the target can't emit object files\n";
+                return false;
+            }
+            passes.run(module);
+            out.flush();
+            return true;
+        }
+
+        // link objects into an executable with $CC (cc by default), the runtime and libm, false if the linker fails
+        static bool link_executable(const std::vector<std::string>& objects, const std::string& path){
+            const char* cc = std::getenv("CC");
+            std::vector<std::string> args = {cc && *cc ? cc : "cc"};
+            args.insert(args.end(), objects.begin(), objects.end());
+            args.push_back(Runtime::library_path());
+            args.push_back("-o");
+            args.push_back(path);
+            args.push_back("-lm");
+
+            std::vector<char*> argv;
+            for (std::string& arg : args){
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid;
+            if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0){
+                std::cerr << "AOT error: unable to run linker " << args[0] << '\n';
+                return false;
+            }
+            int status = 0;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                std::cerr << "AOT error: linking " << path << " failed\n";
+                return false;
+            }
+            return true;
+        }
+
+    private:
+#if LLVM_VERSION_MAJOR >= 18
+        static constexpr llvm::CodeGenFileType OBJECT_FILE = llvm::CodeGenFileType::ObjectFile;
+        using CodeGenLevel = llvm::CodeGenOptLevel;
+#else
+        static constexpr llvm::CodeGenFileType OBJECT_FILE = llvm::CGFT_ObjectFile;
+        using CodeGenLevel = llvm::CodeGenOpt::Level;
+#endif
+
+        static CodeGenLevel codegen_level(OptLevel level){
+            switch (level){
+                case OptLevel::O1: return CodeGenLevel::Less;
+                case OptLevel::O2: return CodeGenLevel::Default;
+                case OptLevel::O3: return CodeGenLevel::Aggressive;
+                default: return CodeGenLevel::None;
+            }
+        }
+};
@@ -1,9 +1,12 @@
 #pragma once
 #include <string>
 #include <map>
+#include <memory>
 #include "json.hpp"
 #include <iostream>
 
+#include "AstArena.hpp"
+
 enum class NodeType{
     Program,
 
@@ -16,16 +19,22 @@ enum class NodeType{
     AssignStatement,
     IfStatement,
     ElseStatement,
+    WhileStatement,
+    ForStatement,
+    IndexAssignStatement,
 
     // Expressions
     InfixExpression,
     CallExpression,
+    IndexExpression,
 
     // Literals
     IntegerLiteral,
     FloatLiteral,
     IdentifierLiteral,
     BooleanLiteral,
+    ArrayLiteral,
+    StringLiteral,
 
     // Helper
     FunctionParameter,
@@ -41,17 +50,23 @@ std::map<NodeType, std::string> node_type_map = {
     {NodeType::AssignStatement, "AssignStatement"},
     {NodeType::IfStatement, "IfStatement"},
     {NodeType::ElseStatement, "ElseStatement"},
+    {NodeType::WhileStatement, "WhileStatement"},
+    {NodeType::ForStatement, "ForStatement"},
+    {NodeType::IndexAssignStatement, "IndexAssignStatement"},
 
 
 
     {NodeType::InfixExpression, "InfixExpression"},
     {NodeType::CallExpression, "CallExpression"},
+    {NodeType::IndexExpression, "IndexExpression"},
 
 
     {NodeType::IntegerLiteral, "IntegerLiteral"},
     {NodeType::FloatLiteral, "FloatLiteral"},
     {NodeType::IdentifierLiteral, "IdentifierLiteral"},
     {NodeType::BooleanLiteral, "BooleanLiteral"},
+    {NodeType::ArrayLiteral, "ArrayLiteral"},
+    {NodeType::StringLiteral, "StringLiteral"},
 
     {NodeType::FunctionParameter, "FunctionParameter"},
 };
@@ -76,6 +91,9 @@ class Program : public Node{
     public:
         std::vector<Statement*> statements;
 
+        // every node of the program lives in its arena and is freed with it
+        std::unique_ptr<AstArena> arena = std::make_unique<AstArena>();
+
         std::string type(){
             return node_type_map[NodeType::Program];
         }
@@ -357,6 +375,77 @@ class IfStatement : public Statement{
 };
 
 
+// optional tuning hints on a loop, from @unroll, @unroll(n), @vectorize or @vectorize(n) before it
+struct LoopHints{
+    int unroll = -1; // -1: no hint, 0: unroll with the count left to LLVM, n: unroll n times
+    int vectorize = -1; // -1: no hint, 0: vectorize with the width left to LLVM, n: vectorize n wide
+};
+
+class WhileStatement : public Statement{
+    public:
+        Expression* condition;
+        BlockStatement* body;
+        LoopHints hints;
+
+        WhileStatement(Expression* condition, BlockStatement* body, LoopHints hints = {}) : condition(condition), body(body), hints(hints){}
+
+        std::string type(){
+            return node_type_map[NodeType::WhileStatement];
+        }
+
+        NodeType type_enum(){
+            return NodeType::WhileStatement;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json j {
+                {"body", this->body->json()},
+                {"condition", this->condition->json()},
+                {"type", this->type()},
+                {"unroll", this->hints.unroll},
+                {"vectorize", this->hints.vectorize}
+            };
+
+            return j;
+        }
+};
+
+// for i in start..end, i counts up from start to end - 1
+class ForStatement : public Statement{
+    public:
+        IdentifierLiteral* variable;
+        Expression* start;
+        Expression* end;
+        BlockStatement* body;
+        LoopHints hints;
+
+        ForStatement(IdentifierLiteral* variable, Expression* start, Expression* end, BlockStatement* body, LoopHints hints = {})
+            : variable(variable), start(start), end(end), body(body), hints(hints){}
+
+        std::string type(){
+            return node_type_map[NodeType::ForStatement];
+        }
+
+        NodeType type_enum(){
+            return NodeType::ForStatement;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json j {
+                {"body", this->body->json()},
+                {"end", this->end->json()},
+                {"start", this->start->json()},
+                {"type", this->type()},
+                {"unroll", this->hints.unroll},
+                {"variable", this->variable->json()},
+                {"vectorize", this->hints.vectorize}
+            };
+
+            return j;
+        }
+};
+
+
 class InfixExpression : public Expression{
     public:
         Expression* left;
@@ -418,6 +507,60 @@ class CallExpression : public Expression{
 
 };
 
+// array[index]
+class IndexExpression : public Expression{
+    public:
+        Expression* array;
+        Expression* index;
+
+        IndexExpression(Expression* array, Expression* index) : array(array), index(index){}
+
+        std::string type(){
+            return node_type_map[NodeType::IndexExpression];
+        }
+
+        NodeType type_enum(){
+            return NodeType::IndexExpression;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json j {
+                {"array", this->array->json()},
+                {"index", this->index->json()},
+                {"type", this->type()}
+            };
+
+            return j;
+        }
+};
+
+// array[index] = value;
+class IndexAssignStatement : public Statement{
+    public:
+        IndexExpression* target;
+        Expression* right_value;
+
+        IndexAssignStatement(IndexExpression* target, Expression* right_value) : target(target), right_value(right_value){}
+
+        std::string type(){
+            return node_type_map[NodeType::IndexAssignStatement];
+        }
+
+        NodeType type_enum(){
+            return NodeType::IndexAssignStatement;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json j {
+                {"right_value", this->right_value->json()},
+                {"target", this->target->json()},
+                {"type", this->type()}
+            };
+
+            return j;
+        }
+};
+
 class IntegerLiteral : public Expression{
     public:
         int value;
@@ -487,6 +630,63 @@ class BooleanLiteral : public Expression{
                 {"type", this->type()}
             };
 
+            return j;
+        }
+};
+
+// "text", value holds the bytes with the escapes resolved
+class StringLiteral : public Expression{
+    public:
+        std::string value;
+
+        StringLiteral(std::string value) : value(value){}
+
+        std::string type(){
+            return node_type_map[NodeType::StringLiteral];
+        }
+
+        NodeType type_enum(){
+            return NodeType::StringLiteral;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json j {
+                {"value", this->value},
+                {"type", this->type()}
+            };
+
+            return j;
+        }
+};
+
+// [1.0, 2.0, 3.0], or [0.0; 8] for one element repeated
+class ArrayLiteral : public Expression{
+    public:
+        std::vector<Expression*> elements;
+        int repeat; // 0 unless the literal is [element; repeat]
+
+        ArrayLiteral(std::vector<Expression*> elements, int repeat = 0) : elements(elements), repeat(repeat){}
+
+        std::string type(){
+            return node_type_map[NodeType::ArrayLiteral];
+        }
+
+        NodeType type_enum(){
+            return NodeType::ArrayLiteral;
+        }
+
+        nlohmann::json json(){
+            nlohmann::json::array_t elements_json;
+            for (Expression* element : this->elements){
+                elements_json.push_back(element->json());
+            }
+
+            nlohmann::json j {
+                {"elements", elements_json},
+                {"repeat", this->repeat},
+                {"type", this->type()}
+            };
+
             return j;
         }
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+// Bump allocator for AST nodes. Memory comes from chunked pages and is released all at once when
+// the arena dies; objects with non-trivial destructors (strings, child vectors) are destroyed first,
+// in reverse order of allocation.
+class AstArena{
+    public:
+        AstArena(size_t page_size = 64 * 1024) : page_size(page_size){}
+
+        AstArena(const AstArena&) = delete;
+        AstArena& operator=(const AstArena&) = delete;
+
+        ~AstArena(){
+            for (auto it = this->finalizers.rbegin(); it != this->finalizers.rend(); it++){
+                it->destroy(it->object);
+            }
+            for (Page& page : this->pages){
+                std::free(page.data);
+            }
+        }
+
+        // construct a T inside the arena
+        template <typename T, typename... Args>
+        T* make(Args&&... args){
+            void* memory = this->allocate(sizeof(T), alignof(T));
+            T* object = new (memory) T(std::forward<Args>(args)...);
+
+            if constexpr (!std::is_trivially_destructible_v<T>){
+                this->finalizers.push_back({object, [](void* o){ static_cast<T*>(o)->~T(); }});
+            }
+            this->node_count += 1;
+
+            return object;
+        }
+
+        // raw aligned memory, lives as long as the arena
+        void* allocate(size_t size, size_t align){
+            size_t offset = (this->cursor + align - 1) & ~(align - 1);
+            if (this->pages.empty() || offset + size > this->pages.back().size){
+                // oversized requests get a page of their own
+                this->new_page(size + align > this->page_size ? size + align : this->page_size);
+                offset = (this->cursor + align - 1) & ~(align - 1);
+            }
+
+            void* memory = this->pages.back().data + offset;
+            this->used += size + (offset - this->cursor);
+            this->cursor = offset + size;
+            return memory;
+        }
+
+        // bytes handed out, including alignment padding
+        size_t bytes_used() const {
+            return this->used;
+        }
+
+        // bytes held in pages
+        size_t bytes_reserved() const {
+            return this->reserved;
+        }
+
+        size_t nodes_allocated() const {
+            return this->node_count;
+        }
+
+        size_t page_count() const {
+            return this->pages.size();
+        }
+
+    private:
+        struct Page{
+            char* data;
+            size_t size;
+        };
+
+        struct Finalizer{
+            void* object;
+            void (*destroy)(void*);
+        };
+
+        size_t page_size;
+        std::vector<Page> pages = {};
+        std::vector<Finalizer> finalizers = {};
+        size_t cursor = 0; // offset of the first free byte in the last page
+        size_t used = 0;
+        size_t reserved = 0;
+        size_t node_count = 0;
+
+        void new_page(size_t size){
+            char* data = static_cast<char*>(std::malloc(size));
+            if (data == nullptr){
+                throw std::bad_alloc();
+            }
+            this->pages.push_back({data, size});
+            this->cursor = 0;
+            this->reserved += size;
+        }
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "FlatAst.hpp"
+#include "SourceBuffer.hpp"
+
+// Binary cache of a parsed program, stored as its FlatAst.
+//
+// Layout (native byte order, so a cache only makes sense on the machine that wrote it):
+//   header   magic "LIGMAAST", version, section count, source hash, source size, root node
+//   sections nodes, lists, ints, floats, string offsets, string data; each one is a uint64 byte
+//            length followed by the raw array, padded to 8 bytes
+// The encoding is index-based, so loading needs no pointer fixups: the file is memory mapped,
+// validated, and every section is copied into its vector in one go.
+class AstCache{
+    public:
+        static constexpr uint32_t VERSION = 6;
+
+        // path of the cache that sits next to a source file
+        static std::string path_for(const std::string& source_path){
+            return source_path + ".astc";
+        }
+
+        // FNV-1a over the source bytes
+        static uint64_t hash(std::string_view source){
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (char c : source){
+                h ^= static_cast<uint8_t>(c);
+                h *= 0x100000001b3ull;
+            }
+            return h;
+        }
+
+        // write the cache to a uniquely named temporary file and move it into place, so concurrent
+        // writers never share a temporary, returns false on any I/O error
+        static bool write(const FlatAst& ast, std::string_view source, const std::string& path){
+            int fd = -1;
+            llvm::SmallString<128> tmp_path;
+            if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%%%.tmp", fd, tmp_path)){
+                return false;
+            }
+            llvm::raw_fd_ostream out(fd, true);
+
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.section_count = SECTION_COUNT;
+            header.source_hash = hash(source);
+            header.source_size = source.size();
+            header.root = ast.root;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            write_section(out, ast.nodes);
+            write_section(out, ast.lists);
+            write_section(out, ast.ints);
+            write_section(out, ast.floats);
+            write_section(out, ast.string_offsets);
+            write_section(out, ast.string_data);
+
+            out.close();
+            if (out.has_error()){
+                out.clear_error();
+                llvm::sys::fs::remove(tmp_path);
+                return false;
+            }
+            if (llvm::sys::fs::rename(tmp_path, path)){
+                llvm::sys::fs::remove(tmp_path);
+                return false;
+            }
+            return true;
+        }
+
+        // load the cache at path if it was written for exactly this source, std::nullopt otherwise
+        static std::optional<FlatAst> load(const std::string& path, std::string_view source){
+            std::shared_ptr<SourceBuffer> file = SourceBuffer::map_file(path);
+            if (!file){
+                return std::nullopt;
+            }
+
+            std::string_view bytes = file->view();
+            if (bytes.size() < sizeof(Header)){
+                return std::nullopt;
+            }
+
+            Header header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION || header.section_count != SECTION_COUNT
+                || header.source_size != source.size() || header.source_hash != hash(source)){
+                return std::nullopt;
+            }
+
+            FlatAst ast;
+            size_t offset = sizeof(Header);
+            if (!read_section(bytes, offset, ast.nodes) || !read_section(bytes, offset, ast.lists) || !read_section(bytes, offset, ast.ints)
+                || !read_section(bytes, offset, ast.floats) || !read_section(bytes, offset, ast.string_offsets) || !read_section(bytes, offset, ast.string_data)){
+                return std::nullopt;
+            }
+            ast.root = header.root;
+
+            if (!ast.valid()){
+                return std::nullopt;
+            }
+            return ast;
+        }
+
+    private:
+        static constexpr char MAGIC[8] = {'L', 'I', 'G', 'M', 'A', 'A', 'S', 'T'};
+        static constexpr uint32_t SECTION_COUNT = 6;
+
+        struct Header{
+            char magic[8];
+            uint32_t version;
+            uint32_t section_count;
+            uint64_t source_hash;
+            uint64_t source_size;
+            uint32_t root;
+            uint32_t reserved;
+        };
+
+        // items is a vector or string of trivially copyable values
+        template <typename C>
+        static void write_section(llvm::raw_ostream& out, const C& items){
+            uint64_t length = items.size() * sizeof(typename C::value_type);
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(reinterpret_cast<const char*>(items.data()), length);
+
+            static const char padding[8] = {};
+            out.write(padding, padded(length) - length);
+        }
+
+        // read one section starting at offset and advance past it, false if it doesn't fit the file
+        template <typename C>
+        static bool read_section(std::string_view bytes, size_t& offset, C& items){
+            using T = typename C::value_type;
+            uint64_t length;
+            if (bytes.size() - offset < sizeof(length)){
+                return false;
+            }
+            std::memcpy(&length, bytes.data() + offset, sizeof(length));
+            offset += sizeof(length);
+
+            if (length % sizeof(T) != 0 || length > bytes.size() - offset){
+                return false;
+            }
+            items.resize(length / sizeof(T));
+            if (length > 0){
+                std::memcpy(items.data(), bytes.data() + offset, length);
+            }
+
+            offset += std::min<uint64_t>(padded(length), bytes.size() - offset);
+            return true;
+        }
+
+        static uint64_t padded(uint64_t length){
+            return (length + 7) & ~uint64_t(7);
+        }
+};
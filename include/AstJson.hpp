@@ -0,0 +1,325 @@
+#pragma once
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Ast.hpp"
+
+// Writes a Program as JSON straight to a stream while walking the AST, no nlohmann::json tree is built.
+// The output is the same as program.json().dump(indent): keys in sorted order, statement lists as
+// ["Type", {...}] pairs, and a negative indent gives the compact form.
+class AstJsonWriter{
+    public:
+        AstJsonWriter(std::ostream& out, int indent = 4) : out(out), indent(indent){}
+
+        void write(Node* node){
+            if (node == nullptr){
+                this->out << "null";
+                return;
+            }
+
+            switch (node->type_enum()){
+                case NodeType::Program:{
+                    auto program = static_cast<Program*>(node);
+                    open('{');
+                    key("statements"); write_statements(program->statements);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::ExpressionStatement:{
+                    auto stmt = static_cast<ExpressionStatement*>(node);
+                    open('{');
+                    key("expr"); write(stmt->expr);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::LetStatement:{
+                    auto stmt = static_cast<LetStatement*>(node);
+                    open('{');
+                    key("name"); write(stmt->name);
+                    key("type"); write_string(node->type());
+                    key("value"); write(stmt->value);
+                    key("value_type"); write_string(stmt->value_type);
+                    close('}');
+                    break;
+                }
+                case NodeType::BlockStatement:{
+                    auto block = static_cast<BlockStatement*>(node);
+                    open('{');
+                    key("statements"); write_statements(block->statements);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::FunctionStatement:{
+                    auto func = static_cast<FunctionStatement*>(node);
+                    open('{');
+                    key("body"); write(func->body);
+                    key("name"); write(func->name);
+                    key("params"); write_list(func->params);
+                    key("return_type"); write_string(func->return_type);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::ReturnStatement:{
+                    auto stmt = static_cast<ReturnStatement*>(node);
+                    open('{');
+                    key("return_value"); write(stmt->return_value);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::AssignStatement:{
+                    auto stmt = static_cast<AssignStatement*>(node);
+                    open('{');
+                    key("ident"); write(stmt->ident);
+                    key("right_value"); write(stmt->right_value);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::IfStatement:{
+                    auto stmt = static_cast<IfStatement*>(node);
+                    open('{');
+                    key("alternative");
+                    if (stmt->alternative == nullptr){
+                        write_string("None");
+                    } else {
+                        write(stmt->alternative);
+                    }
+                    key("concequence"); write(stmt->concequence);
+                    key("condition"); write(stmt->condition);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::WhileStatement:{
+                    auto stmt = static_cast<WhileStatement*>(node);
+                    open('{');
+                    key("body"); write(stmt->body);
+                    key("condition"); write(stmt->condition);
+                    key("type"); write_string(node->type());
+                    key("unroll"); this->out << stmt->hints.unroll;
+                    key("vectorize"); this->out << stmt->hints.vectorize;
+                    close('}');
+                    break;
+                }
+                case NodeType::ForStatement:{
+                    auto stmt = static_cast<ForStatement*>(node);
+                    open('{');
+                    key("body"); write(stmt->body);
+                    key("end"); write(stmt->end);
+                    key("start"); write(stmt->start);
+                    key("type"); write_string(node->type());
+                    key("unroll"); this->out << stmt->hints.unroll;
+                    key("variable"); write(stmt->variable);
+                    key("vectorize"); this->out << stmt->hints.vectorize;
+                    close('}');
+                    break;
+                }
+                case NodeType::IndexAssignStatement:{
+                    auto stmt = static_cast<IndexAssignStatement*>(node);
+                    open('{');
+                    key("right_value"); write(stmt->right_value);
+                    key("target"); write(stmt->target);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::InfixExpression:{
+                    auto expr = static_cast<InfixExpression*>(node);
+                    open('{');
+                    key("left"); write(expr->left);
+                    key("op"); write_string(expr->op);
+                    key("right"); write(expr->right);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::CallExpression:{
+                    auto expr = static_cast<CallExpression*>(node);
+                    open('{');
+                    key("Function"); write(expr->Function);
+                    key("arguments"); write_list(expr->arguments);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::IndexExpression:{
+                    auto expr = static_cast<IndexExpression*>(node);
+                    open('{');
+                    key("array"); write(expr->array);
+                    key("index"); write(expr->index);
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::IntegerLiteral:{
+                    open('{');
+                    key("type"); write_string(node->type());
+                    key("value"); this->out << static_cast<IntegerLiteral*>(node)->value;
+                    close('}');
+                    break;
+                }
+                case NodeType::FloatLiteral:{
+                    open('{');
+                    key("type"); write_string(node->type());
+                    key("value"); write_float(static_cast<FloatLiteral*>(node)->value);
+                    close('}');
+                    break;
+                }
+                case NodeType::IdentifierLiteral:{
+                    open('{');
+                    key("type"); write_string(node->type());
+                    key("value"); write_string(static_cast<IdentifierLiteral*>(node)->value);
+                    close('}');
+                    break;
+                }
+                case NodeType::BooleanLiteral:{
+                    open('{');
+                    key("type"); write_string(node->type());
+                    key("value"); this->out << (static_cast<BooleanLiteral*>(node)->value ? "true" : "false");
+                    close('}');
+                    break;
+                }
+                case NodeType::ArrayLiteral:{
+                    auto literal = static_cast<ArrayLiteral*>(node);
+                    open('{');
+                    key("elements"); write_list(literal->elements);
+                    key("repeat"); this->out << literal->repeat;
+                    key("type"); write_string(node->type());
+                    close('}');
+                    break;
+                }
+                case NodeType::StringLiteral:{
+                    open('{');
+                    key("type"); write_string(node->type());
+                    key("value"); write_string(static_cast<StringLiteral*>(node)->value);
+                    close('}');
+                    break;
+                }
+                case NodeType::FunctionParameter:{
+                    auto param = static_cast<FunctionParameter*>(node);
+                    open('{');
+                    key("name"); write_string(param->name);
+                    key("type"); write_string(node->type());
+                    key("value_type"); write_string(param->value_type);
+                    close('}');
+                    break;
+                }
+                default:
+                    std::cerr << "Unhandled node type while writing json: " << node->type() << '\n';
+                    this->out << "null";
+            }
+        }
+
+    private:
+        std::ostream& out;
+        int indent;
+        int depth = 0;
+
+        // one entry per open object/array, true once it has an item
+        std::vector<bool> has_items = {};
+
+        void open(char bracket){
+            this->out << bracket;
+            this->depth++;
+            this->has_items.push_back(false);
+        }
+
+        void close(char bracket){
+            this->depth--;
+            if (this->has_items.back()){
+                newline();
+            }
+            this->has_items.pop_back();
+            this->out << bracket;
+        }
+
+        // separator and indentation before the next array item or object key
+        void item(){
+            if (this->has_items.back()){
+                this->out << ',';
+            }
+            this->has_items.back() = true;
+            newline();
+        }
+
+        void newline(){
+            if (this->indent >= 0){
+                this->out << '\n';
+                for (int i = 0; i < this->depth * this->indent; i++){
+                    this->out << ' ';
+                }
+            }
+        }
+
+        void key(std::string_view name){
+            item();
+            write_string(name);
+            this->out << (this->indent >= 0 ? ": " : ":");
+        }
+
+        // statement lists are arrays of ["Type", {...}] pairs
+        template <typename T>
+        void write_statements(const std::vector<T*>& statements){
+            open('[');
+            for (T* stmt : statements){
+                item();
+                open('[');
+                item(); write_string(stmt->type());
+                item(); write(stmt);
+                close(']');
+            }
+            close(']');
+        }
+
+        template <typename T>
+        void write_list(const std::vector<T*>& items){
+            open('[');
+            for (T* node : items){
+                item();
+                write(node);
+            }
+            close(']');
+        }
+
+        // same shortest round-trip digits nlohmann uses
+        void write_float(float value){
+            if (!std::isfinite(value)){
+                this->out << "null";
+                return;
+            }
+            char buffer[64];
+            char* end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(value));
+            this->out.write(buffer, end - buffer);
+        }
+
+        void write_string(std::string_view value){
+            static const char* hex = "0123456789abcdef";
+            this->out << '"';
+            for (char c : value){
+                switch (c){
+                    case '"': this->out << "\\\""; break;
+                    case '\\': this->out << "\\\\"; break;
+                    case '\b': this->out << "\\b"; break;
+                    case '\f': this->out << "\\f"; break;
+                    case '\n': this->out << "\\n"; break;
+                    case '\r': this->out << "\\r"; break;
+                    case '\t': this->out << "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20){
+                            this->out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                        } else {
+                            this->out << c;
+                        }
+                }
+            }
+            this->out << '"';
+        }
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "Ast.hpp"
+#include "FlatAst.hpp"
+
+// how a name is bound inside a function body
+struct BindingUse{
+    int lets = 0;
+    bool nested = false; // let inside an if or a loop, its value wouldn't dominate the code after it
+    bool assigned = false;
+
+    // bound once at the top of the body and never written again
+    bool single() const {
+        return this->lets == 1 && !this->nested && !this->assigned;
+    }
+};
+
+// how the names in a function body are bound, nested functions are left to their own pass
+inline void collect_bindings(Statement* node, int depth, std::map<std::string, BindingUse>& uses){
+    if (!node){
+        return;
+    }
+    switch (node->type_enum()){
+        case NodeType::BlockStatement:
+            for (Statement* stmt : static_cast<BlockStatement*>(node)->statements){
+                collect_bindings(stmt, depth, uses);
+            }
+            break;
+        case NodeType::LetStatement:{
+            auto let = static_cast<LetStatement*>(node);
+            if (let->name && let->value){
+                BindingUse& use = uses[static_cast<IdentifierLiteral*>(let->name)->value];
+                use.lets++;
+                use.nested |= depth > 0;
+            }
+            break;
+        }
+        case NodeType::AssignStatement:
+            uses[static_cast<AssignStatement*>(node)->ident->value].assigned = true;
+            break;
+        case NodeType::IfStatement:
+            collect_bindings(static_cast<IfStatement*>(node)->concequence, depth + 1, uses);
+            collect_bindings(static_cast<IfStatement*>(node)->alternative, depth + 1, uses);
+            break;
+        case NodeType::WhileStatement:
+            collect_bindings(static_cast<WhileStatement*>(node)->body, depth + 1, uses);
+            break;
+        case NodeType::ForStatement:
+            collect_bindings(static_cast<ForStatement*>(node)->body, depth + 1, uses);
+            break;
+        default:
+            break;
+    }
+}
+
+// mirrors collect_bindings for a flat AST
+inline void collect_bindings(const FlatAst& ast, uint32_t index, int depth, std::map<std::string, BindingUse>& uses){
+    if (index == FLAT_NONE){
+        return;
+    }
+    const FlatNode& node = ast.node(index);
+    switch (ast.tag(index)){
+        case NodeType::BlockStatement:
+            for (uint32_t stmt : ast.list(node.a)){
+                collect_bindings(ast, stmt, depth, uses);
+            }
+            break;
+        case NodeType::LetStatement:
+            if (node.a != FLAT_NONE && node.b != FLAT_NONE){
+                BindingUse& use = uses[std::string(ast.string(ast.node(node.a).a))];
+                use.lets++;
+                use.nested |= depth > 0;
+            }
+            break;
+        case NodeType::AssignStatement:
+            uses[std::string(ast.string(ast.node(node.a).a))].assigned = true;
+            break;
+        case NodeType::IfStatement:
+            collect_bindings(ast, node.b, depth + 1, uses);
+            collect_bindings(ast, node.c, depth + 1, uses);
+            break;
+        case NodeType::WhileStatement:
+            collect_bindings(ast, node.b, depth + 1, uses);
+            break;
+        case NodeType::ForStatement:
+            collect_bindings(ast, node.c, depth + 1, uses);
+            break;
+        default:
+            break;
+    }
+}
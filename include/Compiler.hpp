@@ -1,29 +1,71 @@
 #pragma once
 
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/NoFolder.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <map>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
 #include <tuple>
 #include <iostream>
 #include <memory> 
+#include <utility>
 
 #include "Ast.hpp"
+#include "FlatAst.hpp"
 #include "Environment.hpp"
+#include "Bindings.hpp"
+#include "Escapes.hpp"
+#include "ligma_runtime.h"
 
 enum class BuiltInFunction {
     PRINT,
+    LEN,
+    SUM,
+    DOT,
+    MIN,
+    MAX,
+    MAP,
+    FILL,
+    FREE,
+    EXTRACT,
+    INSERT,
+    SHUFFLE,
+    SLICE,
+    CONTAINS,
+    REMOVE,
+    ALLOCATIONS,
+    FREES,
     INVALID
 };
 
 BuiltInFunction get_builtin_function(std::string name){
     const std::map<std::string, BuiltInFunction> builtins = {
-        {"print", BuiltInFunction::PRINT}
+        {"print", BuiltInFunction::PRINT},
+        {"len", BuiltInFunction::LEN},
+        {"sum", BuiltInFunction::SUM},
+        {"dot", BuiltInFunction::DOT},
+        {"min", BuiltInFunction::MIN},
+        {"max", BuiltInFunction::MAX},
+        {"map", BuiltInFunction::MAP},
+        {"fill", BuiltInFunction::FILL},
+        {"free", BuiltInFunction::FREE},
+        {"extract", BuiltInFunction::EXTRACT},
+        {"insert", BuiltInFunction::INSERT},
+        {"shuffle", BuiltInFunction::SHUFFLE},
+        {"slice", BuiltInFunction::SLICE},
+        {"contains", BuiltInFunction::CONTAINS},
+        {"remove", BuiltInFunction::REMOVE},
+        {"allocations", BuiltInFunction::ALLOCATIONS},
+        {"frees", BuiltInFunction::FREES}
     };
     
     auto it = builtins.find(name);
@@ -36,11 +78,12 @@ BuiltInFunction get_builtin_function(std::string name){
 class Compiler {
 
 public:
-        // Constructor
-    Compiler(){
+        // Constructor, with define_builtins false the builtin globals are only declared because
+        // another module (compiled alongside this one) defines them
+    Compiler(bool define_builtins = true){
         this->module = new llvm::Module("main", context);
         this->env = new Environment();
-        initialize_builtins();
+        initialize_builtins(define_builtins);
     }
 
     // initiate compilation
@@ -74,10 +117,24 @@ public:
                 case NodeType::IfStatement:
                     visit_if_statement(static_cast<IfStatement*>(node));
                     break;
+                case NodeType::WhileStatement:
+                    visit_while_statement(static_cast<WhileStatement*>(node));
+                    break;
+                case NodeType::ForStatement:
+                    visit_for_statement(static_cast<ForStatement*>(node));
+                    break;
+                case NodeType::IndexAssignStatement:
+                    visit_index_assign_statement(static_cast<IndexAssignStatement*>(node));
+                    break;
                 
                 case NodeType::CallExpression:
                     visit_call_expression(static_cast<CallExpression*>(node));
                     break;
+                case NodeType::IndexExpression:
+                case NodeType::ArrayLiteral:
+                case NodeType::StringLiteral:
+                    resolve_value(static_cast<Expression*>(node));
+                    break;
 
                 default:
                     std::cout << "Node type: " << node->type() << '\n';
@@ -85,18 +142,56 @@ public:
             }
     }
 
+    // compile a flat AST: same lowering as compile(Node*), driven by a switch on the tag byte
+    void compile(const FlatAst& ast){
+        compile(ast, ast.root);
+    }
+
+    // compile a single node of a flat AST, e.g. one top-level function
+    void compile(const FlatAst& ast, uint32_t index){
+        this->flat = &ast;
+        compile_flat(index);
+        this->flat = nullptr;
+    }
+
+    // declare a function that is defined in another module, so calls to it resolve
+    void declare_function(const std::string& func_name, const std::vector<std::string>& param_type_names, const std::string& return_type_name){
+        std::vector<llvm::Type*> param_types;
+        for (const std::string& type_name : param_type_names){
+            param_types.push_back(abi_type(resolve_type(type_name)));
+        }
+        llvm::Type* return_type = resolve_type(return_type_name);
+        if (!return_type || std::count(param_types.begin(), param_types.end(), nullptr) > 0){
+            return;
+        }
+        llvm::FunctionType* func_type = llvm::FunctionType::get(return_type, param_types, false);
+
+        llvm::Function* func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, func_name, module);
+        this->env->define(func_name, func, return_type);
+    }
+
     // get module
     llvm::Module* get_module(){
         return this->module;
     }
 
+    // hand the module and the context it lives in over to a new owner (e.g. the JIT),
+    // nothing more can be compiled afterwards
+    std::pair<std::unique_ptr<llvm::LLVMContext>, std::unique_ptr<llvm::Module>> take_module(){
+        this->builder.ClearInsertionPoint();
+        std::unique_ptr<llvm::Module> module(this->module);
+        this->module = nullptr;
+        return std::make_pair(std::move(this->owned_context), std::move(module));
+    }
+
 private:
 
     // LLVM module
     llvm::Module* module;
 
-    // LLVM context and module
-    llvm::LLVMContext context;
+    // LLVM context and module, the context is heap allocated so take_module() can move it out
+    std::unique_ptr<llvm::LLVMContext> owned_context = std::make_unique<llvm::LLVMContext>();
+    llvm::LLVMContext& context = *owned_context;
 
     // Intermediate representation builder
     llvm::IRBuilder<> builder{context};
@@ -104,17 +199,56 @@ private:
     // Environment for variable tracking
     Environment* env;
 
+    // flat AST being compiled by compile(const FlatAst&)
+    const FlatAst* flat = nullptr;
+
+    // variables of the current function that live in a stack slot, every other one is an SSA value
+    std::set<std::string> mutable_names = {};
+
     // Errors encountered during compilation
     std::vector<std::string> errors = {};
 
-    // Map for basic types
+    // Map for basic and vector types, array and map types are added as they are resolved
     std::map<std::string, llvm::Type*> type_map = {
         {"int", llvm::Type::getInt32Ty(context)},
         {"float", llvm::Type::getFloatTy(context)},
-        {"bool", llvm::Type::getInt1Ty(context)}
+        {"bool", llvm::Type::getInt1Ty(context)},
+        {"vec4f", llvm::FixedVectorType::get(llvm::Type::getFloatTy(context), 4)},
+        {"vec8f", llvm::FixedVectorType::get(llvm::Type::getFloatTy(context), 8)},
+        {"vec4i", llvm::FixedVectorType::get(llvm::Type::getInt32Ty(context), 4)},
+        {"vec8i", llvm::FixedVectorType::get(llvm::Type::getInt32Ty(context), 8)},
+        {"string", llvm::StructType::create(context, {llvm::Type::getInt64Ty(context), llvm::Type::getInt64Ty(context)}, "string")}
     };
 
-    void initialize_builtins(){ // initialize builtin variables and functions
+    // {T*, i32} type of a dynamic array, by element type
+    std::map<llvm::Type*, llvm::StructType*> dynamic_array_types = {};
+
+    // key and value type of each map type
+    std::map<llvm::Type*, std::pair<llvm::Type*, llvm::Type*>> map_types = {};
+
+    // storage of the fixed-size array the last literal or map filled, a let binds it instead of copying
+    llvm::Value* fresh_array = nullptr;
+
+    // strings the statement being compiled owns (from concatenations, slices and calls), released
+    // when it is done unless a variable or a return took them over
+    std::vector<llvm::Value*> string_temporaries = {};
+
+    // stack slots of the string variables of the current function, released at every return
+    std::vector<llvm::AllocaInst*> string_slots = {};
+
+    // arrays of the current function that don't outlive it, allocated in its region
+    std::set<std::string> region_names = {};
+
+    // what those arrays are bound to, an SSA value or a slot, free() leaves them to the region
+    std::set<llvm::Value*> region_values = {};
+
+    // the region mark the current function took on entry, nullptr until it allocates in the region
+    llvm::Value* region_mark = nullptr;
+
+    // set while the value of a let of one of region_names is lowered
+    bool allocate_in_region = false;
+
+    void initialize_builtins(bool define){ // initialize builtin variables and functions
         
         // initialize booleans
         auto bool_type = type_map["bool"];
@@ -122,9 +256,9 @@ private:
         auto true_val = llvm::ConstantInt::get(context, llvm::APInt(1, 1, true));
         auto false_val = llvm::ConstantInt::get(context, llvm::APInt(1, 0, true));
 
-        // create global variables for true and false
-        llvm::GlobalVariable* true_var = new llvm::GlobalVariable(*module, bool_type, true, llvm::GlobalValue::ExternalLinkage, true_val, "true");
-        llvm::GlobalVariable* false_var = new llvm::GlobalVariable(*module, bool_type, true, llvm::GlobalValue::ExternalLinkage, false_val, "false");
+        // create global variables for true and false, without initializers they are declarations
+        llvm::GlobalVariable* true_var = new llvm::GlobalVariable(*module, bool_type, true, llvm::GlobalValue::ExternalLinkage, define ? true_val : nullptr, "true");
+        llvm::GlobalVariable* false_var = new llvm::GlobalVariable(*module, bool_type, true, llvm::GlobalValue::ExternalLinkage, define ? false_val : nullptr, "false");
 
         true_var->setConstant(true);
         false_var->setConstant(true);
@@ -150,6 +284,7 @@ private:
         // Compile statements inside the program
         for (Statement* stmt : node->statements){
             compile(stmt);
+            release_string_temporaries();
         }
 
         // Return a constant value
@@ -169,30 +304,21 @@ private:
             
             // value of the variable
             Expression* value = node->value;
-            auto [val, type] = resolve_value(value);
-
-            // if variable doesnt exist, create a new variable
-            if (this->env->lookup(name) == std::make_tuple(nullptr, nullptr)){
-                llvm::AllocaInst* ptr = this->builder.CreateAlloca(type, nullptr, name);
-                this->builder.CreateStore(val, ptr);
-                this->env->define(name, ptr, type);
-            } else {
-                auto [ptr, type] = this->env->lookup(name);
-                this->builder.CreateStore(val, ptr);
-            }
+            emit_region_let(name, [this, value](){ return resolve_value(value); });
         }
     }
 
     void visit_block_statement(BlockStatement* node){
         for (Statement* stmt : node->statements){
             compile(stmt);
+            release_string_temporaries();
         }
     }
 
     void visit_return_statement(ReturnStatement* node){
         auto ret_val = node->return_value;
         auto [val, type] = resolve_value(ret_val);
-        this->builder.CreateRet(val);
+        emit_return(val);
     }
 
     void visit_function_statement(FunctionStatement* node){
@@ -200,31 +326,484 @@ private:
         // function name
         std::string func_name = static_cast<IdentifierLiteral*>(node->name)->value;
 
-
         // function body
         BlockStatement* body = static_cast<BlockStatement*>(node->body);
 
         // function parameters
-        std::vector<FunctionParameter*> params = node->params;
-
         std::vector<std::string> param_names;
-        for (FunctionParameter* param : params){
+        std::vector<std::string> param_types;
+        for (FunctionParameter* param : node->params){
             param_names.push_back(param->name);
+            param_types.push_back(param->value_type);
+        }
+
+        std::map<std::string, BindingUse> uses;
+        collect_bindings(body, 0, uses);
+        ArrayEscapes escapes(unshadowed_builtins());
+        collect_escapes(body, 0, false, escapes);
+
+        emit_function(func_name, param_names, param_types, node->return_type, stack_names(uses, param_names), escapes.region_names(), [this, body](){
+            compile(body);
+        });
+    }
+
+
+    void visit_assign_statement(AssignStatement* node){
+
+        // variable name
+        std::string name = node->ident->value;
+
+        // value of the variable
+        Expression* value = node->right_value;
+        auto [val, type] = resolve_value(value);
+
+        emit_assign(name, val, type);
+    }
+
+    void visit_if_statement(IfStatement* node){
+
+        auto condition = node->condition;
+        auto consequence = node->concequence;
+        auto alternative = node->alternative;
+
+        auto [cond_val, cond_type] = resolve_value(condition);
+
+        emit_if(cond_val, [this, consequence](){ compile(consequence); }, [this, alternative](){ compile(alternative); });
+    }
+
+    void visit_index_assign_statement(IndexAssignStatement* node){
+        auto [array_val, array_type] = resolve_value(node->target->array);
+        auto [index_val, index_type] = resolve_value(node->target->index);
+        auto [val, type] = resolve_value(node->right_value);
+        emit_index_assign(array_val, array_type, index_val, index_type, val, type);
+    }
+
+    void visit_while_statement(WhileStatement* node){
+        auto condition = node->condition;
+        auto body = node->body;
+        emit_while([this, condition](){ return resolve_value(condition); }, [this, body](){ compile(body); }, node->hints);
+    }
+
+    void visit_for_statement(ForStatement* node){
+        auto [start_val, start_type] = resolve_value(node->start);
+        auto [end_val, end_type] = resolve_value(node->end);
+        auto body = node->body;
+        emit_for(node->variable->value, start_val, start_type, end_val, end_type, [this, body](){ compile(body); }, node->hints);
+    }
+
+
+    // infix expressions
+    std::tuple<llvm::Value*, llvm::Type*> visit_infix_expression(InfixExpression* node){
+        if (node->left && node->right) {
+            auto [left_value, left_type] = resolve_value(node->left); 
+            auto [right_value, right_type] = resolve_value(node->right);
+            return emit_infix(node->op, left_value, left_type, right_value, right_type);
+        }
+        return std::make_tuple(nullptr, nullptr);
+    }
+
+    // call expressions -> func()
+    std::tuple<llvm::Value*, llvm::Type*> visit_call_expression(CallExpression* node){
+
+        std::string func_name = static_cast<IdentifierLiteral*>(node->Function)->value;
+        std::vector<llvm::Value*> params_values;
+        std::vector<llvm::Type*> params_types;
+
+        for (Expression* param : node->arguments){
+            auto [p_val, p_type] = resolve_value(param);
+            params_values.push_back(p_val);
+            params_types.push_back(p_type);
+        }
+
+        return emit_call(func_name, params_values, params_types);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> resolve_value(Expression* node, std::optional<std::string> value_type = std::nullopt){
+        if (node) {
+            switch(node->type_enum()){
+                case NodeType::IntegerLiteral:{
+                    return emit_integer(static_cast<IntegerLiteral*>(node)->value);
+                }
+                case NodeType::FloatLiteral:{
+                    return emit_float(static_cast<FloatLiteral*>(node)->value);
+                }
+                case NodeType::IdentifierLiteral:{
+                    return emit_identifier(static_cast<IdentifierLiteral*>(node)->value);
+                }
+                case NodeType::InfixExpression:{
+                    return visit_infix_expression(static_cast<InfixExpression*>(node));
+                }
+                case NodeType::BooleanLiteral:{
+                    return emit_boolean(static_cast<BooleanLiteral*>(node)->value);
+                }
+                case NodeType::StringLiteral:{
+                    return emit_string(static_cast<StringLiteral*>(node)->value);
+                }
+                case NodeType::CallExpression:{
+                    return visit_call_expression(static_cast<CallExpression*>(node));
+                }
+                case NodeType::IndexExpression:{
+                    auto expr = static_cast<IndexExpression*>(node);
+                    auto [array_val, array_type] = resolve_value(expr->array);
+                    auto [index_val, index_type] = resolve_value(expr->index);
+                    return emit_index(array_val, array_type, index_val, index_type);
+                }
+                case NodeType::ArrayLiteral:{
+                    auto literal = static_cast<ArrayLiteral*>(node);
+                    std::vector<llvm::Value*> values;
+                    std::vector<llvm::Type*> types;
+                    for (Expression* element : literal->elements){
+                        auto [e_val, e_type] = resolve_value(element);
+                        values.push_back(e_val);
+                        types.push_back(e_type);
+                    }
+                    return emit_array_literal(values, types, literal->repeat);
+                }
+                default:
+                    std::cerr << "Unhandled node type during value resolution\n";
+            }
+        }
+        return std::make_tuple(nullptr, nullptr);
+    }
+
+// --------------------------------------- FLAT AST ---------------------------------------
+    // statements of a flat AST, mirrors compile(Node*) / the visit_* functions
+    void compile_flat(uint32_t index){
+        if (index == FLAT_NONE){
+            return;
+        }
+
+        const FlatAst& ast = *this->flat;
+        const FlatNode& node = ast.node(index);
+
+        switch (ast.tag(index)){
+            case NodeType::Program:
+            case NodeType::BlockStatement:
+                for (uint32_t stmt : ast.list(node.a)){
+                    compile_flat(stmt);
+                    release_string_temporaries();
+                }
+                break;
+            case NodeType::ExpressionStatement:
+                resolve_flat(node.a);
+                break;
+            case NodeType::LetStatement:{
+                if (node.a != FLAT_NONE && node.b != FLAT_NONE){
+                    uint32_t value = node.b;
+                    emit_region_let(std::string(ast.string(ast.node(node.a).a)), [this, value](){ return resolve_flat(value); });
+                }
+                break;
+            }
+            case NodeType::FunctionStatement:{
+                std::vector<std::string> param_names;
+                std::vector<std::string> param_types;
+                for (uint32_t param : ast.list(node.d)){
+                    param_names.push_back(std::string(ast.string(ast.node(param).a)));
+                    param_types.push_back(std::string(ast.string(ast.node(param).b)));
+                }
+
+                uint32_t body = node.b;
+                std::map<std::string, BindingUse> uses;
+                collect_bindings(ast, body, 0, uses);
+                ArrayEscapes escapes(unshadowed_builtins());
+                collect_escapes(ast, body, 0, false, false, escapes);
+
+                emit_function(std::string(ast.string(ast.node(node.a).a)), param_names, param_types, std::string(ast.string(node.c)), stack_names(uses, param_names), escapes.region_names(), [this, body](){
+                    compile_flat(body);
+                });
+                break;
+            }
+            case NodeType::ReturnStatement:{
+                auto [val, type] = resolve_flat(node.a);
+                emit_return(val);
+                break;
+            }
+            case NodeType::AssignStatement:{
+                auto [val, type] = resolve_flat(node.b);
+                emit_assign(std::string(ast.string(ast.node(node.a).a)), val, type);
+                break;
+            }
+            case NodeType::IfStatement:{
+                auto [cond_val, cond_type] = resolve_flat(node.a);
+                uint32_t consequence = node.b;
+                uint32_t alternative = node.c;
+                emit_if(cond_val, [this, consequence](){ compile_flat(consequence); }, [this, alternative](){ compile_flat(alternative); });
+                break;
+            }
+            case NodeType::WhileStatement:{
+                uint32_t condition = node.a;
+                uint32_t body = node.b;
+                emit_while([this, condition](){ return resolve_flat(condition); }, [this, body](){ compile_flat(body); }, unpack_loop_hints(node.d));
+                break;
+            }
+            case NodeType::ForStatement:{
+                std::span<const uint32_t> range = ast.list(node.b);
+                auto [start_val, start_type] = resolve_flat(range[0]);
+                auto [end_val, end_type] = resolve_flat(range[1]);
+                uint32_t body = node.c;
+                emit_for(std::string(ast.string(ast.node(node.a).a)), start_val, start_type, end_val, end_type, [this, body](){ compile_flat(body); }, unpack_loop_hints(node.d));
+                break;
+            }
+            case NodeType::IndexAssignStatement:{
+                const FlatNode& target = ast.node(node.a);
+                auto [array_val, array_type] = resolve_flat(target.a);
+                auto [index_val, index_type] = resolve_flat(target.b);
+                auto [val, type] = resolve_flat(node.b);
+                emit_index_assign(array_val, array_type, index_val, index_type, val, type);
+                break;
+            }
+            case NodeType::InfixExpression:
+            case NodeType::CallExpression:
+            case NodeType::IndexExpression:
+            case NodeType::ArrayLiteral:
+            case NodeType::StringLiteral:
+                resolve_flat(index);
+                break;
+            default:
+                std::cerr << "Unknown node type encountered during compilation\n";
+        }
+    }
+
+    // expressions of a flat AST, mirrors resolve_value
+    std::tuple<llvm::Value*, llvm::Type*> resolve_flat(uint32_t index){
+        if (index == FLAT_NONE){
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        const FlatAst& ast = *this->flat;
+        const FlatNode& node = ast.node(index);
+
+        switch (ast.tag(index)){
+            case NodeType::IntegerLiteral:
+                return emit_integer(ast.ints[node.a]);
+            case NodeType::FloatLiteral:
+                return emit_float(ast.floats[node.a]);
+            case NodeType::BooleanLiteral:
+                return emit_boolean(node.a != 0);
+            case NodeType::StringLiteral:
+                return emit_string(ast.string(node.a));
+            case NodeType::IdentifierLiteral:
+                return emit_identifier(std::string(ast.string(node.a)));
+            case NodeType::InfixExpression:{
+                if (node.a == FLAT_NONE || node.b == FLAT_NONE){
+                    return std::make_tuple(nullptr, nullptr);
+                }
+                auto [left_value, left_type] = resolve_flat(node.a);
+                auto [right_value, right_type] = resolve_flat(node.b);
+                return emit_infix(ast.string(node.c), left_value, left_type, right_value, right_type);
+            }
+            case NodeType::CallExpression:{
+                std::vector<llvm::Value*> params_values;
+                std::vector<llvm::Type*> params_types;
+                for (uint32_t arg : ast.list(node.b)){
+                    auto [p_val, p_type] = resolve_flat(arg);
+                    params_values.push_back(p_val);
+                    params_types.push_back(p_type);
+                }
+                return emit_call(std::string(ast.string(ast.node(node.a).a)), params_values, params_types);
+            }
+            case NodeType::IndexExpression:{
+                auto [array_val, array_type] = resolve_flat(node.a);
+                auto [index_val, index_type] = resolve_flat(node.b);
+                return emit_index(array_val, array_type, index_val, index_type);
+            }
+            case NodeType::ArrayLiteral:{
+                std::vector<llvm::Value*> values;
+                std::vector<llvm::Type*> types;
+                for (uint32_t element : ast.list(node.a)){
+                    auto [e_val, e_type] = resolve_flat(element);
+                    values.push_back(e_val);
+                    types.push_back(e_type);
+                }
+                return emit_array_literal(values, types, int(node.b));
+            }
+            default:
+                std::cerr << "Unhandled node type during value resolution\n";
+        }
+        return std::make_tuple(nullptr, nullptr);
+    }
+
+// --------------------------------------- BINDINGS ---------------------------------------
+    // A variable that is bound once and never reassigned is an SSA value: a let binds the value it
+    // was given and a parameter binds the argument. The rest get a stack slot in the entry block.
+
+    // names that need a stack slot: reassigned, declared more than once or inside an if or a loop,
+    // and parameters that are assigned or redeclared
+    static std::set<std::string> stack_names(const std::map<std::string, BindingUse>& uses, const std::vector<std::string>& param_names){
+        std::set<std::string> names;
+        for (const auto& [name, use] : uses){
+            if (!use.single()){
+                names.insert(name);
+            }
+        }
+        for (const std::string& name : param_names){
+            auto it = uses.find(name);
+            if (it != uses.end() && (it->second.assigned || it->second.lets > 0)){
+                names.insert(name);
+            }
+        }
+        return names;
+    }
+
+    // stack slots and globals are loaded from, SSA bindings are used as they are
+    static bool is_slot(llvm::Value* value){
+        return llvm::isa<llvm::AllocaInst>(value) || llvm::isa<llvm::GlobalVariable>(value);
+    }
+
+    // allocas all go at the top of the entry block, where mem2reg can promote them
+    llvm::AllocaInst* create_entry_alloca(llvm::Type* type, const std::string& name){
+        llvm::BasicBlock& entry = this->builder.GetInsertBlock()->getParent()->getEntryBlock();
+        llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+        return entry_builder.CreateAlloca(type, nullptr, name);
+    }
+
+    // aligned storage for a fixed-size array in the entry block, as a pointer to its first element
+    llvm::Value* create_array_storage(llvm::ArrayType* type, const std::string& name){
+        llvm::AllocaInst* storage = create_entry_alloca(type, name);
+        storage->setAlignment(llvm::Align(ARRAY_ALIGNMENT));
+        llvm::IRBuilder<> entry_builder(storage->getParent(), std::next(storage->getIterator()));
+        return entry_builder.CreateConstInBoundsGEP2_32(type, storage, 0, 0, name + ".data");
+    }
+
+// --------------------------------------- CODE GENERATION ---------------------------------------
+    // shared by the pointer and flat AST walks, operands are already lowered
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_integer(int value){
+        auto type_i = type_map["int"];
+        return std::make_tuple(llvm::ConstantInt::get(context, llvm::APInt(32, value, true)), type_i);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_float(float value){
+        auto type_f = type_map["float"];
+        return std::make_tuple(llvm::ConstantFP::get(context, llvm::APFloat(value)), type_f);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_boolean(bool value){
+        auto type_b = llvm::Type::getInt1Ty(context);
+        return std::make_tuple(llvm::ConstantInt::get(context, llvm::APInt(1, value, true)), type_b);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_identifier(const std::string& name){
+        this->fresh_array = nullptr;
+        auto [value, type] = env->lookup(name);
+        // a fixed-size array is used through the pointer to its storage
+        if (value && type && type->isArrayTy())
+            return std::make_tuple(value, type);
+        else if (value && is_slot(value))
+            return std::make_tuple(builder.CreateLoad(type, value), type);
+        else if (value)
+            return std::make_tuple(value, type);
+        else
+            std::cerr << "Undefined variable: " << name << '\n';
+        return std::make_tuple(nullptr, nullptr);
+    }
+
+    void emit_let(const std::string& name, llvm::Value* val, llvm::Type* type){
+        auto [ptr, ptr_type] = this->env->lookup(name);
+        // a fixed-size array gets its own storage, the one a literal just filled or a copy
+        if (type && type->isArrayTy()){
+            bool fresh = val == this->fresh_array;
+            this->fresh_array = nullptr;
+            if (ptr && ptr_type == type){
+                copy_array(ptr, val, type);
+            } else if (fresh){
+                this->env->define(name, val, type);
+            } else {
+                llvm::Value* storage = create_array_storage(llvm::cast<llvm::ArrayType>(type), name);
+                copy_array(storage, val, type);
+                this->env->define(name, storage, type);
+            }
+            return;
+        }
+
+        // a string variable always has a slot, which owns its string. The let may run again (in a
+        // loop) over a slot that still holds the string of the last run, which is released
+        if (is_string(type)){
+            llvm::Value* owned = take_string(val);
+            llvm::Value* slot = ptr && is_slot(ptr) ? ptr : create_string_slot(name);
+            llvm::Value* old = this->builder.CreateLoad(type, slot);
+            this->builder.CreateStore(owned, slot);
+            emit_string_release(old);
+            return;
         }
 
-        // function parameter types
-        std::vector<llvm::Type*> param_types = [this, &params](){
-            std::vector<llvm::Type*> types;
-            for (FunctionParameter* param : params){
-                types.push_back(type_map[param->value_type]);
+        // redeclaring a variable stores to its slot
+        if (ptr && is_slot(ptr)){
+            this->builder.CreateStore(val, ptr);
+        } else if (this->mutable_names.count(name) > 0){
+            llvm::AllocaInst* slot = create_entry_alloca(type, name);
+            this->builder.CreateStore(val, slot);
+            this->env->define(name, slot, type);
+        } else {
+            // bind the value itself, named after the variable when it is an unnamed instruction
+            if (val && llvm::isa<llvm::Instruction>(val) && !val->hasName()){
+                val->setName(name);
+            }
+            this->env->define(name, val, type);
+        }
+    }
+
+    void emit_assign(const std::string& name, llvm::Value* val, llvm::Type* type){
+        // if you are trying to assign a value to a variable that has not been defined
+        if (this->env->lookup(name) == std::make_tuple(nullptr, nullptr)){
+            this->errors.push_back("COMPILE ERROR: Identifier " + name + " has not been defined before its re-assigned");   
+        } else {
+            auto [ptr, ptr_type] = this->env->lookup(name);
+            if (ptr_type && ptr_type->isArrayTy()){
+                // fixed-size arrays are assigned element by element, into the same storage
+                this->fresh_array = nullptr;
+                if (type == ptr_type){
+                    copy_array(ptr, val, ptr_type);
+                } else {
+                    this->errors.push_back("COMPILE ERROR: Identifier " + name + " can't be assigned an array of another type or length");
+                }
+            } else if (is_slot(ptr) && is_string(ptr_type)){
+                llvm::Value* owned = take_string(val);
+                llvm::Value* old = this->builder.CreateLoad(ptr_type, ptr);
+                this->builder.CreateStore(owned, ptr);
+                emit_string_release(old);
+            } else if (is_slot(ptr)){
+                this->builder.CreateStore(val, ptr);
+            } else {
+                this->errors.push_back("COMPILE ERROR: Identifier " + name + " can't be re-assigned");
             }
-            return types;
-        }();
+        }
+    }
+
+    // a string returned goes to the caller owned, the string variables are released just before the
+    // ret once the whole function is compiled
+    void emit_return(llvm::Value* val){
+        if (val && is_string(val->getType())){
+            val = take_string(val);
+        }
+        release_string_temporaries();
+        this->builder.CreateRet(val);
+    }
+
+    // declare a function, then compile its body in a new scope via compile_body(),
+    // stack_names are the variables of the body that need a stack slot and region_names the arrays
+    // it can allocate in its region
+    template <typename F>
+    void emit_function(const std::string& func_name, const std::vector<std::string>& param_names, const std::vector<std::string>& param_type_names, const std::string& return_type_name, std::set<std::string> stack_names, std::set<std::string> region_names, F compile_body){
 
+        // function parameter types, fixed-size arrays are passed as a pointer to their storage
+        std::vector<llvm::Type*> param_types;
+        std::vector<llvm::Type*> arg_types;
+        for (const std::string& type_name : param_type_names){
+            param_types.push_back(resolve_type(type_name));
+            arg_types.push_back(abi_type(param_types.back()));
+        }
 
         // function return type
-        llvm::Type* return_type = type_map[node->return_type];
-        llvm::FunctionType* func_type = llvm::FunctionType::get(return_type, param_types, false);
+        llvm::Type* return_type = resolve_type(return_type_name);
+        if (!return_type || std::count(param_types.begin(), param_types.end(), nullptr) > 0){
+            return;
+        }
+        if (return_type->isArrayTy()){
+            std::cerr << "Function " << func_name << " can't return a fixed-size array, it would outlive its storage; return " << return_type_name.substr(0, return_type_name.find(';')) << "] instead\n";
+            return;
+        }
+        llvm::FunctionType* func_type = llvm::FunctionType::get(return_type, arg_types, false);
 
         // create function
         llvm::Function* func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage, func_name, module);
@@ -238,23 +817,44 @@ private:
         auto prev_block = this->builder.GetInsertBlock();
         auto prev_point = this->builder.saveIP();
         auto prev_env = this->env;
-        auto prev_env_address = &prev_env;
+        auto prev_mutable_names = std::move(this->mutable_names);
+        this->mutable_names = std::move(stack_names);
+        auto prev_string_slots = std::move(this->string_slots);
+        auto prev_string_temporaries = std::move(this->string_temporaries);
+        this->string_slots.clear();
+        this->string_temporaries.clear();
+        auto prev_region_names = std::move(this->region_names);
+        auto prev_region_values = std::move(this->region_values);
+        auto prev_region_mark = this->region_mark;
+        this->region_names = std::move(region_names);
+        this->region_values.clear();
+        this->region_mark = nullptr;
 
-       
 
         // set the insert point to the function block
         this->builder.SetInsertPoint(block);
 
+        // parameters bind their argument, unless they are written to
         std::vector<llvm::Value*> params_ptrs = {};
         for (int i = 0; i < param_types.size(); i++){
             
             auto param_type = param_types[i];
             auto param_name = param_names[i];
 
-            llvm::AllocaInst* ptr = this->builder.CreateAlloca(param_type, nullptr, param_name);
-            this->builder.CreateStore(func->arg_begin() + i, ptr);
-
-            params_ptrs.push_back(ptr);
+            llvm::Argument* arg = func->getArg(i);
+            arg->setName(param_name);
+            if (this->mutable_names.count(param_name) > 0 && !param_type->isArrayTy()){
+                llvm::AllocaInst* ptr = this->builder.CreateAlloca(param_type, nullptr, param_name + ".addr");
+                this->builder.CreateStore(arg, ptr);
+                // the caller keeps its string, the slot takes a reference of its own
+                if (is_string(param_type)){
+                    emit_string_retain(arg);
+                    this->string_slots.push_back(ptr);
+                }
+                params_ptrs.push_back(ptr);
+            } else {
+                params_ptrs.push_back(arg);
+            }
         }
 
 
@@ -270,10 +870,18 @@ private:
         this->env->define(func_name, func, return_type);
 
         // compile the function body
-        compile(body);
+        compile_body();
+        release_string_slots(func);
+        leave_region(func);
 
         // restore the previous environment
         this->env = prev_env;
+        this->mutable_names = std::move(prev_mutable_names);
+        this->string_slots = std::move(prev_string_slots);
+        this->string_temporaries = std::move(prev_string_temporaries);
+        this->region_names = std::move(prev_region_names);
+        this->region_values = std::move(prev_region_values);
+        this->region_mark = prev_region_mark;
         
         // register the function in the global environment
         this->env->define(func_name, func, return_type);
@@ -284,266 +892,1464 @@ private:
 
     }
 
-
-    void visit_assign_statement(AssignStatement* node){
-
-        // variable name
-        std::string name = node->ident->value;
-
-        // value of the variable
-        Expression* value = node->right_value;
-        auto [val, type] = resolve_value(value);
-
-        // if you are trying to assign a value to a variable that has not been defined
-        if (this->env->lookup(name) == std::make_tuple(nullptr, nullptr)){
-            this->errors.push_back("COMPILE ERROR: Identifier " + name + " has not been defined before its re-assigned");   
-        } else {
-            auto [ptr, type] = this->env->lookup(name);
-            this->builder.CreateStore(val, ptr);
-        }
-    }
-
-    void visit_if_statement(IfStatement* node){
-
-        auto condition = node->condition;
-        auto consequence = node->concequence;
-        auto alternative = node->alternative;
-
-        auto [cond_val, cond_type] = resolve_value(condition);
+    // branch on cond_val, compile_else() may emit nothing
+    template <typename T, typename E>
+    void emit_if(llvm::Value* cond_val, T compile_then, E compile_else){
         llvm::Function* func = this->builder.GetInsertBlock()->getParent();
         llvm::BasicBlock* then_block = llvm::BasicBlock::Create(context, "then", func);
         llvm::BasicBlock* else_block = llvm::BasicBlock::Create(context, "else");
         llvm::BasicBlock* merge_block = llvm::BasicBlock::Create(context, "ifcont");
 
-        auto ip = this->builder.saveIP();
-
+        release_string_temporaries();
         this->builder.CreateCondBr(cond_val, then_block, else_block);
 
         this->builder.SetInsertPoint(then_block);
-        compile(consequence);
-        this->builder.CreateBr(merge_block);
+        compile_then();
+        branch_if_open(merge_block);
 
         func->insert(func->end(), else_block);
         this->builder.SetInsertPoint(else_block);
-        compile(alternative);
-        this->builder.CreateBr(merge_block);
+        compile_else();
+        branch_if_open(merge_block);
 
         func->insert(func->end(), merge_block);
         this->builder.SetInsertPoint(merge_block);
     }
 
+    // Loops are lowered to canonical form: the block before the loop is the preheader and falls into
+    // the header, the header tests the condition and branches to the body or the exit, and the body
+    // ends in the single latch that branches back to the header. The latch branch carries the loop's
+    // llvm.loop metadata, which is where LoopUnroll and LoopVectorize look for hints.
 
-    // infix expressions
-    std::tuple<llvm::Value*, llvm::Type*> visit_infix_expression(InfixExpression* node){
-        if (node->left && node->right) {
-            std::string op = node->op;
-            auto [left_value, left_type] = resolve_value(node->left); 
-            auto [right_value, right_type] = resolve_value(node->right);
-            llvm::Value* result = nullptr;
-            llvm::Type* result_type = nullptr;
-
-            // if both left and right values are integers
-            if (left_type == type_map["int"] && right_type == type_map["int"]){
-                switch (op[0]){
-                    case '+':
-                        result = this->builder.CreateAdd(left_value, right_value);                    
-                        break;
-                    case '-':
-                        result = builder.CreateSub(left_value, right_value);
-                        break;
-                    case '*':
-                        result = builder.CreateMul(left_value, right_value);
-                        break;
-                    case '/':
-                        result = builder.CreateSDiv(left_value, right_value);
-                        break;
-                    case '%':
-                        result = builder.CreateSRem(left_value, right_value);
-                        break;
-                    case '^':
-                        // TODO
-                        break;
-                    
-                    case '<':
-                        // if op length is 1, then it is a less than operator
-                        if (op.length() == 1){
-                            result = builder.CreateICmpSLT(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        if (op == "<="){
-                            result = builder.CreateICmpSLE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        break;
-                    case '>':
-                        // if op length is 1, then it is a greater than operator
-                        if (op.length() == 1){
-                            result = builder.CreateICmpSGT(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        if (op == ">="){
-                            result = builder.CreateICmpSGE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        break;
-                    case '=':
-                        if (op == "=="){
-                            result = builder.CreateICmpEQ(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        break;
-                    case '!':
-                        if (op == "!="){
-                            result = builder.CreateICmpNE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        break;
-                }
-            
-            // if both left and right values are floats
-            } else if (left_type == type_map["float"] && right_type == type_map["float"]){
-                switch (op[0]){
-                    case '+':
-                        result = builder.CreateFAdd(left_value, right_value);
-                        break;
-                    case '-':
-                        result = builder.CreateFSub(left_value, right_value);
-                        break;
-                    case '*':
-                        result = builder.CreateFMul(left_value, right_value);
-                        break;
-                    case '/':
-                        result = builder.CreateFDiv(left_value, right_value);
-                        break;
-                    case '%':
-                        result = builder.CreateFRem(left_value, right_value);
-                        break;
-                    case '^':
-                        // TODO
-                        break;
-                    case '<':
-                        // if op length is 1, then it is a less than operator
-                        if (op.length() == 1){
-                            result = builder.CreateFCmpOLT(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        if (op == "<="){
-                            result = builder.CreateFCmpOLE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        break;
-                    case '>':
-                        // if op length is 1, then it is a greater than operator
-                        if (op.length() == 1){
-                            result = builder.CreateFCmpOGT(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
-                        if (op == ">="){
-                            result = builder.CreateFCmpOGE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
+    template <typename C, typename B>
+    void emit_while(C compile_condition, B compile_body, const LoopHints& hints){
+        llvm::Function* func = this->builder.GetInsertBlock()->getParent();
+        llvm::BasicBlock* header = llvm::BasicBlock::Create(context, "while.header", func);
+        llvm::BasicBlock* body = llvm::BasicBlock::Create(context, "while.body");
+        llvm::BasicBlock* latch = llvm::BasicBlock::Create(context, "while.latch");
+        llvm::BasicBlock* exit = llvm::BasicBlock::Create(context, "while.exit");
+
+        this->builder.CreateBr(header);
+        this->builder.SetInsertPoint(header);
+        auto [cond_val, cond_type] = compile_condition();
+        release_string_temporaries();
+        this->builder.CreateCondBr(cond_val, body, exit);
+
+        func->insert(func->end(), body);
+        this->builder.SetInsertPoint(body);
+        compile_body();
+        branch_if_open(latch);
+
+        func->insert(func->end(), latch);
+        this->builder.SetInsertPoint(latch);
+        this->builder.CreateBr(header)->setMetadata(llvm::LLVMContext::MD_loop, loop_metadata(hints));
+
+        func->insert(func->end(), exit);
+        this->builder.SetInsertPoint(exit);
+    }
+
+    // for name in start..end: the induction variable is bound (read only) to name inside the body
+    template <typename B>
+    void emit_for(const std::string& name, llvm::Value* start, llvm::Type* start_type, llvm::Value* end, llvm::Type* end_type, B compile_body, const LoopHints& hints){
+        llvm::Type* int_type = type_map["int"];
+        if (!start || !end || start_type != int_type || end_type != int_type){
+            std::cerr << "The range of the for loop over " << name << " has to be int..int\n";
+            return;
+        }
+        release_string_temporaries();
+
+        emit_counted_loop(name, start, end, [&](llvm::PHINode* variable){
+            // the loop variable shadows whatever the name was bound to, until the loop ends
+            auto shadowed = this->env->records.find(name);
+            std::optional<std::tuple<llvm::Value*, llvm::Type*>> previous;
+            if (shadowed != this->env->records.end()){
+                previous = shadowed->second;
+            }
+            this->env->define(name, variable, int_type);
+
+            compile_body();
+
+            if (previous){
+                this->env->define(name, std::get<0>(*previous), std::get<1>(*previous));
+            } else {
+                this->env->records.erase(name);
+            }
+        }, hints);
+    }
+
+    // counted loop over start..end: the induction variable is a phi in the header, passed to
+    // compile_body(variable), and counts up by one in the latch. end is evaluated once, up front
+    template <typename B>
+    void emit_counted_loop(const std::string& name, llvm::Value* start, llvm::Value* end, B compile_body, const LoopHints& hints){
+        llvm::Type* int_type = type_map["int"];
+        llvm::BasicBlock* preheader = this->builder.GetInsertBlock();
+        llvm::Function* func = preheader->getParent();
+        llvm::BasicBlock* header = llvm::BasicBlock::Create(context, "for.header", func);
+        llvm::BasicBlock* body = llvm::BasicBlock::Create(context, "for.body");
+        llvm::BasicBlock* latch = llvm::BasicBlock::Create(context, "for.latch");
+        llvm::BasicBlock* exit = llvm::BasicBlock::Create(context, "for.exit");
+
+        this->builder.CreateBr(header);
+        this->builder.SetInsertPoint(header);
+        llvm::PHINode* variable = this->builder.CreatePHI(int_type, 2, name);
+        variable->addIncoming(start, preheader);
+        this->builder.CreateCondBr(this->builder.CreateICmpSLT(variable, end), body, exit);
+
+        func->insert(func->end(), body);
+        this->builder.SetInsertPoint(body);
+        compile_body(variable);
+        branch_if_open(latch);
+
+        // variable < end on the way in, so the increment can't overflow
+        func->insert(func->end(), latch);
+        this->builder.SetInsertPoint(latch);
+        llvm::Value* next = this->builder.CreateNSWAdd(variable, llvm::ConstantInt::get(int_type, 1), name + ".next");
+        variable->addIncoming(next, latch);
+        this->builder.CreateBr(header)->setMetadata(llvm::LLVMContext::MD_loop, loop_metadata(hints));
+
+        func->insert(func->end(), exit);
+        this->builder.SetInsertPoint(exit);
+    }
+
+    // distinct llvm.loop node (its first operand is itself) with the properties for the hints
+    llvm::MDNode* loop_metadata(const LoopHints& hints){
+        llvm::Type* int_type = type_map["int"];
+        std::vector<llvm::Metadata*> properties = {nullptr};
+        auto property = [&](const char* name, llvm::Constant* value){
+            properties.push_back(llvm::MDNode::get(context, {llvm::MDString::get(context, name), llvm::ConstantAsMetadata::get(value)}));
+        };
+
+        if (hints.unroll == 0){
+            properties.push_back(llvm::MDNode::get(context, {llvm::MDString::get(context, "llvm.loop.unroll.enable")}));
+        } else if (hints.unroll > 0){
+            property("llvm.loop.unroll.count", llvm::ConstantInt::get(int_type, hints.unroll));
+        }
+        if (hints.vectorize >= 0){
+            property("llvm.loop.vectorize.enable", llvm::ConstantInt::getTrue(context));
+        }
+        if (hints.vectorize > 0){
+            property("llvm.loop.vectorize.width", llvm::ConstantInt::get(int_type, hints.vectorize));
+        }
+
+        llvm::MDNode* loop = llvm::MDNode::getDistinct(context, properties);
+        loop->replaceOperandWith(0, loop);
+        return loop;
+    }
+
+    // fall through to target unless the block already ended (e.g. with a return)
+    void branch_if_open(llvm::BasicBlock* target){
+        if (this->builder.GetInsertBlock()->getTerminator() == nullptr){
+            this->builder.CreateBr(target);
+        }
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_infix(std::string_view op, llvm::Value* left_value, llvm::Type* left_type, llvm::Value* right_value, llvm::Type* right_type){
+        llvm::Value* result = nullptr;
+        llvm::Type* result_type = nullptr;
+
+        // a vector on either side makes it element-wise
+        if (is_vector(left_type) || is_vector(right_type)){
+            return emit_vector_infix(op, left_value, left_type, right_value, right_type);
+        }
+        if (is_string(left_type) || is_string(right_type)){
+            return emit_string_infix(op, left_value, left_type, right_value, right_type);
+        }
+
+        // if both left and right values are integers
+        if (left_type == type_map["int"] && right_type == type_map["int"]){
+            switch (op[0]){
+                case '+':
+                    result = this->builder.CreateAdd(left_value, right_value);                    
+                    break;
+                case '-':
+                    result = builder.CreateSub(left_value, right_value);
+                    break;
+                case '*':
+                    result = builder.CreateMul(left_value, right_value);
+                    break;
+                case '/':
+                    result = builder.CreateSDiv(left_value, right_value);
+                    break;
+                case '%':
+                    result = builder.CreateSRem(left_value, right_value);
+                    break;
+                case '^':
+                    result = emit_int_power(left_value, right_value);
+                    break;
+                
+                case '<':
+                    // if op length is 1, then it is a less than operator
+                    if (op.length() == 1){
+                        result = builder.CreateICmpSLT(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    if (op == "<="){
+                        result = builder.CreateICmpSLE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
                         break;
-                    case '=':
-                        if (op == "=="){
-                            result = builder.CreateFCmpOEQ(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
+                    }
+                    break;
+                case '>':
+                    // if op length is 1, then it is a greater than operator
+                    if (op.length() == 1){
+                        result = builder.CreateICmpSGT(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    if (op == ">="){
+                        result = builder.CreateICmpSGE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    break;
+                case '=':
+                    if (op == "=="){
+                        result = builder.CreateICmpEQ(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
                         break;
-                    case '!':
-                        if (op == "!="){
-                            result = builder.CreateFCmpONE(left_value, right_value);
-                            result_type = llvm::Type::getInt1Ty(context);
-                            break;
-                        }
+                    }
+                    break;
+                case '!':
+                    if (op == "!="){
+                        result = builder.CreateICmpNE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
                         break;
+                    }
+                    break;
+            }
+        
+        // if both left and right values are floats
+        } else if (left_type == type_map["float"] && right_type == type_map["float"]){
+            switch (op[0]){
+                case '+':
+                    result = builder.CreateFAdd(left_value, right_value);
+                    break;
+                case '-':
+                    result = builder.CreateFSub(left_value, right_value);
+                    break;
+                case '*':
+                    result = builder.CreateFMul(left_value, right_value);
+                    break;
+                case '/':
+                    result = builder.CreateFDiv(left_value, right_value);
+                    break;
+                case '%':
+                    result = builder.CreateFRem(left_value, right_value);
+                    break;
+                case '^':
+                    result = emit_float_power(left_value, right_value);
+                    break;
+                case '<':
+                    // if op length is 1, then it is a less than operator
+                    if (op.length() == 1){
+                        result = builder.CreateFCmpOLT(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    if (op == "<="){
+                        result = builder.CreateFCmpOLE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    break;
+                case '>':
+                    // if op length is 1, then it is a greater than operator
+                    if (op.length() == 1){
+                        result = builder.CreateFCmpOGT(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    if (op == ">="){
+                        result = builder.CreateFCmpOGE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    break;
+                case '=':
+                    if (op == "=="){
+                        result = builder.CreateFCmpOEQ(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    break;
+                case '!':
+                    if (op == "!="){
+                        result = builder.CreateFCmpONE(left_value, right_value);
+                        result_type = llvm::Type::getInt1Ty(context);
+                        break;
+                    }
+                    break;
+            }
+        }
+        // arithmetic results take the type of the value the builder produced
+        if (result != nullptr)
+            result_type = result->getType();
+        return std::make_tuple(result, result_type);
+    }
+
+// --------------------------------------- EXPONENTIATION ---------------------------------------
+    // constant exponents from 0 up to this are strength-reduced to multiplies
+    static constexpr int64_t MAX_UNROLLED_EXPONENT = 16;
+
+    // int ^ int: multiplies for a small constant exponent, otherwise a call to ligma.ipow
+    llvm::Value* emit_int_power(llvm::Value* base, llvm::Value* exponent){
+        if (auto constant = llvm::dyn_cast<llvm::ConstantInt>(exponent)){
+            int64_t n = constant->getSExtValue();
+            if (n >= 0 && n <= MAX_UNROLLED_EXPONENT){
+                return emit_power_multiplies(base, n);
+            }
+        }
+        return this->builder.CreateCall(int_power_function(), {base, exponent});
+    }
+
+    // float ^ float: multiplies for a small integral constant exponent, llvm.powi for any other
+    // integral constant and llvm.pow for the rest
+    llvm::Value* emit_float_power(llvm::Value* base, llvm::Value* exponent){
+        if (auto constant = llvm::dyn_cast<llvm::ConstantFP>(exponent); constant && constant->getValueAPF().isInteger()){
+            double n = constant->getValueAPF().convertToFloat();
+            if (n >= 0 && n <= MAX_UNROLLED_EXPONENT){
+                return emit_power_multiplies(base, static_cast<uint64_t>(n));
+            }
+            if (n >= INT32_MIN && n <= INT32_MAX){
+                llvm::Value* int_exponent = llvm::ConstantInt::get(type_map["int"], static_cast<int64_t>(n), true);
+                return this->builder.CreateIntrinsic(llvm::Intrinsic::powi, {base->getType(), int_exponent->getType()}, {base, int_exponent});
+            }
+        }
+        return this->builder.CreateBinaryIntrinsic(llvm::Intrinsic::pow, base, exponent);
+    }
+
+    // base^n by squaring, unrolled: x^2 is x*x, x^3 is x*(x*x)
+    llvm::Value* emit_power_multiplies(llvm::Value* base, uint64_t n){
+        bool is_float = base->getType()->isFloatingPointTy();
+        auto multiply = [&](llvm::Value* a, llvm::Value* b){
+            return is_float ? this->builder.CreateFMul(a, b) : this->builder.CreateMul(a, b);
+        };
+
+        llvm::Value* result = nullptr;
+        llvm::Value* square = base;
+        while (n > 0){
+            if (n & 1){
+                result = result ? multiply(result, square) : square;
+            }
+            n >>= 1;
+            if (n > 0){
+                square = multiply(square, square);
+            }
+        }
+        if (result){
+            return result;
+        }
+        return is_float ? llvm::ConstantFP::get(base->getType(), 1.0) : llvm::ConstantInt::get(base->getType(), 1);
+    }
+
+    // i32 ligma.ipow(i32 base, i32 exponent), exponentiation by squaring with wrapping multiplies.
+    // A negative exponent truncates like 1 / base^-exponent: 1 and -1 have a reciprocal, everything
+    // else (0 included) gives 0. Internal to every module that uses it, so modules link cleanly.
+    llvm::Function* int_power_function(){
+        if (llvm::Function* func = this->module->getFunction("ligma.ipow")){
+            return func;
+        }
+
+        llvm::Type* int_type = type_map["int"];
+        llvm::FunctionType* func_type = llvm::FunctionType::get(int_type, {int_type, int_type}, false);
+        llvm::Function* func = llvm::Function::Create(func_type, llvm::Function::InternalLinkage, "ligma.ipow", module);
+        llvm::Argument* base = func->getArg(0);
+        llvm::Argument* exponent = func->getArg(1);
+        base->setName("base");
+        exponent->setName("exponent");
+
+        llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", func);
+        llvm::BasicBlock* negative = llvm::BasicBlock::Create(context, "negative", func);
+        llvm::BasicBlock* loop = llvm::BasicBlock::Create(context, "loop", func);
+        llvm::BasicBlock* body = llvm::BasicBlock::Create(context, "body", func);
+        llvm::BasicBlock* done = llvm::BasicBlock::Create(context, "done", func);
+
+        auto constant = [int_type](int64_t value){ return llvm::ConstantInt::get(int_type, value, true); };
+        llvm::IRBuilder<> b(entry);
+        b.CreateCondBr(b.CreateICmpSLT(exponent, constant(0)), negative, loop);
+
+        b.SetInsertPoint(negative);
+        llvm::Value* odd_exponent = b.CreateICmpNE(b.CreateAnd(exponent, constant(1)), constant(0));
+        llvm::Value* minus_one_power = b.CreateSelect(odd_exponent, constant(-1), constant(1));
+        llvm::Value* reciprocal = b.CreateSelect(b.CreateICmpEQ(base, constant(-1)), minus_one_power, constant(0));
+        b.CreateRet(b.CreateSelect(b.CreateICmpEQ(base, constant(1)), constant(1), reciprocal));
+
+        b.SetInsertPoint(loop);
+        llvm::PHINode* result = b.CreatePHI(int_type, 2, "result");
+        llvm::PHINode* square = b.CreatePHI(int_type, 2, "square");
+        llvm::PHINode* remaining = b.CreatePHI(int_type, 2, "remaining");
+        b.CreateCondBr(b.CreateICmpEQ(remaining, constant(0)), done, body);
+
+        b.SetInsertPoint(body);
+        llvm::Value* odd = b.CreateICmpNE(b.CreateAnd(remaining, constant(1)), constant(0));
+        llvm::Value* next_result = b.CreateSelect(odd, b.CreateMul(result, square), result);
+        llvm::Value* next_square = b.CreateMul(square, square);
+        llvm::Value* next_remaining = b.CreateLShr(remaining, constant(1));
+        b.CreateBr(loop);
+
+        result->addIncoming(constant(1), entry);
+        result->addIncoming(next_result, body);
+        square->addIncoming(base, entry);
+        square->addIncoming(next_square, body);
+        remaining->addIncoming(exponent, entry);
+        remaining->addIncoming(next_remaining, body);
+
+        b.SetInsertPoint(done);
+        b.CreateRet(result);
+        return func;
+    }
+
+// --------------------------------------- ARRAYS ---------------------------------------
+    // Arrays hold int or float elements in one contiguous buffer, aligned for 256-bit vectors. A
+    // fixed-size [T; N] lives in a stack slot of its function and its value is a pointer to the
+    // first element, the length being part of its type ([N x T]); a let or an assignment copies it
+    // and a call passes it by reference. A dynamic [T] is a {T*, i32} pair of data pointer and
+    // length over a runtime heap block from fill() or map(), released with free(); copies share the
+    // block. One that doesn't outlive its function is in the function's region instead (see REGIONS).
+    // Indexing isn't bounds checked.
+    static constexpr uint64_t ARRAY_ALIGNMENT = LIGMA_ALIGNMENT;
+
+    // fixed-size arrays up to this long are reduced as one <N x T> vector, longer ones in a loop
+    static constexpr uint64_t MAX_VECTOR_LENGTH = 64;
+
+    // loops over the elements of an array are canonical and left unhinted; LoopVectorize widens them
+    // when the target has vector registers, where a forced hint would only warn when it can't
+    static constexpr LoopHints ARRAY_LOOP_HINTS = {};
+
+    // the type a type name stands for: int, float, bool, [T; N], [T] or map[K, V]. nullptr if there is none
+    llvm::Type* resolve_type(const std::string& name){
+        auto it = this->type_map.find(name);
+        if (it != this->type_map.end()){
+            return it->second;
+        }
+
+        llvm::Type* type = nullptr;
+        if (name.size() > 2 && name.front() == '[' && name.back() == ']'){
+            size_t semicolon = name.find(';');
+            llvm::Type* element = resolve_type(name.substr(1, std::min(semicolon, name.size() - 1) - 1));
+            if (is_numeric(element) && semicolon == std::string::npos){
+                type = dynamic_array_type(element);
+            } else if (is_numeric(element)){
+                uint64_t length = std::strtoull(name.c_str() + semicolon + 1, nullptr, 10);
+                type = length > 0 ? llvm::ArrayType::get(element, length) : nullptr;
+            }
+        } else if (name.rfind("map[", 0) == 0 && name.back() == ']' && name.find(", ") != std::string::npos){
+            size_t comma = name.find(", ");
+            type = map_type(name.substr(4, comma - 4), name.substr(comma + 2, name.size() - comma - 3));
+        }
+        if (!type){
+            std::cerr << "Unknown type: " << name << '\n';
+            return nullptr;
+        }
+        this->type_map[name] = type;
+        return type;
+    }
+
+    bool is_numeric(llvm::Type* type){
+        return type && (type == this->type_map["int"] || type == this->type_map["float"]);
+    }
+
+    llvm::StructType* dynamic_array_type(llvm::Type* element){
+        auto it = this->dynamic_array_types.find(element);
+        if (it != this->dynamic_array_types.end()){
+            return it->second;
+        }
+        std::string name = element == this->type_map["int"] ? "array.int" : "array.float";
+        llvm::StructType* type = llvm::StructType::create(context, {llvm::PointerType::getUnqual(element), this->type_map["int"]}, name);
+        this->dynamic_array_types[element] = type;
+        return type;
+    }
+
+    // element type of an array type, nullptr for any other type
+    llvm::Type* element_type(llvm::Type* type){
+        if (type && type->isArrayTy()){
+            return type->getArrayElementType();
+        }
+        for (const auto& [element, array_type] : this->dynamic_array_types){
+            if (array_type == type){
+                return element;
+            }
+        }
+        return nullptr;
+    }
+
+    // the type a value is passed to a function as
+    static llvm::Type* abi_type(llvm::Type* type){
+        if (type && type->isArrayTy()){
+            return llvm::PointerType::getUnqual(type->getArrayElementType());
+        }
+        return type;
+    }
+
+    llvm::Value* array_data(llvm::Value* array, llvm::Type* type){
+        return type->isArrayTy() ? array : this->builder.CreateExtractValue(array, 0, "data");
+    }
+
+    llvm::Value* array_length(llvm::Value* array, llvm::Type* type){
+        if (type->isArrayTy()){
+            return llvm::ConstantInt::get(this->type_map["int"], type->getArrayNumElements());
+        }
+        return this->builder.CreateExtractValue(array, 1, "length");
+    }
+
+    llvm::Value* make_dynamic_array(llvm::Value* data, llvm::Value* length, llvm::Type* element){
+        llvm::Value* array = llvm::UndefValue::get(dynamic_array_type(element));
+        array = this->builder.CreateInsertValue(array, data, 0);
+        return this->builder.CreateInsertValue(array, length, 1);
+    }
+
+    llvm::Value* element_pointer(llvm::Type* element, llvm::Value* data, llvm::Value* index){
+        return this->builder.CreateInBoundsGEP(element, data, index);
+    }
+
+    // the whole of a fixed-size array as one vector
+    llvm::Value* load_vector(llvm::Value* data, llvm::Type* type){
+        llvm::Type* vector_type = llvm::FixedVectorType::get(type->getArrayElementType(), type->getArrayNumElements());
+        llvm::Value* ptr = this->builder.CreateBitCast(data, llvm::PointerType::getUnqual(vector_type));
+        return this->builder.CreateAlignedLoad(vector_type, ptr, llvm::MaybeAlign(ARRAY_ALIGNMENT));
+    }
+
+    // copy the elements of a fixed-size array from src to dst
+    void copy_array(llvm::Value* dst, llvm::Value* src, llvm::Type* type){
+        if (!src || dst == src){
+            return;
+        }
+        uint64_t size = this->module->getDataLayout().getTypeAllocSize(type).getFixedValue();
+        this->builder.CreateMemCpy(dst, llvm::MaybeAlign(ARRAY_ALIGNMENT), src, llvm::MaybeAlign(ARRAY_ALIGNMENT), size);
+    }
+
+    // bytes of the block of a dynamic array of length elements, length isn't negative
+    llvm::Value* allocation_size(llvm::Type* element, llvm::Value* length){
+        llvm::Type* size_type = this->builder.getInt64Ty();
+        uint64_t element_size = this->module->getDataLayout().getTypeAllocSize(element).getFixedValue();
+        return this->builder.CreateNUWMul(this->builder.CreateZExt(length, size_type), llvm::ConstantInt::get(size_type, element_size), "bytes");
+    }
+
+    // block for length elements (none unless length is positive), as a dynamic array: from the
+    // function's region while a let of a region array is lowered, from the runtime's heap otherwise
+    llvm::Value* emit_allocate(llvm::Type* element, llvm::Value* length){
+        llvm::Type* int_type = this->type_map["int"];
+        llvm::Type* size_type = this->builder.getInt64Ty();
+        llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+
+        llvm::Value* zero = llvm::ConstantInt::get(int_type, 0);
+        length = this->builder.CreateSelect(this->builder.CreateICmpSGT(length, zero), length, zero);
+        llvm::Value* bytes = allocation_size(element, length);
+
+        llvm::Value* buffer = nullptr;
+        if (this->allocate_in_region && enter_region()){
+            buffer = this->builder.CreateCall(runtime_function("ligma_region_alloc", byte_pointer, {size_type}), {bytes}, "buffer");
+        } else {
+            buffer = this->builder.CreateCall(runtime_function("ligma_alloc", byte_pointer, {size_type}), {bytes}, "buffer");
+        }
+        return make_dynamic_array(this->builder.CreateBitCast(buffer, llvm::PointerType::getUnqual(element)), length, element);
+    }
+
+    // store value to every element of data[0..length)
+    void emit_fill(llvm::Value* data, llvm::Value* length, llvm::Value* value){
+        llvm::Type* element = value->getType();
+        emit_counted_loop("i", llvm::ConstantInt::get(this->type_map["int"], 0), length, [&](llvm::PHINode* i){
+            this->builder.CreateStore(value, element_pointer(element, data, i));
+        }, ARRAY_LOOP_HINTS);
+    }
+
+    // [a, b, c] or [value; repeat], in new fixed-size storage
+    std::tuple<llvm::Value*, llvm::Type*> emit_array_literal(const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types, int repeat){
+        llvm::Type* element = types.empty() ? nullptr : types[0];
+        bool valid = is_numeric(element);
+        for (size_t i = 0; i < values.size(); i++){
+            valid = valid && values[i] && types[i] == element;
+        }
+        if (!valid){
+            std::cerr << "Array elements have to be all int or all float\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        uint64_t length = repeat > 0 ? repeat : values.size();
+        llvm::ArrayType* type = llvm::ArrayType::get(element, length);
+        llvm::Value* storage = create_array_storage(type, "array");
+        if (repeat > 0){
+            emit_fill(storage, llvm::ConstantInt::get(this->type_map["int"], length), values[0]);
+        } else {
+            for (size_t i = 0; i < values.size(); i++){
+                this->builder.CreateStore(values[i], this->builder.CreateConstInBoundsGEP1_64(element, storage, i));
+            }
+        }
+        this->fresh_array = storage;
+        return std::make_tuple(storage, type);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_index(llvm::Value* array, llvm::Type* array_type, llvm::Value* index, llvm::Type* index_type){
+        if (array && is_map(array_type)){
+            return emit_map_index(array, array_type, index, index_type);
+        }
+        llvm::Type* element = element_type(array_type);
+        if (!array || !element || !index || index_type != this->type_map["int"]){
+            std::cerr << "Only arrays can be indexed, and only by an int\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+        llvm::Value* ptr = element_pointer(element, array_data(array, array_type), index);
+        return std::make_tuple(this->builder.CreateLoad(element, ptr), element);
+    }
+
+    void emit_index_assign(llvm::Value* array, llvm::Type* array_type, llvm::Value* index, llvm::Type* index_type, llvm::Value* val, llvm::Type* type){
+        if (array && is_map(array_type)){
+            emit_map_store(array, array_type, index, index_type, val, type);
+            return;
+        }
+        llvm::Type* element = element_type(array_type);
+        if (!array || !element || !index || index_type != this->type_map["int"]){
+            std::cerr << "Only arrays can be indexed, and only by an int\n";
+            return;
+        }
+        if (!val || type != element){
+            std::cerr << "The value assigned to an array element has to have the element type\n";
+            return;
+        }
+        this->builder.CreateStore(val, element_pointer(element, array_data(array, array_type), index));
+    }
+
+    // len, sum, dot, min, max, map, fill and free, and the vector, string and map builtins
+    std::tuple<llvm::Value*, llvm::Type*> emit_builtin(BuiltInFunction builtin, const std::string& func_name, const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types){
+        auto fail = [&func_name](const std::string& message){
+            std::cerr << func_name << "(): " << message << '\n';
+            return std::tuple<llvm::Value*, llvm::Type*>(nullptr, nullptr);
+        };
+        if (std::count(values.begin(), values.end(), nullptr) > 0){
+            return fail("invalid argument");
+        }
+
+        if (builtin == BuiltInFunction::PRINT){
+            return fail("not implemented yet");
+        }
+        if (builtin == BuiltInFunction::ALLOCATIONS || builtin == BuiltInFunction::FREES){
+            if (!values.empty()){
+                return fail("takes no arguments");
+            }
+            size_t counter = builtin == BuiltInFunction::ALLOCATIONS ? offsetof(ligma_alloc_counters, allocations) : offsetof(ligma_alloc_counters, frees);
+            return std::make_tuple(emit_alloc_counter(counter, func_name), this->type_map["int"]);
+        }
+        if (builtin == BuiltInFunction::CONTAINS || builtin == BuiltInFunction::REMOVE || (!types.empty() && is_map(types[0]))){
+            return emit_map_builtin(builtin, func_name, values, types);
+        }
+        if (builtin == BuiltInFunction::SLICE || (!types.empty() && is_string(types[0]))){
+            return emit_string_builtin(builtin, func_name, values, types);
+        }
+        if (builtin == BuiltInFunction::EXTRACT || builtin == BuiltInFunction::INSERT || builtin == BuiltInFunction::SHUFFLE
+            || (!types.empty() && is_vector(types[0]))){
+            return emit_vector_builtin(builtin, func_name, values, types);
+        }
+        if (builtin == BuiltInFunction::FILL){
+            if (values.size() != 2 || !is_numeric(types[0]) || types[1] != this->type_map["int"]){
+                return fail("expects an int or float value and an int length");
+            }
+            llvm::Type* type = dynamic_array_type(types[0]);
+            llvm::Value* array = emit_allocate(types[0], values[1]);
+            emit_fill(array_data(array, type), array_length(array, type), values[0]);
+            return std::make_tuple(array, type);
+        }
+
+        // the rest take an array first
+        size_t arity = builtin == BuiltInFunction::DOT || builtin == BuiltInFunction::MAP ? 2 : 1;
+        llvm::Type* element = values.empty() ? nullptr : element_type(types[0]);
+        if (values.size() != arity || !element){
+            return fail(arity == 1 ? "expects an array" : "expects an array and a second argument");
+        }
+
+        switch (builtin){
+            case BuiltInFunction::LEN:
+                return std::make_tuple(array_length(values[0], types[0]), this->type_map["int"]);
+            case BuiltInFunction::DOT:
+                if (element_type(types[1]) != element){
+                    return fail("expects two arrays of the same element type");
+                }
+                if (types[0]->isArrayTy() && types[1]->isArrayTy() && types[0]->getArrayNumElements() != types[1]->getArrayNumElements()){
+                    return fail("expects two fixed-size arrays of the same length");
+                }
+                return std::make_tuple(emit_reduce(builtin, values[0], types[0], values[1], types[1]), element);
+            case BuiltInFunction::SUM:
+            case BuiltInFunction::MIN:
+            case BuiltInFunction::MAX:
+                return std::make_tuple(emit_reduce(builtin, values[0], types[0], nullptr, nullptr), element);
+            case BuiltInFunction::MAP:{
+                auto func = llvm::dyn_cast<llvm::Function>(values[1]);
+                if (!func || func->arg_size() != 1 || func->getArg(0)->getType() != element || func->getReturnType() != element){
+                    return fail("expects an array and a function from its element type to its element type");
+                }
+                return emit_map(values[0], types[0], func);
+            }
+            case BuiltInFunction::FREE:{
+                if (types[0]->isArrayTy()){
+                    return fail("a fixed-size array lives on the stack, only dynamic arrays are freed");
+                }
+                if (in_region(values[0])){
+                    return std::make_tuple(nullptr, nullptr);
                 }
+                llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+                llvm::Value* bytes = allocation_size(element, array_length(values[0], types[0]));
+                llvm::FunctionCallee free = runtime_function("ligma_free", this->builder.getVoidTy(), {byte_pointer, bytes->getType()});
+                this->builder.CreateCall(free, {this->builder.CreateBitCast(array_data(values[0], types[0]), byte_pointer), bytes});
+                return std::make_tuple(nullptr, nullptr);
+            }
+            default:
+                return fail("unknown builtin");
+        }
+    }
+
+    // sum(a), dot(a, b), min(a) or max(a). A fixed-size array short enough is loaded as one vector
+    // and reduced with the llvm.vector.reduce intrinsics, anything else is reduced in a loop over
+    // its elements (dot over those of the shorter array). Float sums may be reassociated, so either
+    // form can add a vector at a time; min and max of floats ignore NaNs like llvm.minnum/maxnum.
+    // Over no elements, sum and dot are 0, min is the largest value of the type and max the smallest.
+    llvm::Value* emit_reduce(BuiltInFunction builtin, llvm::Value* a, llvm::Type* a_type, llvm::Value* b, llvm::Type* b_type){
+        llvm::Type* element = element_type(a_type);
+        bool is_float = element->isFloatingPointTy();
+
+        llvm::IRBuilderBase::FastMathFlagGuard guard(this->builder);
+        llvm::FastMathFlags flags;
+        flags.setAllowReassoc();
+        this->builder.setFastMathFlags(flags);
+
+        auto multiply = [&](llvm::Value* x, llvm::Value* y){
+            return is_float ? this->builder.CreateFMul(x, y) : this->builder.CreateMul(x, y);
+        };
+
+        if (a_type->isArrayTy() && a_type->getArrayNumElements() <= MAX_VECTOR_LENGTH && (!b || b_type == a_type)){
+            llvm::Value* vector = load_vector(a, a_type);
+            if (builtin == BuiltInFunction::DOT){
+                vector = multiply(vector, load_vector(b, b_type));
+            }
+            return reduce_vector(builtin, vector);
+        }
+
+        llvm::Value* initial = nullptr;
+        switch (builtin){
+            case BuiltInFunction::MIN:
+                initial = is_float ? llvm::ConstantFP::getInfinity(element, false) : llvm::ConstantInt::get(element, INT32_MAX, true);
+                break;
+            case BuiltInFunction::MAX:
+                initial = is_float ? llvm::ConstantFP::getInfinity(element, true) : llvm::ConstantInt::get(element, INT32_MIN, true);
+                break;
+            default:
+                initial = llvm::Constant::getNullValue(element);
+        }
+        llvm::AllocaInst* accumulator = create_entry_alloca(element, "acc");
+        this->builder.CreateStore(initial, accumulator);
+
+        llvm::Value* a_data = array_data(a, a_type);
+        llvm::Value* b_data = b ? array_data(b, b_type) : nullptr;
+        llvm::Value* length = array_length(a, a_type);
+        if (b){
+            llvm::Value* b_length = array_length(b, b_type);
+            length = this->builder.CreateSelect(this->builder.CreateICmpSLT(b_length, length), b_length, length, "length");
+        }
+        emit_counted_loop("i", llvm::ConstantInt::get(this->type_map["int"], 0), length, [&](llvm::PHINode* i){
+            llvm::Value* x = this->builder.CreateLoad(element, element_pointer(element, a_data, i));
+            if (b_data){
+                x = multiply(x, this->builder.CreateLoad(element, element_pointer(element, b_data, i)));
             }
-            if (result != nullptr && result_type != nullptr)
-                result_type = result->getType();
-            return std::make_tuple(result, result_type);
+            llvm::Value* acc = this->builder.CreateLoad(element, accumulator);
+            llvm::Value* next = nullptr;
+            switch (builtin){
+                case BuiltInFunction::MIN:
+                    next = is_float ? this->builder.CreateMinNum(acc, x) : this->builder.CreateSelect(this->builder.CreateICmpSLT(x, acc), x, acc);
+                    break;
+                case BuiltInFunction::MAX:
+                    next = is_float ? this->builder.CreateMaxNum(acc, x) : this->builder.CreateSelect(this->builder.CreateICmpSGT(x, acc), x, acc);
+                    break;
+                default:
+                    next = is_float ? this->builder.CreateFAdd(acc, x) : this->builder.CreateAdd(acc, x);
+            }
+            this->builder.CreateStore(next, accumulator);
+        }, ARRAY_LOOP_HINTS);
+        return this->builder.CreateLoad(element, accumulator);
+    }
+
+    // map(a, f): a new array of f applied to every element, in new fixed-size storage for a
+    // fixed-size array and in a new heap buffer for a dynamic one
+    std::tuple<llvm::Value*, llvm::Type*> emit_map(llvm::Value* array, llvm::Type* type, llvm::Function* func){
+        llvm::Type* element = element_type(type);
+        llvm::Value* length = array_length(array, type);
+        llvm::Value* result = type->isArrayTy() ? create_array_storage(llvm::cast<llvm::ArrayType>(type), "mapped") : emit_allocate(element, length);
+
+        llvm::Value* src = array_data(array, type);
+        llvm::Value* dst = array_data(result, type);
+        emit_counted_loop("i", llvm::ConstantInt::get(this->type_map["int"], 0), length, [&](llvm::PHINode* i){
+            llvm::Value* mapped = this->builder.CreateCall(func, {this->builder.CreateLoad(element, element_pointer(element, src, i))});
+            this->builder.CreateStore(mapped, element_pointer(element, dst, i));
+        }, ARRAY_LOOP_HINTS);
+
+        if (type->isArrayTy()){
+            this->fresh_array = result;
         }
+        return std::make_tuple(result, type);
+    }
+
+// --------------------------------------- REGIONS ---------------------------------------
+    // A function whose dynamic arrays don't outlive the call (Escapes.hpp) allocates them in the
+    // runtime's region of its thread: it takes a mark in its entry block the first time it needs one
+    // and leaves the region at the mark just before each of its rets, which frees them all at once.
+    // free() on one of them does nothing, the return will.
+
+    // names of the builtins the escape analysis knows, unless a function of the program shadows them
+    std::set<std::string> unshadowed_builtins(){
+        std::set<std::string> names;
+        for (const char* name : {"fill", "map", "len", "sum", "dot", "min", "max", "free"}){
+            if (!llvm::isa_and_nonnull<llvm::Function>(std::get<0>(this->env->lookup(name)))){
+                names.insert(name);
+            }
+        }
+        return names;
+    }
+
+    // let name = value, where value is lowered by resolve(), in the region if name is one of its arrays
+    template <typename R>
+    void emit_region_let(const std::string& name, R resolve){
+        bool region = this->region_names.count(name) > 0;
+        this->allocate_in_region = region;
+        auto [val, type] = resolve();
+        this->allocate_in_region = false;
+
+        emit_let(name, val, type);
+        if (region){
+            this->region_values.insert(std::get<0>(this->env->lookup(name)));
+        }
+    }
+
+    // take the function's mark if it hasn't yet, false outside a function
+    bool enter_region(){
+        llvm::BasicBlock* block = this->builder.GetInsertBlock();
+        if (!block || !block->getParent()){
+            return false;
+        }
+        if (!this->region_mark){
+            llvm::BasicBlock& entry = block->getParent()->getEntryBlock();
+            llvm::IRBuilder<> entry_builder(&entry, entry.getFirstInsertionPt());
+            this->region_mark = entry_builder.CreateCall(runtime_function("ligma_region_enter", region_mark_type(), {}), {}, "region");
+        }
+        return true;
+    }
+
+    // the runtime's ligma_region_mark, a pointer and a 64-bit word
+    llvm::StructType* region_mark_type(){
+        return llvm::StructType::get(context, {llvm::PointerType::getUnqual(this->builder.getInt8Ty()), this->builder.getInt64Ty()});
+    }
+
+    // an array value that is a region array, or was loaded from the slot of one
+    bool in_region(llvm::Value* array){
+        if (auto load = llvm::dyn_cast<llvm::LoadInst>(array)){
+            array = load->getPointerOperand();
+        }
+        return this->region_values.count(array) > 0;
+    }
+
+    // leave the region at the function's mark just before each of its rets
+    void leave_region(llvm::Function* func){
+        if (!this->region_mark){
+            return;
+        }
+        llvm::FunctionCallee leave = runtime_function("ligma_region_leave", this->builder.getVoidTy(), {region_mark_type()});
+        for (llvm::BasicBlock& block : *func){
+            if (auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(block.getTerminator())){
+                llvm::IRBuilder<> ret_builder(ret);
+                ret_builder.CreateCall(leave, {this->region_mark});
+            }
+        }
+    }
+
+    // allocations() and frees(): the blocks the runtime's heap gave out and got back on this thread
+    // so far, as an int, so a program can check that a hot function doesn't allocate or that it
+    // doesn't leak. Region allocations aren't counted. offset is the counter's in ligma_alloc_counters
+    llvm::Value* emit_alloc_counter(size_t offset, const std::string& name){
+        llvm::Type* word = this->builder.getInt64Ty();
+        llvm::Type* counters_pointer = llvm::PointerType::getUnqual(word);
+        llvm::Value* counters = this->builder.CreateCall(runtime_function("ligma_counters", counters_pointer, {}), {}, "counters");
+        llvm::Value* counter = this->builder.CreateConstInBoundsGEP1_64(word, counters, offset / sizeof(uint64_t));
+        return this->builder.CreateTrunc(this->builder.CreateLoad(word, counter), this->type_map["int"], name);
+    }
+
+// --------------------------------------- VECTORS ---------------------------------------
+    // vec4f, vec8f, vec4i and vec8i are <4 x float>, <8 x float>, <4 x i32> and <8 x i32> values,
+    // held in registers like scalars and lowered straight to LLVM vector instructions, so they are
+    // SIMD whether or not the loop vectorizer would have been. Arithmetic is element-wise, with a
+    // scalar of the element type broadcast to every lane; comparisons aren't, there's no mask type.
+
+    static bool is_vector(llvm::Type* type){
+        return type && type->isVectorTy();
+    }
+
+    // whether a vector type is one of the language's
+    bool is_vector_type(llvm::Type* type){
+        for (const auto& [name, named] : this->type_map){
+            if (named == type && is_vector(type)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // vec4f(x) broadcasts x, vec4f(a, b, c, d) takes a value per lane and vec4f(a) loads a [float; 4]
+    std::tuple<llvm::Value*, llvm::Type*> emit_vector_constructor(const std::string& name, llvm::FixedVectorType* type, const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types){
+        llvm::Type* element = type->getElementType();
+        unsigned lanes = type->getNumElements();
+        bool valid = std::count(values.begin(), values.end(), nullptr) == 0;
+
+        if (valid && values.size() == 1 && types[0] == element){
+            return std::make_tuple(this->builder.CreateVectorSplat(lanes, values[0]), type);
+        }
+        if (valid && values.size() == 1 && types[0] == llvm::ArrayType::get(element, lanes)){
+            return std::make_tuple(load_vector(values[0], types[0]), type);
+        }
+        if (valid && values.size() == lanes && std::count(types.begin(), types.end(), element) == lanes){
+            llvm::Value* vector = llvm::UndefValue::get(type);
+            for (unsigned i = 0; i < lanes; i++){
+                vector = this->builder.CreateInsertElement(vector, values[i], i);
+            }
+            return std::make_tuple(vector, type);
+        }
+
+        std::string element_name = element->isFloatingPointTy() ? "float" : "int";
+        std::cerr << name << "(): expects " << lanes << " " << element_name << " values, one to broadcast, or a ["
+                  << element_name << "; " << lanes << "] array\n";
         return std::make_tuple(nullptr, nullptr);
     }
 
-    // call expressions -> func()
-    std::tuple<llvm::Instruction*, llvm::Type*> visit_call_expression(CallExpression* node){
+    std::tuple<llvm::Value*, llvm::Type*> emit_vector_infix(std::string_view op, llvm::Value* left_value, llvm::Type* left_type, llvm::Value* right_value, llvm::Type* right_type){
+        llvm::Type* type = is_vector(left_type) ? left_type : right_type;
+        llvm::Type* element = type->getScalarType();
+        unsigned lanes = llvm::cast<llvm::FixedVectorType>(type)->getNumElements();
 
-        std::cout << "Visiting call expression\n";
-        
-        std::string func_name = static_cast<IdentifierLiteral*>(node->Function)->value;
-        std::vector<Expression*> params = node->arguments;
-        std::vector<llvm::Value*> params_values;
-        std::vector<llvm::Type*> params_types;
+        // a scalar operand is broadcast
+        if (left_value && left_type == element){
+            left_value = this->builder.CreateVectorSplat(lanes, left_value);
+            left_type = type;
+        }
+        if (right_value && right_type == element){
+            right_value = this->builder.CreateVectorSplat(lanes, right_value);
+            right_type = type;
+        }
+        if (!left_value || !right_value || left_type != type || right_type != type){
+            std::cerr << "The operands of " << op << " have to be vectors of the same type, or one of them a scalar of its element type\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        bool is_float = element->isFloatingPointTy();
+        llvm::Value* result = nullptr;
+        if (op == "+"){
+            result = is_float ? this->builder.CreateFAdd(left_value, right_value) : this->builder.CreateAdd(left_value, right_value);
+        } else if (op == "-"){
+            result = is_float ? this->builder.CreateFSub(left_value, right_value) : this->builder.CreateSub(left_value, right_value);
+        } else if (op == "*"){
+            result = is_float ? this->builder.CreateFMul(left_value, right_value) : this->builder.CreateMul(left_value, right_value);
+        } else if (op == "/"){
+            result = is_float ? this->builder.CreateFDiv(left_value, right_value) : this->builder.CreateSDiv(left_value, right_value);
+        } else if (op == "%"){
+            result = is_float ? this->builder.CreateFRem(left_value, right_value) : this->builder.CreateSRem(left_value, right_value);
+        } else {
+            std::cerr << "The " << op << " operator isn't defined on vectors\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+        return std::make_tuple(result, type);
+    }
+
+    // len, sum, dot, min and max work on a vector like on an array. extract(v, i) reads lane i and
+    // insert(v, i, x) is v with lane i set to x; a lane index is only checked when it is a constant.
+    // shuffle(v, i...) picks lanes of v, and shuffle(v, w, i...) lanes of v followed by w, by
+    // constant index into a vector of as many lanes as there are indexes (4 or 8).
+    std::tuple<llvm::Value*, llvm::Type*> emit_vector_builtin(BuiltInFunction builtin, const std::string& func_name, const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types){
+        auto fail = [&func_name](const std::string& message){
+            std::cerr << func_name << "(): " << message << '\n';
+            return std::tuple<llvm::Value*, llvm::Type*>(nullptr, nullptr);
+        };
+        if (values.empty() || !is_vector(types[0])){
+            return fail("expects a vector");
+        }
+
+        llvm::Type* type = types[0];
+        llvm::Type* element = type->getScalarType();
+        llvm::Type* int_type = this->type_map["int"];
+        unsigned lanes = llvm::cast<llvm::FixedVectorType>(type)->getNumElements();
+        auto lane_index = [&](size_t i, unsigned bound){
+            auto index = llvm::dyn_cast<llvm::ConstantInt>(values[i]);
+            return types[i] == int_type && (!index || (!index->isNegative() && index->getZExtValue() < bound));
+        };
+
+        switch (builtin){
+            case BuiltInFunction::LEN:
+                return std::make_tuple(llvm::ConstantInt::get(int_type, lanes), int_type);
+            case BuiltInFunction::SUM:
+            case BuiltInFunction::MIN:
+            case BuiltInFunction::MAX:
+                if (values.size() != 1){
+                    return fail("expects a vector");
+                }
+                return std::make_tuple(reduce_vector(builtin, values[0]), element);
+            case BuiltInFunction::DOT:{
+                if (values.size() != 2 || types[1] != type){
+                    return fail("expects two vectors of the same type");
+                }
+                bool is_float = element->isFloatingPointTy();
+                llvm::Value* product = is_float ? this->builder.CreateFMul(values[0], values[1]) : this->builder.CreateMul(values[0], values[1]);
+                return std::make_tuple(reduce_vector(BuiltInFunction::SUM, product), element);
+            }
+            case BuiltInFunction::EXTRACT:
+                if (values.size() != 2 || !lane_index(1, lanes)){
+                    return fail("expects a vector and the int index of one of its lanes");
+                }
+                return std::make_tuple(this->builder.CreateExtractElement(values[0], values[1]), element);
+            case BuiltInFunction::INSERT:
+                if (values.size() != 3 || !lane_index(1, lanes) || types[2] != element){
+                    return fail("expects a vector, the int index of one of its lanes and a value of its element type");
+                }
+                return std::make_tuple(this->builder.CreateInsertElement(values[0], values[2], values[1]), type);
+            case BuiltInFunction::SHUFFLE:{
+                bool two_sources = values.size() > 1 && types[1] == type;
+                size_t first = two_sources ? 2 : 1;
+                std::vector<int> mask;
+                for (size_t i = first; i < values.size(); i++){
+                    if (!llvm::isa<llvm::ConstantInt>(values[i]) || !lane_index(i, two_sources ? 2 * lanes : lanes)){
+                        return fail("lane indexes have to be int constants below the number of lanes shuffled from");
+                    }
+                    mask.push_back(static_cast<int>(llvm::cast<llvm::ConstantInt>(values[i])->getZExtValue()));
+                }
+                llvm::Type* result_type = llvm::FixedVectorType::get(element, mask.size());
+                if (!is_vector_type(result_type)){
+                    return fail("picks 4 or 8 lanes");
+                }
+                llvm::Value* result = two_sources
+                    ? this->builder.CreateShuffleVector(values[0], values[1], mask)
+                    : this->builder.CreateShuffleVector(values[0], mask);
+                return std::make_tuple(result, result_type);
+            }
+            default:
+                return fail("isn't defined on vectors");
+        }
+    }
+
+    // horizontal sum, min or max of the lanes of a vector, the sum of floats in any order
+    llvm::Value* reduce_vector(BuiltInFunction builtin, llvm::Value* vector){
+        llvm::Type* element = vector->getType()->getScalarType();
+        bool is_float = element->isFloatingPointTy();
+
+        llvm::IRBuilderBase::FastMathFlagGuard guard(this->builder);
+        llvm::FastMathFlags flags;
+        flags.setAllowReassoc();
+        this->builder.setFastMathFlags(flags);
+
+        switch (builtin){
+            case BuiltInFunction::MIN:
+                return is_float ? this->builder.CreateFPMinReduce(vector) : this->builder.CreateIntMinReduce(vector, true);
+            case BuiltInFunction::MAX:
+                return is_float ? this->builder.CreateFPMaxReduce(vector) : this->builder.CreateIntMaxReduce(vector, true);
+            default:
+                return is_float ? this->builder.CreateFAddReduce(llvm::ConstantFP::get(element, -0.0), vector) : this->builder.CreateAddReduce(vector);
+        }
+    }
+
+// --------------------------------------- STRINGS ---------------------------------------
+    // A string is the runtime's ligma_string (runtime/ligma_runtime.h) as an { i64, i64 } pair passed
+    // by value: up to 15 bytes inline, or a view of a reference counted heap buffer. Literals are
+    // constants, inline or over an immortal buffer in the module. Concatenations, slices and calls
+    // give back owned strings, which the statement holds as temporaries until a let, assignment or
+    // return takes them over, or releases. A string variable lives in a slot that owns its string,
+    // released when it's reassigned and at every return; parameters are borrowed from the caller.
 
-        if (params.size() > 0){
-            for (Expression* param : params){
-                auto [p_val, p_type] = resolve_value(param);
-                params_values.push_back(p_val);
-                params_types.push_back(p_type);
+    bool is_string(llvm::Type* type){
+        return type && type == this->type_map["string"];
+    }
+
+    llvm::FunctionCallee runtime_function(const char* name, llvm::Type* return_type, const std::vector<llvm::Type*>& param_types){
+        return this->module->getOrInsertFunction(name, llvm::FunctionType::get(return_type, param_types, false));
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_string(std::string_view value){
+        auto type = llvm::cast<llvm::StructType>(this->type_map["string"]);
+        llvm::Type* word = this->builder.getInt64Ty();
+        uint64_t words[2] = {0, 0};
+        llvm::Constant* buffer_address = nullptr;
+
+        if (value.size() <= LIGMA_STRING_INLINE){
+            // the bytes in order over both words, the length in the last byte
+            for (size_t i = 0; i < value.size(); i++){
+                words[i / 8] |= uint64_t(uint8_t(value[i])) << (8 * (i % 8));
             }
+            words[1] |= uint64_t(value.size()) << 56;
+        } else {
+            // a buffer that is never freed nor appended to: refcount, capacity, used, then the bytes
+            llvm::Type* int32 = this->builder.getInt32Ty();
+            llvm::Constant* size = llvm::ConstantInt::get(int32, value.size());
+            llvm::Constant* buffer = llvm::ConstantStruct::getAnon({llvm::ConstantInt::get(int32, LIGMA_BUFFER_IMMORTAL), size, size,
+                llvm::ConstantDataArray::getString(context, llvm::StringRef(value.data(), value.size()), false)});
+            auto global = new llvm::GlobalVariable(*this->module, buffer->getType(), true, llvm::GlobalValue::PrivateLinkage, buffer, "string");
+            global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+            global->setAlignment(llvm::Align(alignof(ligma_buffer)));
+            buffer_address = llvm::ConstantExpr::getPtrToInt(global, word);
+            words[1] = uint64_t(value.size() | LIGMA_STRING_HEAP) << 32;
         }
 
-        switch(get_builtin_function(func_name)){
-            /* 
-            built-in functions here
-            */
-           
-            default: // user defined function
-                auto [func, return_type] = this->env->lookup(func_name);
- 
-                auto func_ = llvm::cast<llvm::Function>(func);
+        llvm::Constant* first = buffer_address ? buffer_address : llvm::ConstantInt::get(word, words[0]);
+        return std::make_tuple(llvm::ConstantStruct::get(type, {first, llvm::ConstantInt::get(word, words[1])}), type);
+    }
 
+    void emit_string_retain(llvm::Value* val){
+        if (!llvm::isa<llvm::Constant>(val)){
+            this->builder.CreateCall(runtime_function("ligma_string_retain", this->builder.getVoidTy(), {val->getType()}), {val});
+        }
+    }
 
-                auto ret = this->builder.CreateCall(func_, params_values);   
-                return std::make_tuple(ret, return_type);
+    void emit_string_release(llvm::Value* val){
+        if (!llvm::isa<llvm::Constant>(val)){
+            this->builder.CreateCall(runtime_function("ligma_string_release", this->builder.getVoidTy(), {val->getType()}), {val});
         }
     }
 
-    std::tuple<llvm::Value*, llvm::Type*> resolve_value(Expression* node, std::optional<std::string> value_type = std::nullopt){
-        if (node) {
-            switch(node->type_enum()){
-                case NodeType::IntegerLiteral:{
-                    auto type_i = type_map["int"];
-                    return std::make_tuple(llvm::ConstantInt::get(context, llvm::APInt(32, static_cast<IntegerLiteral*>(node)->value, true)), type_i);
+    // take a string over: a temporary of the statement as it is, any other (a variable, a parameter
+    // or a literal) with a reference of its own
+    llvm::Value* take_string(llvm::Value* val){
+        auto it = std::find(this->string_temporaries.begin(), this->string_temporaries.end(), val);
+        if (it != this->string_temporaries.end()){
+            this->string_temporaries.erase(it);
+        } else {
+            emit_string_retain(val);
+        }
+        return val;
+    }
+
+    // release what the statement still owns, unless the block already ended (the return did)
+    void release_string_temporaries(){
+        llvm::BasicBlock* block = this->builder.GetInsertBlock();
+        if (block && !block->getTerminator()){
+            for (llvm::Value* val : this->string_temporaries){
+                emit_string_release(val);
+            }
+        }
+        this->string_temporaries.clear();
+    }
+
+    // slot for a string variable, holding the empty string from the function's entry on, so every
+    // return can release it whether or not the let ran
+    llvm::AllocaInst* create_string_slot(const std::string& name){
+        llvm::Type* type = this->type_map["string"];
+        llvm::AllocaInst* slot = create_entry_alloca(type, name);
+        llvm::IRBuilder<> entry_builder(slot->getParent(), std::next(slot->getIterator()));
+        entry_builder.CreateStore(llvm::Constant::getNullValue(type), slot);
+        this->string_slots.push_back(slot);
+        this->env->define(name, slot, type);
+        return slot;
+    }
+
+    // release every string variable of func just before each of its rets
+    void release_string_slots(llvm::Function* func){
+        if (this->string_slots.empty()){
+            return;
+        }
+        std::vector<llvm::ReturnInst*> returns;
+        for (llvm::BasicBlock& block : *func){
+            if (auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(block.getTerminator())){
+                returns.push_back(ret);
+            }
+        }
+
+        llvm::Type* type = this->type_map["string"];
+        llvm::FunctionCallee release = runtime_function("ligma_string_release", this->builder.getVoidTy(), {type});
+        for (llvm::ReturnInst* ret : returns){
+            llvm::IRBuilder<> ret_builder(ret);
+            for (llvm::AllocaInst* slot : this->string_slots){
+                ret_builder.CreateCall(release, {ret_builder.CreateLoad(type, slot)});
+            }
+        }
+    }
+
+    // + concatenates, the comparisons are bytewise
+    std::tuple<llvm::Value*, llvm::Type*> emit_string_infix(std::string_view op, llvm::Value* left_value, llvm::Type* left_type, llvm::Value* right_value, llvm::Type* right_type){
+        llvm::Type* type = this->type_map["string"];
+        llvm::Type* int_type = this->type_map["int"];
+        if (!left_value || !right_value || left_type != type || right_type != type){
+            std::cerr << "The operands of " << op << " have to be both strings\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        if (op == "+"){
+            llvm::Value* result = this->builder.CreateCall(runtime_function("ligma_string_concat", type, {type, type}), {left_value, right_value});
+            this->string_temporaries.push_back(result);
+            return std::make_tuple(result, type);
+        }
+
+        llvm::Value* zero = llvm::ConstantInt::get(int_type, 0);
+        llvm::Value* result = nullptr;
+        if (op == "==" || op == "!="){
+            llvm::Value* equal = this->builder.CreateCall(runtime_function("ligma_string_equal", int_type, {type, type}), {left_value, right_value});
+            result = op == "==" ? this->builder.CreateICmpNE(equal, zero) : this->builder.CreateICmpEQ(equal, zero);
+        } else if (op == "<" || op == "<=" || op == ">" || op == ">="){
+            llvm::Value* order = this->builder.CreateCall(runtime_function("ligma_string_compare", int_type, {type, type}), {left_value, right_value});
+            llvm::CmpInst::Predicate predicate = op == "<" ? llvm::CmpInst::ICMP_SLT : op == "<=" ? llvm::CmpInst::ICMP_SLE
+                : op == ">" ? llvm::CmpInst::ICMP_SGT : llvm::CmpInst::ICMP_SGE;
+            result = this->builder.CreateICmp(predicate, order, zero);
+        } else {
+            std::cerr << "The " << op << " operator isn't defined on strings\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+        return std::make_tuple(result, result->getType());
+    }
+
+    // len(s), and slice(s, start, end) for the bytes [start, end) clamped to s. A slice views the
+    // buffer of s unless it's short enough to be inline
+    std::tuple<llvm::Value*, llvm::Type*> emit_string_builtin(BuiltInFunction builtin, const std::string& func_name, const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types){
+        auto fail = [&func_name](const std::string& message){
+            std::cerr << func_name << "(): " << message << '\n';
+            return std::tuple<llvm::Value*, llvm::Type*>(nullptr, nullptr);
+        };
+        llvm::Type* type = this->type_map["string"];
+        llvm::Type* int_type = this->type_map["int"];
+        if (values.empty() || !is_string(types[0])){
+            return fail("expects a string");
+        }
+
+        switch (builtin){
+            case BuiltInFunction::LEN:
+                if (values.size() != 1){
+                    return fail("expects a string");
                 }
-                case NodeType::FloatLiteral:{
-                    auto type_f = type_map["float"];
-                    return std::make_tuple(llvm::ConstantFP::get(context, llvm::APFloat(static_cast<FloatLiteral*>(node)->value)), type_f);
+                return std::make_tuple(this->builder.CreateCall(runtime_function("ligma_string_length", int_type, {type}), {values[0]}), int_type);
+            case BuiltInFunction::SLICE:{
+                if (values.size() != 3 || types[1] != int_type || types[2] != int_type){
+                    return fail("expects a string and an int start and end");
                 }
-                case NodeType::IdentifierLiteral:{
-                    std::string name = static_cast<IdentifierLiteral*>(node)->value;
-                    auto [value, type] = env->lookup(name);
-                    if (value)
-                        return std::make_tuple(builder.CreateLoad(type, value), type);
-                    else
-                        std::cerr << "Undefined variable: " << name << '\n';
-                    break;
+                llvm::Value* result = this->builder.CreateCall(runtime_function("ligma_string_slice", type, {type, int_type, int_type}), values);
+                this->string_temporaries.push_back(result);
+                return std::make_tuple(result, type);
+            }
+            default:
+                return fail("isn't defined on strings");
+        }
+    }
+
+// --------------------------------------- MAPS ---------------------------------------
+    // A map[K, V] is a handle to the runtime's ligma_map (runtime/ligma_runtime.h), a SwissTable with
+    // int, float, bool or string keys and values; copies share the table and free(m) releases it,
+    // along with the strings it holds. m[k] loads the value of k from the slot the runtime finds, or
+    // the zero value when k isn't in the map, m[k] = v and insert(m, k, v) store to the slot it finds
+    // or adds. Keys other than strings go to the runtime as a 32-bit word.
+
+    bool is_map(llvm::Type* type){
+        return type && this->map_types.count(type) > 0;
+    }
+
+    // the { i8* } type of map[key, value], nullptr unless both are int, float, bool or string
+    llvm::StructType* map_type(const std::string& key_name, const std::string& value_name){
+        llvm::Type* key = resolve_type(key_name);
+        llvm::Type* value = resolve_type(value_name);
+        for (llvm::Type* type : {key, value}){
+            if (!is_numeric(type) && type != this->type_map["bool"] && !is_string(type)){
+                return nullptr;
+            }
+        }
+        llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+        llvm::StructType* type = llvm::StructType::create(context, {byte_pointer}, "map." + key_name + "." + value_name);
+        this->map_types[type] = std::make_pair(key, value);
+        return type;
+    }
+
+    // a key as the runtime takes it: a string as it is, anything else as a word. -0.0 + 0.0 is 0.0,
+    // so both float zeros are the same key
+    llvm::Value* map_key(llvm::Value* key){
+        llvm::Type* word = this->builder.getInt32Ty();
+        if (key->getType()->isFloatTy()){
+            return this->builder.CreateBitCast(this->builder.CreateFAdd(key, llvm::ConstantFP::get(key->getType(), 0.0)), word);
+        }
+        if (key->getType()->isIntegerTy(1)){
+            return this->builder.CreateZExt(key, word);
+        }
+        return key;
+    }
+
+    // ligma_map_<operation>_word or _string on the map's table and key. find only reads memory, so
+    // repeated lookups between two stores can be folded into one
+    llvm::Value* emit_map_call(const std::string& operation, llvm::Type* return_type, llvm::Value* map, llvm::Value* key){
+        llvm::Value* runtime_key = map_key(key);
+        std::string name = "ligma_map_" + operation + (is_string(key->getType()) ? "_string" : "_word");
+        llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+        llvm::FunctionCallee callee = runtime_function(name.c_str(), return_type, {byte_pointer, runtime_key->getType()});
+        if (auto func = llvm::dyn_cast<llvm::Function>(callee.getCallee())){
+            func->setDoesNotThrow();
+            if (operation == "find"){
+                func->setOnlyReadsMemory();
+            }
+        }
+        return this->builder.CreateCall(callee, {this->builder.CreateExtractValue(map, 0, "table"), runtime_key});
+    }
+
+    // false, with an error, unless key has the key type of the map
+    bool check_map_key(llvm::Type* map_type, llvm::Value* key, llvm::Type* key_type){
+        if (!key || key_type != this->map_types[map_type].first){
+            std::cerr << "A map is indexed by its key type\n";
+            return false;
+        }
+        return true;
+    }
+
+    // map[K, V](), an empty map
+    std::tuple<llvm::Value*, llvm::Type*> emit_map_constructor(const std::string& name, const std::vector<llvm::Value*>& values){
+        llvm::Type* type = resolve_type(name);
+        if (!is_map(type)){
+            return std::make_tuple(nullptr, nullptr);
+        }
+        if (!values.empty()){
+            std::cerr << name << "() takes no arguments\n";
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        auto [key, value] = this->map_types[type];
+        uint32_t flags = (is_string(key) ? LIGMA_MAP_STRING_KEYS : 0) | (is_string(value) ? LIGMA_MAP_STRING_VALUES : 0);
+        uint64_t value_size = this->module->getDataLayout().getTypeAllocSize(value).getFixedValue();
+        llvm::Type* int32 = this->builder.getInt32Ty();
+        llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+        llvm::Value* table = this->builder.CreateCall(runtime_function("ligma_map_new", byte_pointer, {int32, int32}),
+            {llvm::ConstantInt::get(int32, flags), llvm::ConstantInt::get(int32, value_size)}, "table");
+        return std::make_tuple(this->builder.CreateInsertValue(llvm::UndefValue::get(type), table, 0), type);
+    }
+
+    // zero bytes to load the value of a missing key from, enough for any value type
+    llvm::Constant* map_zero(){
+        llvm::GlobalVariable* zero = this->module->getGlobalVariable("map.zero", true);
+        if (!zero){
+            llvm::Type* type = llvm::ArrayType::get(this->builder.getInt8Ty(), sizeof(ligma_string));
+            zero = new llvm::GlobalVariable(*this->module, type, true, llvm::GlobalValue::PrivateLinkage, llvm::Constant::getNullValue(type), "map.zero");
+            zero->setAlignment(llvm::Align(alignof(ligma_string)));
+        }
+        return llvm::ConstantExpr::getBitCast(zero, llvm::PointerType::getUnqual(this->builder.getInt8Ty()));
+    }
+
+    // m[k]; a string value is the statement's own, so it outlives a removal of k
+    std::tuple<llvm::Value*, llvm::Type*> emit_map_index(llvm::Value* map, llvm::Type* type, llvm::Value* key, llvm::Type* key_type){
+        if (!check_map_key(type, key, key_type)){
+            return std::make_tuple(nullptr, nullptr);
+        }
+        llvm::Type* value_type = this->map_types[type].second;
+        llvm::Value* slot = emit_map_call("find", llvm::PointerType::getUnqual(this->builder.getInt8Ty()), map, key);
+        llvm::Value* missing = this->builder.CreateIsNull(slot, "missing");
+        llvm::Value* ptr = this->builder.CreateSelect(missing, map_zero(), slot);
+        llvm::Value* value = this->builder.CreateLoad(value_type, this->builder.CreateBitCast(ptr, llvm::PointerType::getUnqual(value_type)));
+        if (is_string(value_type)){
+            emit_string_retain(value);
+            this->string_temporaries.push_back(value);
+        }
+        return std::make_tuple(value, value_type);
+    }
+
+    // m[k] = v, the map holds its own reference to a string value
+    void emit_map_store(llvm::Value* map, llvm::Type* type, llvm::Value* key, llvm::Type* key_type, llvm::Value* val, llvm::Type* val_type){
+        if (!check_map_key(type, key, key_type)){
+            return;
+        }
+        llvm::Type* value_type = this->map_types[type].second;
+        if (!val || val_type != value_type){
+            std::cerr << "The value stored to a map has to have its value type\n";
+            return;
+        }
+        llvm::Value* slot = emit_map_call("insert", llvm::PointerType::getUnqual(this->builder.getInt8Ty()), map, key);
+        llvm::Value* ptr = this->builder.CreateBitCast(slot, llvm::PointerType::getUnqual(value_type));
+        if (is_string(value_type)){
+            llvm::Value* owned = take_string(val);
+            llvm::Value* old = this->builder.CreateLoad(value_type, ptr);
+            this->builder.CreateStore(owned, ptr);
+            emit_string_release(old);
+        } else {
+            this->builder.CreateStore(val, ptr);
+        }
+    }
+
+    // len(m), insert(m, k, v), contains(m, k), remove(m, k), which is true if k was in m, and free(m)
+    std::tuple<llvm::Value*, llvm::Type*> emit_map_builtin(BuiltInFunction builtin, const std::string& func_name, const std::vector<llvm::Value*>& values, const std::vector<llvm::Type*>& types){
+        auto fail = [&func_name](const std::string& message){
+            std::cerr << func_name << "(): " << message << '\n';
+            return std::tuple<llvm::Value*, llvm::Type*>(nullptr, nullptr);
+        };
+        if (values.empty() || !is_map(types[0])){
+            return fail("expects a map");
+        }
+        llvm::Type* int32 = this->builder.getInt32Ty();
+        llvm::Type* byte_pointer = llvm::PointerType::getUnqual(this->builder.getInt8Ty());
+
+        switch (builtin){
+            case BuiltInFunction::LEN:
+            case BuiltInFunction::FREE:{
+                if (values.size() != 1){
+                    return fail("expects a map");
                 }
-                case NodeType::InfixExpression:{
-                    return visit_infix_expression(static_cast<InfixExpression*>(node));
+                llvm::Value* table = this->builder.CreateExtractValue(values[0], 0, "table");
+                if (builtin == BuiltInFunction::FREE){
+                    this->builder.CreateCall(runtime_function("ligma_map_free", this->builder.getVoidTy(), {byte_pointer}), {table});
+                    return std::make_tuple(nullptr, nullptr);
                 }
-                case NodeType::BooleanLiteral:{
-                    auto type_b = llvm::Type::getInt1Ty(context);
-                    return std::make_tuple(llvm::ConstantInt::get(context, llvm::APInt(1, static_cast<BooleanLiteral*>(node)->value, true)), type_b);
+                return std::make_tuple(this->builder.CreateCall(runtime_function("ligma_map_size", int32, {byte_pointer}), {table}), this->type_map["int"]);
+            }
+            case BuiltInFunction::INSERT:
+                if (values.size() != 3){
+                    return fail("expects a map, a key and a value");
                 }
-                case NodeType::CallExpression:{
-                    return visit_call_expression(static_cast<CallExpression*>(node));
+                emit_map_store(values[0], types[0], values[1], types[1], values[2], types[2]);
+                return std::make_tuple(nullptr, nullptr);
+            case BuiltInFunction::CONTAINS:
+            case BuiltInFunction::REMOVE:{
+                if (values.size() != 2 || !check_map_key(types[0], values[1], types[1])){
+                    return fail("expects a map and a key");
                 }
-                default:
-                    std::cerr << "Unhandled node type during value resolution\n";
+                llvm::Value* result = builtin == BuiltInFunction::CONTAINS
+                    ? this->builder.CreateIsNotNull(emit_map_call("find", byte_pointer, values[0], values[1]))
+                    : this->builder.CreateIsNotNull(emit_map_call("remove", int32, values[0], values[1]));
+                return std::make_tuple(result, this->type_map["bool"]);
             }
+            default:
+                return fail("isn't defined on maps");
         }
-        return std::make_tuple(nullptr, nullptr);
+    }
+
+    std::tuple<llvm::Value*, llvm::Type*> emit_call(const std::string& func_name, const std::vector<llvm::Value*>& params_values, const std::vector<llvm::Type*>& params_types){
+
+        // a function of the program takes precedence over a builtin of the same name
+        auto [func, return_type] = this->env->lookup(func_name);
+        auto func_ = llvm::dyn_cast_or_null<llvm::Function>(func);
+        if (!func_){
+            BuiltInFunction builtin = get_builtin_function(func_name);
+            if (builtin != BuiltInFunction::INVALID){
+                return emit_builtin(builtin, func_name, params_values, params_types);
+            }
+            auto type = this->type_map.find(func_name);
+            if (type != this->type_map.end() && is_vector(type->second)){
+                return emit_vector_constructor(func_name, llvm::cast<llvm::FixedVectorType>(type->second), params_values, params_types);
+            }
+            if (func_name.rfind("map[", 0) == 0){
+                return emit_map_constructor(func_name, params_values);
+            }
+            std::cerr << "Undefined function: " << func_name << '\n';
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        if (params_values.size() != func_->arg_size()){
+            std::cerr << "Function " << func_name << " takes " << func_->arg_size() << " arguments, not " << params_values.size() << '\n';
+            return std::make_tuple(nullptr, nullptr);
+        }
+
+        // a fixed-size array passed for a dynamic one of its element type is viewed as one, over its
+        // storage, any other argument must have the type of its parameter
+        std::vector<llvm::Value*> args = params_values;
+        for (size_t i = 0; i < args.size(); i++){
+            llvm::Type* param_type = func_->getArg(i)->getType();
+            if (params_types[i] && params_types[i]->isArrayTy() && param_type == dynamic_array_type(params_types[i]->getArrayElementType())){
+                args[i] = make_dynamic_array(args[i], array_length(args[i], params_types[i]), params_types[i]->getArrayElementType());
+            }
+            if (!args[i] || args[i]->getType() != param_type){
+                std::cerr << "Argument " << i + 1 << " of " << func_name << " doesn't have the type of its parameter\n";
+                return std::make_tuple(nullptr, nullptr);
+            }
+        }
+
+        auto ret = this->builder.CreateCall(func_, args);
+        if (is_string(return_type)){
+            this->string_temporaries.push_back(ret);
+        }
+        return std::make_tuple(ret, return_type);
     }
 };
@@ -0,0 +1,542 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Ast.hpp"
+#include "Bindings.hpp"
+
+struct FoldReport{
+    size_t nodes_before = 0;
+    size_t nodes_after = 0;
+    size_t folded = 0; // expressions replaced by a literal or simplified to one of their operands
+    size_t propagated = 0; // uses of a let-bound constant replaced by the constant
+    size_t pruned = 0; // if statements whose condition was constant, and loops that never run
+
+    size_t removed() const {
+        return this->nodes_before - this->nodes_after;
+    }
+
+    void print(std::ostream& out) const {
+        out << "fold: " << this->nodes_before << " -> " << this->nodes_after << " nodes (" << this->removed() << " removed), "
+            << this->folded << " folded, " << this->propagated << " propagated, " << this->pruned << " branches pruned" << '\n';
+    }
+};
+
+// Constant folding and algebraic simplification over the AST, run before the Compiler.
+//
+// Infix expressions over int, float and bool literals are evaluated the way the compiled code
+// would (32-bit wrapping ints, single precision floats, ordered float comparisons). An integer
+// division or remainder by zero is left for the program to hit, a float one folds to the inf or NaN
+// it evaluates to. Float ^ isn't folded, its codegen depends on the exponent.
+// A let that is bound once at the top of a function and never reassigned, and whose value folds
+// to a literal, is dropped and its uses become the literal. An if with a constant condition is
+// replaced by the branch it takes, a loop that never runs is dropped, and statements after a
+// return in the same block are dropped. New nodes come from the program's arena.
+class ConstantFolder{
+    public:
+        FoldReport run(Program& program){
+            this->arena = program.arena.get();
+            this->report = FoldReport();
+            this->report.nodes_before = count_nodes(program.statements);
+
+            for (Statement* stmt : program.statements){
+                if (stmt && stmt->type_enum() == NodeType::FunctionStatement){
+                    auto func = static_cast<FunctionStatement*>(stmt);
+                    this->return_types[static_cast<IdentifierLiteral*>(func->name)->value] = func->return_type;
+                }
+            }
+            for (Statement* stmt : program.statements){
+                if (stmt && stmt->type_enum() == NodeType::FunctionStatement){
+                    fold_function(static_cast<FunctionStatement*>(stmt));
+                }
+            }
+
+            this->report.nodes_after = count_nodes(program.statements);
+            return this->report;
+        }
+
+    private:
+        AstArena* arena = nullptr;
+        FoldReport report;
+
+        std::map<std::string, std::string> return_types; // of every top-level function
+
+        // the function being folded
+        std::map<std::string, BindingUse> uses;
+        std::map<std::string, Expression*> constants; // let-bound literals
+        std::map<std::string, std::string> types; // declared types of parameters and lets
+
+        void fold_function(FunctionStatement* func){
+            auto prev_uses = std::move(this->uses);
+            auto prev_constants = std::move(this->constants);
+            auto prev_types = std::move(this->types);
+
+            this->uses = {};
+            this->constants = {};
+            this->types = {};
+            for (FunctionParameter* param : func->params){
+                this->types[param->name] = param->value_type;
+            }
+            collect_bindings(func->body, 0, this->uses);
+            fold_block(func->body);
+
+            this->uses = std::move(prev_uses);
+            this->constants = std::move(prev_constants);
+            this->types = std::move(prev_types);
+        }
+
+        void fold_block(BlockStatement* block){
+            if (!block){
+                return;
+            }
+            std::vector<Statement*> statements;
+            for (Statement* stmt : block->statements){
+                if (fold_statement(stmt, statements)){
+                    break;
+                }
+            }
+            block->statements = std::move(statements);
+        }
+
+        // fold stmt and append what is left of it to out, true if out now ends in a return
+        bool fold_statement(Statement* stmt, std::vector<Statement*>& out){
+            if (!stmt){
+                return false;
+            }
+
+            switch (stmt->type_enum()){
+                case NodeType::ExpressionStatement:{
+                    auto expr_stmt = static_cast<ExpressionStatement*>(stmt);
+                    expr_stmt->expr = fold_expression(expr_stmt->expr);
+                    break;
+                }
+                case NodeType::LetStatement:{
+                    auto let = static_cast<LetStatement*>(stmt);
+                    if (!let->name || !let->value){
+                        break;
+                    }
+                    std::string name = static_cast<IdentifierLiteral*>(let->name)->value;
+                    let->value = fold_expression(let->value);
+                    this->types[name] = let->value_type.empty() ? type_of(let->value) : let->value_type;
+
+                    // a constant that can't change, its uses take the literal and the let goes away
+                    if (is_literal(let->value) && this->uses[name].single()){
+                        this->constants[name] = let->value;
+                        return false;
+                    }
+                    break;
+                }
+                case NodeType::AssignStatement:{
+                    auto assign = static_cast<AssignStatement*>(stmt);
+                    assign->right_value = fold_expression(assign->right_value);
+                    break;
+                }
+                case NodeType::IndexAssignStatement:{
+                    auto assign = static_cast<IndexAssignStatement*>(stmt);
+                    fold_expression(assign->target);
+                    assign->right_value = fold_expression(assign->right_value);
+                    break;
+                }
+                case NodeType::ReturnStatement:{
+                    auto ret = static_cast<ReturnStatement*>(stmt);
+                    ret->return_value = fold_expression(ret->return_value);
+                    out.push_back(stmt);
+                    return true;
+                }
+                case NodeType::IfStatement:{
+                    auto if_stmt = static_cast<IfStatement*>(stmt);
+                    if_stmt->condition = fold_expression(if_stmt->condition);
+                    fold_block(if_stmt->concequence);
+                    fold_block(if_stmt->alternative);
+
+                    // only the branch taken is left, spliced into the enclosing block
+                    if (if_stmt->condition && if_stmt->condition->type_enum() == NodeType::BooleanLiteral){
+                        this->report.pruned++;
+                        BlockStatement* taken = static_cast<BooleanLiteral*>(if_stmt->condition)->value ? if_stmt->concequence : if_stmt->alternative;
+                        if (taken){
+                            for (Statement* inner : taken->statements){
+                                out.push_back(inner);
+                                if (inner->type_enum() == NodeType::ReturnStatement){
+                                    return true;
+                                }
+                            }
+                        }
+                        return false;
+                    }
+                    break;
+                }
+                case NodeType::WhileStatement:{
+                    auto loop = static_cast<WhileStatement*>(stmt);
+                    loop->condition = fold_expression(loop->condition);
+                    if (loop->condition && loop->condition->type_enum() == NodeType::BooleanLiteral && !static_cast<BooleanLiteral*>(loop->condition)->value){
+                        this->report.pruned++;
+                        return false;
+                    }
+                    fold_block(loop->body);
+                    break;
+                }
+                case NodeType::ForStatement:{
+                    auto loop = static_cast<ForStatement*>(stmt);
+                    loop->start = fold_expression(loop->start);
+                    loop->end = fold_expression(loop->end);
+                    if (loop->start && loop->end && loop->start->type_enum() == NodeType::IntegerLiteral && loop->end->type_enum() == NodeType::IntegerLiteral
+                        && static_cast<IntegerLiteral*>(loop->start)->value >= static_cast<IntegerLiteral*>(loop->end)->value){
+                        this->report.pruned++;
+                        return false;
+                    }
+
+                    // the loop variable shadows a constant of the same name inside the body
+                    const std::string& name = loop->variable->value;
+                    auto prev_constants = this->constants;
+                    auto prev_types = this->types;
+                    this->constants.erase(name);
+                    this->types[name] = "int";
+                    fold_block(loop->body);
+                    this->constants = std::move(prev_constants);
+                    this->types = std::move(prev_types);
+                    break;
+                }
+                case NodeType::BlockStatement:
+                    fold_block(static_cast<BlockStatement*>(stmt));
+                    break;
+                case NodeType::FunctionStatement:
+                    fold_function(static_cast<FunctionStatement*>(stmt));
+                    break;
+                default:
+                    break;
+            }
+            out.push_back(stmt);
+            return false;
+        }
+
+        Expression* fold_expression(Expression* expr){
+            if (!expr){
+                return expr;
+            }
+
+            switch (expr->type_enum()){
+                case NodeType::IdentifierLiteral:{
+                    auto it = this->constants.find(static_cast<IdentifierLiteral*>(expr)->value);
+                    if (it != this->constants.end()){
+                        this->report.propagated++;
+                        return copy_literal(it->second);
+                    }
+                    return expr;
+                }
+                case NodeType::CallExpression:{
+                    auto call = static_cast<CallExpression*>(expr);
+                    for (Expression*& arg : call->arguments){
+                        arg = fold_expression(arg);
+                    }
+                    return expr;
+                }
+                case NodeType::IndexExpression:{
+                    auto index = static_cast<IndexExpression*>(expr);
+                    index->array = fold_expression(index->array);
+                    index->index = fold_expression(index->index);
+                    return expr;
+                }
+                case NodeType::ArrayLiteral:{
+                    for (Expression*& element : static_cast<ArrayLiteral*>(expr)->elements){
+                        element = fold_expression(element);
+                    }
+                    return expr;
+                }
+                case NodeType::InfixExpression:{
+                    auto infix = static_cast<InfixExpression*>(expr);
+                    infix->left = fold_expression(infix->left);
+                    infix->right = fold_expression(infix->right);
+                    if (!infix->left || !infix->right){
+                        return expr;
+                    }
+
+                    Expression* folded = evaluate(infix->op, infix->left, infix->right);
+                    if (!folded){
+                        folded = simplify(infix->op, infix->left, infix->right);
+                    }
+                    if (folded){
+                        this->report.folded++;
+                        return folded;
+                    }
+                    return expr;
+                }
+                default:
+                    return expr;
+            }
+        }
+
+        // the literal an infix over two literals evaluates to, nullptr if it can't be folded
+        Expression* evaluate(const std::string& op, Expression* left, Expression* right){
+            NodeType type = left->type_enum();
+            if (type != right->type_enum()){
+                return nullptr;
+            }
+
+            if (type == NodeType::IntegerLiteral){
+                int32_t a = static_cast<IntegerLiteral*>(left)->value;
+                int32_t b = static_cast<IntegerLiteral*>(right)->value;
+                // add, sub and mul wrap like the i32 instructions they stand for
+                auto wrap = [](uint32_t value){ return static_cast<int32_t>(value); };
+                if (op == "+") return make_int(wrap(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)));
+                if (op == "-") return make_int(wrap(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)));
+                if (op == "*") return make_int(wrap(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)));
+                if (op == "/" || op == "%"){
+                    if (b == 0 || (a == std::numeric_limits<int32_t>::min() && b == -1)){
+                        return nullptr;
+                    }
+                    return make_int(op == "/" ? a / b : a % b);
+                }
+                if (op == "^") return make_int(int_power(a, b));
+                return compare(op, a, b);
+            }
+
+            if (type == NodeType::FloatLiteral){
+                float a = static_cast<FloatLiteral*>(left)->value;
+                float b = static_cast<FloatLiteral*>(right)->value;
+                if (op == "+") return make_float(a + b);
+                if (op == "-") return make_float(a - b);
+                if (op == "*") return make_float(a * b);
+                if (op == "/") return make_float(a / b);
+                if (op == "%") return make_float(std::fmod(a, b));
+                return compare(op, a, b);
+            }
+            return nullptr;
+        }
+
+        // same result as the compiled ligma.ipow: wrapping, and a negative exponent truncates
+        static int32_t int_power(int32_t base, int32_t exponent){
+            if (exponent < 0){
+                if (base == 1) return 1;
+                if (base == -1) return (exponent & 1) ? -1 : 1;
+                return 0;
+            }
+            uint32_t result = 1;
+            uint32_t square = static_cast<uint32_t>(base);
+            for (uint32_t remaining = static_cast<uint32_t>(exponent); remaining > 0; remaining >>= 1){
+                if (remaining & 1){
+                    result *= square;
+                }
+                square *= square;
+            }
+            return static_cast<int32_t>(result);
+        }
+
+        // ordered comparison, false whenever a float operand is NaN
+        template <typename T>
+        Expression* compare(const std::string& op, T a, T b){
+            if (op == "<") return make_bool(a < b);
+            if (op == "<=") return make_bool(a <= b);
+            if (op == ">") return make_bool(a > b);
+            if (op == ">=") return make_bool(a >= b);
+            if (op == "==") return make_bool(a == b);
+            if (op == "!=") return make_bool(a < b || a > b);
+            return nullptr;
+        }
+
+        // algebraic identities with one constant operand, only where both sides are known to have
+        // the same type so a type error isn't simplified away. nullptr if none applies
+        Expression* simplify(const std::string& op, Expression* left, Expression* right){
+            std::string type = type_of(left);
+            if (type != type_of(right) || (type != "int" && type != "float")){
+                return nullptr;
+            }
+
+            if (type == "int"){
+                if (op == "+" && is_int(left, 0)) return right;
+                if ((op == "+" || op == "-") && is_int(right, 0)) return left;
+                if (op == "*" && is_int(left, 1)) return right;
+                if ((op == "*" || op == "/") && is_int(right, 1)) return left;
+                // dropping the other operand is only fine when it has no calls in it
+                if (op == "*" && ((is_int(left, 0) && is_pure(right)) || (is_int(right, 0) && is_pure(left)))) return make_int(0);
+                if (op == "-" && same_variable(left, right)) return make_int(0);
+                return nullptr;
+            }
+
+            // x + 0.0 isn't x when x is -0.0
+            if (op == "-" && is_float(right, 0.0f)) return left;
+            if (op == "*" && is_float(left, 1.0f)) return right;
+            if ((op == "*" || op == "/") && is_float(right, 1.0f)) return left;
+            return nullptr;
+        }
+
+        // "int", "float", "bool", "string", a vector, array or map type, or "" when it isn't known
+        std::string type_of(Expression* expr){
+            if (!expr){
+                return "";
+            }
+            switch (expr->type_enum()){
+                case NodeType::IntegerLiteral: return "int";
+                case NodeType::FloatLiteral: return "float";
+                case NodeType::BooleanLiteral: return "bool";
+                case NodeType::StringLiteral: return "string";
+                case NodeType::IdentifierLiteral:{
+                    auto it = this->types.find(static_cast<IdentifierLiteral*>(expr)->value);
+                    return it != this->types.end() ? it->second : "";
+                }
+                case NodeType::CallExpression:{
+                    // map[string, int]() constructs its type
+                    const std::string& name = static_cast<CallExpression*>(expr)->Function->value;
+                    if (name.rfind("map[", 0) == 0){
+                        return name;
+                    }
+                    auto it = this->return_types.find(name);
+                    return it != this->return_types.end() ? it->second : "";
+                }
+                case NodeType::InfixExpression:{
+                    auto infix = static_cast<InfixExpression*>(expr);
+                    std::string type = type_of(infix->left);
+                    if (type.empty() || type != type_of(infix->right)){
+                        return "";
+                    }
+                    const std::string& op = infix->op;
+                    bool comparison = op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=";
+                    return comparison ? "bool" : type;
+                }
+                case NodeType::IndexExpression:{
+                    // [float; 8] or [float] -> float, map[string, float] -> float
+                    std::string type = type_of(static_cast<IndexExpression*>(expr)->array);
+                    if (type.rfind("map[", 0) == 0){
+                        return type.substr(type.find(", ") + 2, type.size() - type.find(", ") - 3);
+                    }
+                    if (type.size() < 3 || type.front() != '['){
+                        return "";
+                    }
+                    return type.substr(1, type.find_first_of(";]") - 1);
+                }
+                default:
+                    return "";
+            }
+        }
+
+        static bool is_literal(Expression* expr){
+            NodeType type = expr->type_enum();
+            return type == NodeType::IntegerLiteral || type == NodeType::FloatLiteral || type == NodeType::BooleanLiteral;
+        }
+
+        static bool is_int(Expression* expr, int32_t value){
+            return expr->type_enum() == NodeType::IntegerLiteral && static_cast<IntegerLiteral*>(expr)->value == value;
+        }
+
+        static bool is_float(Expression* expr, float value){
+            return expr->type_enum() == NodeType::FloatLiteral && static_cast<FloatLiteral*>(expr)->value == value
+                && std::signbit(static_cast<FloatLiteral*>(expr)->value) == std::signbit(value);
+        }
+
+        static bool same_variable(Expression* left, Expression* right){
+            return left->type_enum() == NodeType::IdentifierLiteral && right->type_enum() == NodeType::IdentifierLiteral
+                && static_cast<IdentifierLiteral*>(left)->value == static_cast<IdentifierLiteral*>(right)->value;
+        }
+
+        // no calls anywhere in the expression
+        static bool is_pure(Expression* expr){
+            if (!expr){
+                return true;
+            }
+            switch (expr->type_enum()){
+                case NodeType::CallExpression:
+                    return false;
+                case NodeType::InfixExpression:
+                    return is_pure(static_cast<InfixExpression*>(expr)->left) && is_pure(static_cast<InfixExpression*>(expr)->right);
+                case NodeType::IndexExpression:
+                    return is_pure(static_cast<IndexExpression*>(expr)->array) && is_pure(static_cast<IndexExpression*>(expr)->index);
+                case NodeType::ArrayLiteral:
+                    for (Expression* element : static_cast<ArrayLiteral*>(expr)->elements){
+                        if (!is_pure(element)){
+                            return false;
+                        }
+                    }
+                    return true;
+                default:
+                    return true;
+            }
+        }
+
+        Expression* copy_literal(Expression* literal){
+            switch (literal->type_enum()){
+                case NodeType::IntegerLiteral: return make_int(static_cast<IntegerLiteral*>(literal)->value);
+                case NodeType::FloatLiteral: return make_float(static_cast<FloatLiteral*>(literal)->value);
+                default: return make_bool(static_cast<BooleanLiteral*>(literal)->value);
+            }
+        }
+
+        Expression* make_int(int32_t value){
+            return this->arena->make<IntegerLiteral>(value);
+        }
+
+        Expression* make_float(float value){
+            return this->arena->make<FloatLiteral>(value);
+        }
+
+        Expression* make_bool(bool value){
+            return this->arena->make<BooleanLiteral>(value);
+        }
+
+        static size_t count_nodes(const std::vector<Statement*>& statements){
+            size_t count = 0;
+            for (Statement* stmt : statements){
+                count += count_nodes(stmt);
+            }
+            return count;
+        }
+
+        static size_t count_nodes(Node* node){
+            if (!node){
+                return 0;
+            }
+            switch (node->type_enum()){
+                case NodeType::ExpressionStatement:
+                    return 1 + count_nodes(static_cast<ExpressionStatement*>(node)->expr);
+                case NodeType::LetStatement:
+                    return 1 + count_nodes(static_cast<LetStatement*>(node)->name) + count_nodes(static_cast<LetStatement*>(node)->value);
+                case NodeType::AssignStatement:
+                    return 1 + count_nodes(static_cast<AssignStatement*>(node)->ident) + count_nodes(static_cast<AssignStatement*>(node)->right_value);
+                case NodeType::ReturnStatement:
+                    return 1 + count_nodes(static_cast<ReturnStatement*>(node)->return_value);
+                case NodeType::BlockStatement:
+                    return 1 + count_nodes(static_cast<BlockStatement*>(node)->statements);
+                case NodeType::IfStatement:{
+                    auto if_stmt = static_cast<IfStatement*>(node);
+                    return 1 + count_nodes(if_stmt->condition) + count_nodes(if_stmt->concequence) + count_nodes(if_stmt->alternative);
+                }
+                case NodeType::FunctionStatement:{
+                    auto func = static_cast<FunctionStatement*>(node);
+                    return 1 + count_nodes(func->name) + count_nodes(func->body) + func->params.size();
+                }
+                case NodeType::WhileStatement:
+                    return 1 + count_nodes(static_cast<WhileStatement*>(node)->condition) + count_nodes(static_cast<WhileStatement*>(node)->body);
+                case NodeType::ForStatement:{
+                    auto loop = static_cast<ForStatement*>(node);
+                    return 1 + count_nodes(loop->variable) + count_nodes(loop->start) + count_nodes(loop->end) + count_nodes(loop->body);
+                }
+                case NodeType::IndexAssignStatement:
+                    return 1 + count_nodes(static_cast<IndexAssignStatement*>(node)->target) + count_nodes(static_cast<IndexAssignStatement*>(node)->right_value);
+                case NodeType::InfixExpression:
+                    return 1 + count_nodes(static_cast<InfixExpression*>(node)->left) + count_nodes(static_cast<InfixExpression*>(node)->right);
+                case NodeType::IndexExpression:
+                    return 1 + count_nodes(static_cast<IndexExpression*>(node)->array) + count_nodes(static_cast<IndexExpression*>(node)->index);
+                case NodeType::ArrayLiteral:{
+                    size_t count = 1;
+                    for (Expression* element : static_cast<ArrayLiteral*>(node)->elements){
+                        count += count_nodes(element);
+                    }
+                    return count;
+                }
+                case NodeType::CallExpression:{
+                    auto call = static_cast<CallExpression*>(node);
+                    size_t count = 1 + count_nodes(call->Function);
+                    for (Expression* arg : call->arguments){
+                        count += count_nodes(arg);
+                    }
+                    return count;
+                }
+                default:
+                    return 1;
+            }
+        }
+};
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+#include "Ast.hpp"
+#include "FlatAst.hpp"
+
+// Escape analysis of the dynamic arrays a function body allocates. A variable bound to fill(...) or
+// map(...) doesn't outlive the call when every use of it only reads or writes its elements:
+// indexing it, or passing it to len, sum, dot, min, max, map or free. Returning it, passing it to a
+// function of the program, binding it to another name or reassigning it lets it escape, as does any
+// use inside a nested function. Lets inside a loop are left out, every iteration would allocate
+// again and a region only gives its memory back when the function returns.
+struct ArrayEscapes{
+    // builtins the calls go to, those a function of the program shadows aren't in it
+    std::set<std::string> builtins;
+
+    // variables bound to a new array, false once a let of theirs can't allocate in a region
+    std::map<std::string, bool> allocated = {};
+    std::set<std::string> escaping = {};
+
+    explicit ArrayEscapes(std::set<std::string> builtins) : builtins(std::move(builtins)){}
+
+    bool is_builtin(const std::string& name, bool allocating) const {
+        if (this->builtins.count(name) == 0){
+            return false;
+        }
+        return allocating ? name == "fill" || name == "map" : name != "fill";
+    }
+
+    void let(const std::string& name, bool allocates){
+        auto [it, added] = this->allocated.emplace(name, allocates);
+        it->second = it->second && allocates;
+    }
+
+    // the arrays that can live in the function's region
+    std::set<std::string> region_names() const {
+        std::set<std::string> names;
+        for (const auto& [name, allocates] : this->allocated){
+            if (allocates && this->escaping.count(name) == 0){
+                names.insert(name);
+            }
+        }
+        return names;
+    }
+};
+
+// uses of names in an expression; consumed when it is an array operand that doesn't keep the array
+inline void collect_escapes(Expression* node, bool consumed, bool nested, ArrayEscapes& escapes){
+    if (!node){
+        return;
+    }
+    switch (node->type_enum()){
+        case NodeType::IdentifierLiteral:
+            if (!consumed || nested){
+                escapes.escaping.insert(static_cast<IdentifierLiteral*>(node)->value);
+            }
+            break;
+        case NodeType::IndexExpression:
+            collect_escapes(static_cast<IndexExpression*>(node)->array, true, nested, escapes);
+            collect_escapes(static_cast<IndexExpression*>(node)->index, false, nested, escapes);
+            break;
+        case NodeType::InfixExpression:
+            collect_escapes(static_cast<InfixExpression*>(node)->left, false, nested, escapes);
+            collect_escapes(static_cast<InfixExpression*>(node)->right, false, nested, escapes);
+            break;
+        case NodeType::CallExpression:{
+            auto call = static_cast<CallExpression*>(node);
+            bool consumer = escapes.is_builtin(call->Function->value, false);
+            for (Expression* arg : call->arguments){
+                collect_escapes(arg, consumer, nested, escapes);
+            }
+            break;
+        }
+        case NodeType::ArrayLiteral:
+            for (Expression* element : static_cast<ArrayLiteral*>(node)->elements){
+                collect_escapes(element, false, nested, escapes);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// the lets and uses of a function body, nested is true inside a function nested in it
+inline void collect_escapes(Statement* node, int loop_depth, bool nested, ArrayEscapes& escapes){
+    if (!node){
+        return;
+    }
+    switch (node->type_enum()){
+        case NodeType::BlockStatement:
+            for (Statement* stmt : static_cast<BlockStatement*>(node)->statements){
+                collect_escapes(stmt, loop_depth, nested, escapes);
+            }
+            break;
+        case NodeType::ExpressionStatement:
+            collect_escapes(static_cast<ExpressionStatement*>(node)->expr, false, nested, escapes);
+            break;
+        case NodeType::LetStatement:{
+            auto let = static_cast<LetStatement*>(node);
+            if (let->name && let->value && !nested){
+                bool allocates = loop_depth == 0 && let->value->type_enum() == NodeType::CallExpression
+                    && escapes.is_builtin(static_cast<CallExpression*>(let->value)->Function->value, true);
+                escapes.let(static_cast<IdentifierLiteral*>(let->name)->value, allocates);
+            }
+            collect_escapes(let->value, false, nested, escapes);
+            break;
+        }
+        case NodeType::AssignStatement:
+            escapes.escaping.insert(static_cast<AssignStatement*>(node)->ident->value);
+            collect_escapes(static_cast<AssignStatement*>(node)->right_value, false, nested, escapes);
+            break;
+        case NodeType::IndexAssignStatement:
+            collect_escapes(static_cast<IndexAssignStatement*>(node)->target, false, nested, escapes);
+            collect_escapes(static_cast<IndexAssignStatement*>(node)->right_value, false, nested, escapes);
+            break;
+        case NodeType::ReturnStatement:
+            collect_escapes(static_cast<ReturnStatement*>(node)->return_value, false, nested, escapes);
+            break;
+        case NodeType::IfStatement:
+            collect_escapes(static_cast<IfStatement*>(node)->condition, false, nested, escapes);
+            collect_escapes(static_cast<IfStatement*>(node)->concequence, loop_depth, nested, escapes);
+            collect_escapes(static_cast<IfStatement*>(node)->alternative, loop_depth, nested, escapes);
+            break;
+        case NodeType::WhileStatement:
+            collect_escapes(static_cast<WhileStatement*>(node)->condition, false, nested, escapes);
+            collect_escapes(static_cast<WhileStatement*>(node)->body, loop_depth + 1, nested, escapes);
+            break;
+        case NodeType::ForStatement:
+            collect_escapes(static_cast<ForStatement*>(node)->start, false, nested, escapes);
+            collect_escapes(static_cast<ForStatement*>(node)->end, false, nested, escapes);
+            collect_escapes(static_cast<ForStatement*>(node)->body, loop_depth + 1, nested, escapes);
+            break;
+        case NodeType::FunctionStatement:
+            collect_escapes(static_cast<FunctionStatement*>(node)->body, loop_depth, true, escapes);
+            break;
+        default:
+            break;
+    }
+}
+
+// mirrors both collect_escapes for a flat AST, where statements and expressions are alike nodes
+inline void collect_escapes(const FlatAst& ast, uint32_t index, int loop_depth, bool consumed, bool nested, ArrayEscapes& escapes){
+    if (index == FLAT_NONE){
+        return;
+    }
+    const FlatNode& node = ast.node(index);
+    switch (ast.tag(index)){
+        case NodeType::BlockStatement:
+            for (uint32_t stmt : ast.list(node.a)){
+                collect_escapes(ast, stmt, loop_depth, false, nested, escapes);
+            }
+            break;
+        case NodeType::ExpressionStatement:
+        case NodeType::ReturnStatement:
+            collect_escapes(ast, node.a, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::LetStatement:
+            if (node.a != FLAT_NONE && node.b != FLAT_NONE && !nested){
+                bool allocates = loop_depth == 0 && ast.tag(node.b) == NodeType::CallExpression
+                    && escapes.is_builtin(std::string(ast.string(ast.node(ast.node(node.b).a).a)), true);
+                escapes.let(std::string(ast.string(ast.node(node.a).a)), allocates);
+            }
+            collect_escapes(ast, node.b, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::AssignStatement:
+            escapes.escaping.insert(std::string(ast.string(ast.node(node.a).a)));
+            collect_escapes(ast, node.b, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::IndexAssignStatement:
+        case NodeType::InfixExpression:
+            collect_escapes(ast, node.a, loop_depth, false, nested, escapes);
+            collect_escapes(ast, node.b, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::IfStatement:
+            collect_escapes(ast, node.a, loop_depth, false, nested, escapes);
+            collect_escapes(ast, node.b, loop_depth, false, nested, escapes);
+            collect_escapes(ast, node.c, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::WhileStatement:
+            collect_escapes(ast, node.a, loop_depth, false, nested, escapes);
+            collect_escapes(ast, node.b, loop_depth + 1, false, nested, escapes);
+            break;
+        case NodeType::ForStatement:
+            for (uint32_t bound : ast.list(node.b)){
+                collect_escapes(ast, bound, loop_depth, false, nested, escapes);
+            }
+            collect_escapes(ast, node.c, loop_depth + 1, false, nested, escapes);
+            break;
+        case NodeType::FunctionStatement:
+            collect_escapes(ast, node.b, loop_depth, false, true, escapes);
+            break;
+        case NodeType::IdentifierLiteral:
+            if (!consumed || nested){
+                escapes.escaping.insert(std::string(ast.string(node.a)));
+            }
+            break;
+        case NodeType::IndexExpression:
+            collect_escapes(ast, node.a, loop_depth, true, nested, escapes);
+            collect_escapes(ast, node.b, loop_depth, false, nested, escapes);
+            break;
+        case NodeType::CallExpression:{
+            bool consumer = escapes.is_builtin(std::string(ast.string(ast.node(node.a).a)), false);
+            for (uint32_t arg : ast.list(node.b)){
+                collect_escapes(ast, arg, loop_depth, consumer, nested, escapes);
+            }
+            break;
+        }
+        case NodeType::ArrayLiteral:
+            for (uint32_t element : ast.list(node.a)){
+                collect_escapes(ast, element, loop_depth, false, nested, escapes);
+            }
+            break;
+        default:
+            break;
+    }
+}
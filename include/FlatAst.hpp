@@ -0,0 +1,483 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <optional>
+
+#include "Ast.hpp"
+
+// Flat, index-based encoding of a Program. Nodes sit contiguously in one vector and refer to their
+// children by 32-bit index, so a traversal walks memory linearly and never makes a virtual call.
+//
+// Per node type the fields hold:
+//   Program              a: statement list
+//   ExpressionStatement  a: expression
+//   LetStatement         a: name (IdentifierLiteral), b: value, c: value type (string)
+//   BlockStatement       a: statement list
+//   FunctionStatement    a: name (IdentifierLiteral), b: body (BlockStatement), c: return type (string), d: parameter list
+//   ReturnStatement      a: return value
+//   AssignStatement      a: ident (IdentifierLiteral), b: right value
+//   IfStatement          a: condition, b: consequence, c: alternative (or FLAT_NONE)
+//   WhileStatement       a: condition, b: body, d: loop hints
+//   ForStatement         a: variable (IdentifierLiteral), b: range list (start, end), c: body, d: loop hints
+//   IndexAssignStatement a: target (IndexExpression), b: right value
+//   InfixExpression      a: left, b: right, c: operator (string)
+//   CallExpression       a: function (IdentifierLiteral), b: argument list
+//   IndexExpression      a: array, b: index
+//   IntegerLiteral       a: index into ints
+//   FloatLiteral         a: index into floats
+//   IdentifierLiteral    a: name (string)
+//   BooleanLiteral       a: value
+//   ArrayLiteral         a: element list, b: repeat count (0 unless [element; repeat])
+//   StringLiteral        a: value (string)
+//   FunctionParameter    a: name (string), b: value type (string)
+// A list is an offset into `lists` where the element count is stored, followed by the node indices.
+
+constexpr uint32_t FLAT_NONE = UINT32_MAX;
+
+// loop hints in one field: unroll + 1 in the low half, vectorize + 1 in the high half
+constexpr uint32_t pack_loop_hints(LoopHints hints){
+    return uint32_t(hints.unroll + 1) | uint32_t(hints.vectorize + 1) << 16;
+}
+
+constexpr LoopHints unpack_loop_hints(uint32_t packed){
+    return LoopHints{int(packed & 0xffff) - 1, int(packed >> 16) - 1};
+}
+
+struct FlatNode{
+    uint8_t tag; // NodeType
+    uint8_t reserved[3];
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+};
+
+class FlatAst{
+    public:
+        std::vector<FlatNode> nodes = {};
+        std::vector<uint32_t> lists = {};
+        std::vector<int32_t> ints = {};
+        std::vector<float> floats = {};
+
+        // interned strings: string i is string_data[string_offsets[i], string_offsets[i + 1])
+        std::string string_data = "";
+        std::vector<uint32_t> string_offsets = {0};
+
+        uint32_t root = FLAT_NONE; // the Program node
+
+        NodeType tag(uint32_t index) const {
+            return static_cast<NodeType>(this->nodes[index].tag);
+        }
+
+        const FlatNode& node(uint32_t index) const {
+            return this->nodes[index];
+        }
+
+        std::span<const uint32_t> list(uint32_t offset) const {
+            return std::span<const uint32_t>(this->lists.data() + offset + 1, this->lists[offset]);
+        }
+
+        std::string_view string(uint32_t index) const {
+            return std::string_view(this->string_data).substr(this->string_offsets[index], this->string_offsets[index + 1] - this->string_offsets[index]);
+        }
+
+        size_t string_count() const {
+            return this->string_offsets.size() - 1;
+        }
+
+        // check every index before trusting an encoding that came from outside (e.g. a cache file).
+        // Children always come before their parent, which also rules out cycles.
+        bool valid() const {
+            if (this->string_offsets.empty() || this->string_offsets[0] != 0 || this->string_offsets.back() != this->string_data.size()){
+                return false;
+            }
+            for (size_t i = 1; i < this->string_offsets.size(); i++){
+                if (this->string_offsets[i] < this->string_offsets[i - 1]){
+                    return false;
+                }
+            }
+            if (this->root == FLAT_NONE){
+                return true;
+            }
+            if (this->root >= this->nodes.size() || tag(this->root) != NodeType::Program){
+                return false;
+            }
+
+            for (uint32_t index = 0; index < this->nodes.size(); index++){
+                const FlatNode& n = this->nodes[index];
+
+                // child index of the given kind, optionally FLAT_NONE
+                auto child = [&](uint32_t c, bool optional, bool (*kind)(NodeType)){
+                    if (c == FLAT_NONE){
+                        return optional;
+                    }
+                    return c < index && kind(tag(c));
+                };
+                auto list_of = [&](uint32_t offset, bool optional, bool (*kind)(NodeType)){
+                    if (offset >= this->lists.size() || this->lists[offset] > this->lists.size() - offset - 1){
+                        return false;
+                    }
+                    for (uint32_t c : list(offset)){
+                        if (!child(c, optional, kind)){
+                            return false;
+                        }
+                    }
+                    return true;
+                };
+                auto str = [&](uint32_t s){
+                    return s < string_count();
+                };
+
+                bool ok = false;
+                switch (static_cast<NodeType>(n.tag)){
+                    case NodeType::Program:
+                    case NodeType::BlockStatement:
+                        ok = list_of(n.a, true, is_statement);
+                        break;
+                    case NodeType::ExpressionStatement:
+                    case NodeType::ReturnStatement:
+                        ok = child(n.a, true, is_expression);
+                        break;
+                    case NodeType::LetStatement:
+                        ok = child(n.a, true, is_identifier) && child(n.b, true, is_expression) && str(n.c);
+                        break;
+                    case NodeType::FunctionStatement:
+                        ok = child(n.a, false, is_identifier) && child(n.b, true, is_block) && str(n.c) && list_of(n.d, false, is_parameter);
+                        break;
+                    case NodeType::AssignStatement:
+                        ok = child(n.a, false, is_identifier) && child(n.b, true, is_expression);
+                        break;
+                    case NodeType::IfStatement:
+                        ok = child(n.a, true, is_expression) && child(n.b, true, is_block) && child(n.c, true, is_block);
+                        break;
+                    case NodeType::WhileStatement:
+                        ok = child(n.a, true, is_expression) && child(n.b, true, is_block);
+                        break;
+                    case NodeType::ForStatement:
+                        ok = child(n.a, false, is_identifier) && list_of(n.b, true, is_expression) && this->lists[n.b] == 2 && child(n.c, true, is_block);
+                        break;
+                    case NodeType::IndexAssignStatement:
+                        ok = child(n.a, false, is_index) && child(n.b, true, is_expression);
+                        break;
+                    case NodeType::InfixExpression:
+                        ok = child(n.a, true, is_expression) && child(n.b, true, is_expression) && str(n.c);
+                        break;
+                    case NodeType::CallExpression:
+                        ok = child(n.a, false, is_identifier) && list_of(n.b, true, is_expression);
+                        break;
+                    case NodeType::IndexExpression:
+                        ok = child(n.a, true, is_expression) && child(n.b, true, is_expression);
+                        break;
+                    case NodeType::IntegerLiteral:
+                        ok = n.a < this->ints.size();
+                        break;
+                    case NodeType::FloatLiteral:
+                        ok = n.a < this->floats.size();
+                        break;
+                    case NodeType::IdentifierLiteral:
+                        ok = str(n.a);
+                        break;
+                    case NodeType::BooleanLiteral:
+                        ok = n.a <= 1;
+                        break;
+                    case NodeType::ArrayLiteral:
+                        ok = list_of(n.a, true, is_expression) && this->lists[n.a] > 0 && n.b <= INT32_MAX && (n.b == 0 || this->lists[n.a] == 1);
+                        break;
+                    case NodeType::StringLiteral:
+                        ok = str(n.a);
+                        break;
+                    case NodeType::FunctionParameter:
+                        ok = str(n.a) && str(n.b);
+                        break;
+                    default:
+                        ok = false;
+                }
+                if (!ok){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // rebuild the pointer-based Program, its nodes go in the new program's arena
+        Program to_program() const {
+            Program program = Program();
+            if (this->root != FLAT_NONE){
+                for (uint32_t stmt : list(node(this->root).a)){
+                    program.statements.push_back(static_cast<Statement*>(inflate(stmt, program.arena.get())));
+                }
+            }
+            return program;
+        }
+
+    private:
+        // node kinds a field may refer to, checked by valid()
+        static bool is_statement(NodeType type){
+            return type == NodeType::ExpressionStatement || type == NodeType::LetStatement || type == NodeType::BlockStatement || type == NodeType::FunctionStatement
+                || type == NodeType::ReturnStatement || type == NodeType::AssignStatement || type == NodeType::IfStatement
+                || type == NodeType::WhileStatement || type == NodeType::ForStatement || type == NodeType::IndexAssignStatement;
+        }
+
+        static bool is_expression(NodeType type){
+            return type == NodeType::InfixExpression || type == NodeType::CallExpression || type == NodeType::IndexExpression || type == NodeType::IntegerLiteral
+                || type == NodeType::FloatLiteral || type == NodeType::IdentifierLiteral || type == NodeType::BooleanLiteral || type == NodeType::ArrayLiteral
+                || type == NodeType::StringLiteral;
+        }
+
+        static bool is_index(NodeType type){
+            return type == NodeType::IndexExpression;
+        }
+
+        static bool is_identifier(NodeType type){
+            return type == NodeType::IdentifierLiteral;
+        }
+
+        static bool is_block(NodeType type){
+            return type == NodeType::BlockStatement;
+        }
+
+        static bool is_parameter(NodeType type){
+            return type == NodeType::FunctionParameter;
+        }
+
+        template <typename T>
+        std::vector<T*> inflate_list(uint32_t offset, AstArena* arena) const {
+            std::vector<T*> items;
+            items.reserve(this->lists[offset]);
+            for (uint32_t item : list(offset)){
+                items.push_back(static_cast<T*>(inflate(item, arena)));
+            }
+            return items;
+        }
+
+        Node* inflate(uint32_t index, AstArena* arena) const {
+            if (index == FLAT_NONE){
+                return nullptr;
+            }
+
+            const FlatNode& n = node(index);
+            switch (tag(index)){
+                case NodeType::ExpressionStatement:
+                    return arena->make<ExpressionStatement>(static_cast<Expression*>(inflate(n.a, arena)));
+                case NodeType::LetStatement:
+                    return arena->make<LetStatement>(static_cast<Expression*>(inflate(n.a, arena)), static_cast<Expression*>(inflate(n.b, arena)), std::string(string(n.c)));
+                case NodeType::BlockStatement:
+                    return arena->make<BlockStatement>(inflate_list<Statement>(n.a, arena));
+                case NodeType::FunctionStatement:
+                    return arena->make<FunctionStatement>(inflate_list<FunctionParameter>(n.d, arena), static_cast<BlockStatement*>(inflate(n.b, arena)),
+                                                          static_cast<IdentifierLiteral*>(inflate(n.a, arena)), std::string(string(n.c)));
+                case NodeType::ReturnStatement:
+                    return arena->make<ReturnStatement>(static_cast<Expression*>(inflate(n.a, arena)));
+                case NodeType::AssignStatement:
+                    return arena->make<AssignStatement>(static_cast<IdentifierLiteral*>(inflate(n.a, arena)), static_cast<Expression*>(inflate(n.b, arena)));
+                case NodeType::IfStatement:
+                    return arena->make<IfStatement>(static_cast<Expression*>(inflate(n.a, arena)), static_cast<BlockStatement*>(inflate(n.b, arena)),
+                                                    static_cast<BlockStatement*>(inflate(n.c, arena)));
+                case NodeType::WhileStatement:
+                    return arena->make<WhileStatement>(static_cast<Expression*>(inflate(n.a, arena)), static_cast<BlockStatement*>(inflate(n.b, arena)),
+                                                       unpack_loop_hints(n.d));
+                case NodeType::ForStatement:{
+                    std::vector<Expression*> range = inflate_list<Expression>(n.b, arena);
+                    return arena->make<ForStatement>(static_cast<IdentifierLiteral*>(inflate(n.a, arena)), range[0], range[1],
+                                                     static_cast<BlockStatement*>(inflate(n.c, arena)), unpack_loop_hints(n.d));
+                }
+                case NodeType::IndexAssignStatement:
+                    return arena->make<IndexAssignStatement>(static_cast<IndexExpression*>(inflate(n.a, arena)), static_cast<Expression*>(inflate(n.b, arena)));
+                case NodeType::InfixExpression:{
+                    auto expr = arena->make<InfixExpression>(static_cast<Expression*>(inflate(n.a, arena)), std::string(string(n.c)));
+                    expr->right = static_cast<Expression*>(inflate(n.b, arena));
+                    return expr;
+                }
+                case NodeType::CallExpression:
+                    return arena->make<CallExpression>(static_cast<IdentifierLiteral*>(inflate(n.a, arena)), inflate_list<Expression>(n.b, arena));
+                case NodeType::IndexExpression:
+                    return arena->make<IndexExpression>(static_cast<Expression*>(inflate(n.a, arena)), static_cast<Expression*>(inflate(n.b, arena)));
+                case NodeType::IntegerLiteral:
+                    return arena->make<IntegerLiteral>(this->ints[n.a]);
+                case NodeType::FloatLiteral:
+                    return arena->make<FloatLiteral>(this->floats[n.a]);
+                case NodeType::IdentifierLiteral:
+                    return arena->make<IdentifierLiteral>(std::string(string(n.a)));
+                case NodeType::BooleanLiteral:
+                    return arena->make<BooleanLiteral>(n.a != 0);
+                case NodeType::ArrayLiteral:
+                    return arena->make<ArrayLiteral>(inflate_list<Expression>(n.a, arena), int(n.b));
+                case NodeType::StringLiteral:
+                    return arena->make<StringLiteral>(std::string(string(n.a)));
+                case NodeType::FunctionParameter:
+                    return arena->make<FunctionParameter>(std::string(string(n.a)), std::string(string(n.b)));
+                default:
+                    std::cerr << "Unhandled node type while inflating: " << node_type_map[tag(index)] << '\n';
+                    return nullptr;
+            }
+        }
+};
+
+// Builds a FlatAst out of a pointer-based Program
+class FlatAstBuilder{
+    public:
+        FlatAst ast;
+
+        FlatAst build(Program* program){
+            this->ast = FlatAst();
+            this->interned.clear();
+            this->ast.root = add(program);
+            return std::move(this->ast);
+        }
+
+    private:
+        std::unordered_map<std::string, uint32_t> interned = {};
+
+        uint32_t intern(const std::string& value){
+            auto it = this->interned.find(value);
+            if (it != this->interned.end()){
+                return it->second;
+            }
+
+            uint32_t index = uint32_t(this->ast.string_count());
+            this->ast.string_data += value;
+            this->ast.string_offsets.push_back(uint32_t(this->ast.string_data.size()));
+            this->interned[value] = index;
+            return index;
+        }
+
+        uint32_t push(NodeType type, uint32_t a = FLAT_NONE, uint32_t b = FLAT_NONE, uint32_t c = FLAT_NONE, uint32_t d = FLAT_NONE){
+            this->ast.nodes.push_back(FlatNode{static_cast<uint8_t>(type), {0, 0, 0}, a, b, c, d});
+            return uint32_t(this->ast.nodes.size() - 1);
+        }
+
+        // children are added first, then the list is written out in one run
+        template <typename T>
+        uint32_t add_list(const std::vector<T*>& items){
+            std::vector<uint32_t> indices;
+            indices.reserve(items.size());
+            for (T* item : items){
+                indices.push_back(add(item));
+            }
+
+            uint32_t offset = uint32_t(this->ast.lists.size());
+            this->ast.lists.push_back(uint32_t(indices.size()));
+            this->ast.lists.insert(this->ast.lists.end(), indices.begin(), indices.end());
+            return offset;
+        }
+
+        uint32_t add(Node* node){
+            if (node == nullptr){
+                return FLAT_NONE;
+            }
+
+            switch (node->type_enum()){
+                case NodeType::Program:{
+                    auto program = static_cast<Program*>(node);
+                    return push(NodeType::Program, add_list(program->statements));
+                }
+                case NodeType::ExpressionStatement:{
+                    auto stmt = static_cast<ExpressionStatement*>(node);
+                    return push(NodeType::ExpressionStatement, add(stmt->expr));
+                }
+                case NodeType::LetStatement:{
+                    auto stmt = static_cast<LetStatement*>(node);
+                    uint32_t name = add(stmt->name);
+                    uint32_t value = add(stmt->value);
+                    return push(NodeType::LetStatement, name, value, intern(stmt->value_type));
+                }
+                case NodeType::BlockStatement:{
+                    auto block = static_cast<BlockStatement*>(node);
+                    return push(NodeType::BlockStatement, add_list(block->statements));
+                }
+                case NodeType::FunctionStatement:{
+                    auto func = static_cast<FunctionStatement*>(node);
+                    uint32_t name = add(func->name);
+                    uint32_t params = add_list(func->params);
+                    uint32_t body = add(func->body);
+                    return push(NodeType::FunctionStatement, name, body, intern(func->return_type), params);
+                }
+                case NodeType::ReturnStatement:{
+                    auto stmt = static_cast<ReturnStatement*>(node);
+                    return push(NodeType::ReturnStatement, add(stmt->return_value));
+                }
+                case NodeType::AssignStatement:{
+                    auto stmt = static_cast<AssignStatement*>(node);
+                    uint32_t ident = add(stmt->ident);
+                    uint32_t value = add(stmt->right_value);
+                    return push(NodeType::AssignStatement, ident, value);
+                }
+                case NodeType::IfStatement:{
+                    auto stmt = static_cast<IfStatement*>(node);
+                    uint32_t condition = add(stmt->condition);
+                    uint32_t consequence = add(stmt->concequence);
+                    uint32_t alternative = add(stmt->alternative);
+                    return push(NodeType::IfStatement, condition, consequence, alternative);
+                }
+                case NodeType::WhileStatement:{
+                    auto stmt = static_cast<WhileStatement*>(node);
+                    uint32_t condition = add(stmt->condition);
+                    uint32_t body = add(stmt->body);
+                    return push(NodeType::WhileStatement, condition, body, FLAT_NONE, pack_loop_hints(stmt->hints));
+                }
+                case NodeType::ForStatement:{
+                    auto stmt = static_cast<ForStatement*>(node);
+                    uint32_t variable = add(stmt->variable);
+                    uint32_t range = add_list(std::vector<Expression*>{stmt->start, stmt->end});
+                    uint32_t body = add(stmt->body);
+                    return push(NodeType::ForStatement, variable, range, body, pack_loop_hints(stmt->hints));
+                }
+                case NodeType::IndexAssignStatement:{
+                    auto stmt = static_cast<IndexAssignStatement*>(node);
+                    uint32_t target = add(stmt->target);
+                    uint32_t value = add(stmt->right_value);
+                    return push(NodeType::IndexAssignStatement, target, value);
+                }
+                case NodeType::InfixExpression:{
+                    auto expr = static_cast<InfixExpression*>(node);
+                    uint32_t left = add(expr->left);
+                    uint32_t right = add(expr->right);
+                    return push(NodeType::InfixExpression, left, right, intern(expr->op));
+                }
+                case NodeType::CallExpression:{
+                    auto expr = static_cast<CallExpression*>(node);
+                    uint32_t function = add(expr->Function);
+                    uint32_t arguments = add_list(expr->arguments);
+                    return push(NodeType::CallExpression, function, arguments);
+                }
+                case NodeType::IndexExpression:{
+                    auto expr = static_cast<IndexExpression*>(node);
+                    uint32_t array = add(expr->array);
+                    uint32_t index = add(expr->index);
+                    return push(NodeType::IndexExpression, array, index);
+                }
+                case NodeType::IntegerLiteral:{
+                    this->ast.ints.push_back(static_cast<IntegerLiteral*>(node)->value);
+                    return push(NodeType::IntegerLiteral, uint32_t(this->ast.ints.size() - 1));
+                }
+                case NodeType::FloatLiteral:{
+                    this->ast.floats.push_back(static_cast<FloatLiteral*>(node)->value);
+                    return push(NodeType::FloatLiteral, uint32_t(this->ast.floats.size() - 1));
+                }
+                case NodeType::IdentifierLiteral:{
+                    return push(NodeType::IdentifierLiteral, intern(static_cast<IdentifierLiteral*>(node)->value));
+                }
+                case NodeType::BooleanLiteral:{
+                    return push(NodeType::BooleanLiteral, static_cast<BooleanLiteral*>(node)->value ? 1 : 0);
+                }
+                case NodeType::ArrayLiteral:{
+                    auto literal = static_cast<ArrayLiteral*>(node);
+                    return push(NodeType::ArrayLiteral, add_list(literal->elements), uint32_t(literal->repeat));
+                }
+                case NodeType::StringLiteral:{
+                    return push(NodeType::StringLiteral, intern(static_cast<StringLiteral*>(node)->value));
+                }
+                case NodeType::FunctionParameter:{
+                    auto param = static_cast<FunctionParameter*>(node);
+                    return push(NodeType::FunctionParameter, intern(param->name), intern(param->value_type));
+                }
+                default:
+                    std::cerr << "Unhandled node type while flattening: " << node->type() << '\n';
+                    return FLAT_NONE;
+            }
+        }
+};
@@ -0,0 +1,234 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "Optimizer.hpp"
+#include "Runtime.hpp"
+
+enum class JitMode{
+    Eager, // a module is compiled whole the first time anything in it is looked up
+    Lazy, // every function is compiled and optimized on its first call, through a stub
+};
+
+struct JitStats{
+    size_t functions_added = 0; // function definitions in the modules added
+    size_t functions_compiled = 0; // of those, the ones materialized (compiled, or loaded from an object cache)
+
+    void print(std::ostream& out) const {
+        out << "jit: " << this->functions_compiled << " of " << this->functions_added << " functions compiled" << '\n';
+    }
+};
+
+// JIT session on ORC's LLJIT. Modules are added one at a time, each with its own context, and all
+// of them link into the same session so later modules can call into earlier ones. Functions are
+// called through native function pointers.
+//
+// In lazy mode the session is an LLLazyJIT whose CompileOnDemandLayer splits modules into one
+// partition per function; calls go through stubs that compile the callee on first use. Either way
+// every module on its way to codegen is optimized at the session's level, for the host target.
+class Jit{
+    public:
+        // native signature of a ligma main
+        using MainFunction = int (*)();
+
+        JitMode mode;
+
+        // start a session for the host, returns nullptr (and reports why) if LLJIT can't be created.
+        // With an object cache, codegen checks it first and stores what it compiles; the cache must
+        // outlive the session. With compile threads, independent modules are compiled concurrently.
+        static std::unique_ptr<Jit> create(JitMode mode = JitMode::Eager, OptLevel level = OptLevel::O0, llvm::ObjectCache* cache = nullptr, unsigned compile_threads = 0){
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+            llvm::InitializeNativeTargetAsmParser();
+
+            // the default compiler for the session, with the cache attached
+            auto compiler_creator = [cache, compile_threads](llvm::orc::JITTargetMachineBuilder builder)
+                -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                if (compile_threads > 0){
+                    return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(builder), cache);
+                }
+                auto target = builder.createTargetMachine();
+                if (!target){
+                    return target.takeError();
+                }
+                return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(*target), cache);
+            };
+
+            std::unique_ptr<llvm::orc::LLJIT> lljit;
+            if (mode == JitMode::Lazy){
+                llvm::orc::LLLazyJITBuilder builder;
+                builder.setNumCompileThreads(compile_threads);
+                if (cache){
+                    builder.setCompileFunctionCreator(compiler_creator);
+                }
+                auto lazy = builder.create();
+                if (!lazy){
+                    report(lazy.takeError());
+                    return nullptr;
+                }
+                (*lazy)->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+                lljit = std::move(*lazy);
+            } else {
+                llvm::orc::LLJITBuilder builder;
+                builder.setNumCompileThreads(compile_threads);
+                if (cache){
+                    builder.setCompileFunctionCreator(compiler_creator);
+                }
+                auto eager = builder.create();
+                if (!eager){
+                    report(eager.takeError());
+                    return nullptr;
+                }
+                lljit = std::move(*eager);
+            }
+
+            // the library functions codegen lowers to calls (e.g. powf) come from the host process. Only those,
+            // so a program can't bind to anything else in it, like the compiler's own main
+            llvm::orc::SymbolNameSet library;
+            for (const char* name : LIBRARY_SYMBOLS){
+                library.insert(lljit->mangleAndIntern(name));
+            }
+            auto process_symbols = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(lljit->getDataLayout().getGlobalPrefix(),
+                [library = std::move(library)](const llvm::orc::SymbolStringPtr& name){ return library.count(name) > 0; });
+            if (!process_symbols){
+                report(process_symbols.takeError());
+                return nullptr;
+            }
+            lljit->getMainJITDylib().addGenerator(std::move(*process_symbols));
+
+            // the runtime library is linked into this process, its functions are bound by address
+            llvm::orc::SymbolMap runtime;
+            for (const auto& [name, address] : Runtime::symbols()){
+#if LLVM_VERSION_MAJOR >= 17
+                runtime[lljit->mangleAndIntern(name)] = llvm::orc::ExecutorSymbolDef(llvm::orc::ExecutorAddr::fromPtr(address), llvm::JITSymbolFlags::Exported);
+#else
+                runtime[lljit->mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(address), llvm::JITSymbolFlags::Exported);
+#endif
+            }
+            if (llvm::Error error = lljit->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(runtime)))){
+                report(std::move(error));
+                return nullptr;
+            }
+
+            auto jit = std::unique_ptr<Jit>(new Jit(mode, level, std::move(lljit)));
+            jit->lljit->getIRTransformLayer().setTransform([jit = jit.get()](llvm::orc::ThreadSafeModule tsm, llvm::orc::MaterializationResponsibility&){
+                tsm.withModuleDo([jit](llvm::Module& module){
+                    jit->compiled += count_definitions(module);
+                    if (jit->level != OptLevel::O0){
+                        std::unique_ptr<llvm::TargetMachine> target = host_target_machine();
+                        if (target){
+                            prepare_module(module, *target);
+                        }
+                        Optimizer(jit->level, target.get()).run(module);
+                    }
+                });
+                return llvm::Expected<llvm::orc::ThreadSafeModule>(std::move(tsm));
+            });
+            return jit;
+        }
+
+        // target machine for the host, as the session detects it, returns nullptr (and reports why) if there is none.
+        // Optimizing with it lets the passes query the target's costs, e.g. the vectorizers' register widths.
+        // A TargetMachine isn't safe to share between threads, so each compile thread makes its own.
+        static std::unique_ptr<llvm::TargetMachine> host_target_machine(){
+            llvm::InitializeNativeTarget();
+            auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+            if (!builder){
+                report(builder.takeError());
+                return nullptr;
+            }
+            auto target = builder->createTargetMachine();
+            if (!target){
+                report(target.takeError());
+                return nullptr;
+            }
+            return std::move(*target);
+        }
+
+        // stamp the module with the target's triple and data layout, do this before optimizing it
+        static void prepare_module(llvm::Module& module, llvm::TargetMachine& target){
+            module.setTargetTriple(target.getTargetTriple().str());
+            module.setDataLayout(target.createDataLayout());
+        }
+
+        // add a module (e.g. from Compiler::take_module()), false if it was rejected
+        bool add_module(std::unique_ptr<llvm::LLVMContext> context, std::unique_ptr<llvm::Module> module){
+            this->added += count_definitions(*module);
+
+            llvm::orc::ThreadSafeModule tsm(std::move(module), llvm::orc::ThreadSafeContext(std::move(context)));
+            llvm::Error error = this->mode == JitMode::Lazy
+                ? static_cast<llvm::orc::LLLazyJIT*>(this->lljit.get())->addLazyIRModule(std::move(tsm))
+                : this->lljit->addIRModule(std::move(tsm));
+            if (error){
+                report(std::move(error));
+                return false;
+            }
+            return true;
+        }
+
+        // address of a function in the session as a native function pointer, nullptr if not found.
+        // Looking a symbol up is what compiles the modules it depends on.
+        template <typename F>
+        F lookup(const std::string& name){
+            auto symbol = this->lljit->lookup(name);
+            if (!symbol){
+                report(symbol.takeError());
+                return nullptr;
+            }
+            return symbol->toPtr<F>();
+        }
+
+        JitStats stats() const {
+            return JitStats{this->added, this->compiled.load()};
+        }
+
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+    private:
+        // libm and libc functions LLVM lowers intrinsics and recognized idioms to (pow, frem, memcpy loops, ...)
+        static constexpr const char* LIBRARY_SYMBOLS[] = {
+            "pow", "powf", "fmod", "fmodf", "exp2", "exp2f", "ldexp", "ldexpf", "sqrt", "sqrtf",
+            "__powidf2", "__powisf2", "memcpy", "memmove", "memset", "memcmp", "bcmp",
+        };
+
+        OptLevel level;
+        std::unique_ptr<llvm::orc::LLJIT> lljit;
+
+        size_t added = 0;
+        std::atomic<size_t> compiled = 0; // bumped from the compile threads
+
+        Jit(JitMode mode, OptLevel level, std::unique_ptr<llvm::orc::LLJIT> lljit) : mode(mode), level(level), lljit(std::move(lljit)){}
+
+        static size_t count_definitions(const llvm::Module& module){
+            size_t count = 0;
+            for (const llvm::Function& func : module){
+                if (!func.isDeclaration()){
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        static void report(llvm::Error error){
+            llvm::handleAllErrors(std::move(error), [](const llvm::ErrorInfoBase& info){
+                std::cerr << "JIT error: " << info.message() << '\n';
+            });
+        }
+};
@@ -1,19 +1,34 @@
 #pragma once
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <memory>
 #include "Token.hpp"
+#include "SourceBuffer.hpp"
+#include "Scan.hpp"
+#include "TokenBuffer.hpp"
 
 class Lexer{
     public:
 
-        std::string source;
+        std::shared_ptr<const SourceBuffer> buffer; // keeps the source alive, tokens view into it
+        std::string_view source;
         int pos;
         int read_pos; // whats next?
         int line_no;
         char current_char;
     
-        Lexer(std::string source)
-            : source(source), pos(-1), read_pos(0), line_no(1), current_char(source[0]) {
+        Lexer(std::string source) : Lexer(SourceBuffer::from_string(std::move(source))){}
+
+        // lex straight out of a (memory mapped) source buffer without copying it
+        Lexer(std::shared_ptr<const SourceBuffer> buffer)
+            : buffer(buffer), source(buffer->view()), pos(-1), read_pos(0), line_no(1), current_char('\0') {
+                read_char();
+            }
+
+        // lex only [begin, end) of the buffer, positions stay absolute so tokens match a whole-file lex
+        Lexer(std::shared_ptr<const SourceBuffer> buffer, size_t begin, size_t end, int line_no = 1)
+            : buffer(buffer), source(buffer->view().substr(0, end)), pos(int(begin) - 1), read_pos(int(begin)), line_no(line_no), current_char('\0') {
                 read_char();
             }
 
@@ -26,110 +41,136 @@ class Lexer{
             switch (this->current_char)
             {
             case '+':{
-                tok = create_token(TokenType::PLUS, "+");
+                tok = create_token(TokenType::PLUS, 1);
                 break;
             }
             case '-':{
                 // handle arrow
                 if (peek_char() == '>'){
                     read_char();
-                    tok = create_token(TokenType::ARROW, "->");
+                    tok = create_token(TokenType::ARROW, 2);
                 } else {
-                    tok = create_token(TokenType::MINUS, "-");
+                    tok = create_token(TokenType::MINUS, 1);
                 }
                 break;
             }
             case '*':{
-                tok = create_token(TokenType::ASTERISK, "*");
+                tok = create_token(TokenType::ASTERISK, 1);
                 break;
             }
             case '/':{
-                tok = create_token(TokenType::SLASH, "/");
+                tok = create_token(TokenType::SLASH, 1);
                 break;
             }
             case '^':{
-                tok = create_token(TokenType::POW, "^");
+                tok = create_token(TokenType::POW, 1);
                 break;
             }
             case '%':{
-                tok = create_token(TokenType::MODULUS, "%");
+                tok = create_token(TokenType::MODULUS, 1);
                 break;
             }
             case '<':{
                 if (peek_char() == '='){
                     read_char();
-                    tok = create_token(TokenType::LT_EQ, "<=");
+                    tok = create_token(TokenType::LT_EQ, 2);
                 } else {
-                    tok = create_token(TokenType::LT, "<");
+                    tok = create_token(TokenType::LT, 1);
                 }
                 break;
             }
             case '>':{
                 if (peek_char() == '='){
                     read_char();
-                    tok = create_token(TokenType::GT_EQ, ">=");
+                    tok = create_token(TokenType::GT_EQ, 2);
                 } else {
-                    tok = create_token(TokenType::GT, ">");
+                    tok = create_token(TokenType::GT, 1);
                 }
                 break;
             }
             case '=':{
                 if (peek_char() == '='){
                     read_char();
-                    tok = create_token(TokenType::EQ_EQ, "==");
+                    tok = create_token(TokenType::EQ_EQ, 2);
                 } else {
-                    tok = create_token(TokenType::EQ, "=");
+                    tok = create_token(TokenType::EQ, 1);
                 }
                 break;
             }
             case '!':{
                 if (peek_char() == '='){
                     read_char();
-                    tok = create_token(TokenType::NOT_EQ, "!=");
+                    tok = create_token(TokenType::NOT_EQ, 2);
                 } else {
                     // TODO
-                    tok = create_token(TokenType::ILLEGAL, "!");
+                    tok = create_token(TokenType::ILLEGAL, 1);
                 }
                 break;
             }
             case ':':{
-                tok = create_token(TokenType::COLON, ":");
+                tok = create_token(TokenType::COLON, 1);
                 break;
             }
             case ';':{
-                tok = create_token(TokenType::SEMICOLON, ";");
+                tok = create_token(TokenType::SEMICOLON, 1);
                 break;
             }
             case ',':{
-                tok = create_token(TokenType::COMMA, ",");
+                tok = create_token(TokenType::COMMA, 1);
                 break;
             }
             case '(':{
-                tok = create_token(TokenType::LPAREN, "(");
+                tok = create_token(TokenType::LPAREN, 1);
                 break;
 
             }
             case ')':{
-                tok = create_token(TokenType::RPAREN, ")");
+                tok = create_token(TokenType::RPAREN, 1);
                 break;
             }
             case '{':{
-                tok = create_token(TokenType::LBRACE, "{");
+                tok = create_token(TokenType::LBRACE, 1);
                 break;
             }
             case '}':{
-                tok = create_token(TokenType::RBRACE, "}");
+                tok = create_token(TokenType::RBRACE, 1);
+                break;
+            }
+            case '[':{
+                tok = create_token(TokenType::LBRACKET, 1);
+                break;
+            }
+            case ']':{
+                tok = create_token(TokenType::RBRACKET, 1);
+                break;
+            }
+            case '.':{
+                // a range, a lone dot only appears inside a number
+                if (peek_char() == '.'){
+                    read_char();
+                    tok = create_token(TokenType::DOT_DOT, 2);
+                } else {
+                    tok = create_token(TokenType::ILLEGAL, 1);
+                }
+                break;
+            }
+            case '@':{
+                tok = create_token(TokenType::AT, 1);
+                break;
+            }
+            case '"':{
+                tok = read_string();
                 break;
             }
             case '\0':{
-                tok = create_token(TokenType::EOF_, "");
+                tok = create_token(TokenType::EOF_, this->source.substr(this->source.length()));
                 break;
             }
             
             default:
                 // check if its a letter
                 if (isalpha(this->current_char)){
-                    std::string literal = read_ident();
+                    std::string_view literal = read_ident();
                     TokenType type = lookup_ident(literal); // check if its a reserved keyword
                     tok = create_token(type, literal);
                     return tok;
@@ -140,7 +181,7 @@ class Lexer{
                     return tok;
                 
                 } else { // illegal token
-                    tok = create_token(TokenType::ILLEGAL, std::string(1, this->current_char));
+                    tok = create_token(TokenType::ILLEGAL, source.substr(this->pos, 1));
                 }
                 break;
             }
@@ -149,6 +190,22 @@ class Lexer{
             return tok;
         }
 
+        // lex the rest of the source up front into a structure-of-arrays token buffer (ends with EOF)
+        TokenBuffer tokenize(){
+            TokenBuffer tokens = TokenBuffer(this->buffer);
+            tokens.reserve(this->source.length() / 8 + 1);
+
+            while (true){
+                Token tok = next_token();
+                tokens.push(tok);
+                if (tok.type == TokenType::EOF_){
+                    break;
+                }
+            }
+
+            return tokens;
+        }
+
     private:
         
         void read_char(){ // read next character
@@ -165,6 +222,12 @@ class Lexer{
             this->read_pos += 1;
         }
 
+        void advance_to(size_t new_pos){ // jump to a position found by a scanner
+            this->current_char = new_pos < this->source.length() ? this->source[new_pos] : '\0';
+            this->pos = new_pos;
+            this->read_pos = new_pos + 1;
+        }
+
         char peek_char(){ // what's the next character?
             if(this->read_pos >= this->source.length()){
                 return '\0';
@@ -177,11 +240,14 @@ class Lexer{
 
             int start_pos = this->pos;
             int dot_count = 0; // for float numbers
-            std::string output = "";
 
             // while is digit or dot
             while (isdigit(this->current_char) || this->current_char == '.'){
 
+                // 0..10 is a range, not a float
+                if (this->current_char == '.' && peek_char() == '.'){
+                    break;
+                }
                 
                 if(this->current_char == '.'){ 
                     dot_count += 1;
@@ -189,25 +255,30 @@ class Lexer{
 
                 if(dot_count > 1){ // invalid float number
 
-                    std::string invalid_number = source.substr(start_pos, this->pos - start_pos);
-
-                    while (this->current_char != ' ' && this->current_char != '\t' && this->current_char != '\n' && this->current_char != '\r'){
-                        invalid_number += this->current_char;
+                    while (this->current_char != ' ' && this->current_char != '\t' && this->current_char != '\n' && this->current_char != '\r' && this->current_char != '\0'){
                         read_char();
                     }
 
+                    std::string_view invalid_number = source.substr(start_pos, this->pos - start_pos);
+
                     std::cout << "Invalid number: " << invalid_number << " at line: " << this->line_no << " pos: " << this->pos << std::endl;
                     return create_token(TokenType::ILLEGAL, invalid_number);
                 }
 
-                output += this->current_char;
-                read_char();
+                // consume a whole run of digits at once
+                if (this->current_char == '.'){
+                    read_char();
+                } else {
+                    advance_to(scan_functions().digits(this->source.data(), this->pos, this->source.length()));
+                }
 
                 if (this->current_char == '\0'){
                     break;
                 }
             }
 
+            std::string_view output = source.substr(start_pos, this->pos - start_pos);
+
             if (dot_count == 0){ // integer
                 return create_token(TokenType::INT, output);
             } else { // float
@@ -217,26 +288,51 @@ class Lexer{
 
 
         void skip_whitespace(){ // skip whitespaces
-            while (this->current_char == ' ' || this->current_char == '\t' || this->current_char == '\n' || this->current_char == '\r'){
-                if(this->current_char == '\n'){
-                    this->line_no += 1;
-                }
-                read_char();
+            if (!is_whitespace_char(this->current_char)){
+                return;
             }
+
+            // find the end of the whitespace run and count its newlines in bulk
+            int newlines = 0;
+            size_t end = scan_functions().whitespace(this->source.data(), this->pos, this->source.length(), newlines);
+            this->line_no += newlines;
+            advance_to(end);
         }
 
-        Token create_token(TokenType type, std::string literal){
+        Token create_token(TokenType type, std::string_view literal){
             return Token(type, literal, this->line_no, this->pos);
         }
 
-        std::string read_ident(){ // read identifiers
+        Token create_token(TokenType type, size_t length){ // token of `length` chars ending at the current char
+            return create_token(type, this->source.substr(this->pos + 1 - length, length));
+        }
 
+        // a string literal, the token is what is between the quotes with its escapes left in for the
+        // parser. It can't span lines, an unterminated one is ILLEGAL up to the end of the line
+        Token read_string(){
             int start_pos = this->pos;
-            
-            // reading variable names
-            while (isalpha(this->current_char) || isalnum(this->current_char) || this->current_char == '_'){
+            read_char();
+            while (this->current_char != '"' && this->current_char != '\n' && this->current_char != '\0'){
+                if (this->current_char == '\\' && peek_char() != '\n' && peek_char() != '\0'){
+                    read_char();
+                }
                 read_char();
             }
+            if (this->current_char != '"'){
+                // back off one char, so the newline (or the end) is what the next token starts at
+                Token tok = create_token(TokenType::ILLEGAL, source.substr(start_pos, this->pos - start_pos));
+                advance_to(this->pos - 1);
+                return tok;
+            }
+            return create_token(TokenType::STRING, source.substr(start_pos + 1, this->pos - start_pos - 1));
+        }
+
+        std::string_view read_ident(){ // read identifiers
+
+            int start_pos = this->pos;
+            
+            // reading variable names
+            advance_to(scan_functions().ident(this->source.data(), this->pos, this->source.length()));
             return source.substr(start_pos, this->pos - start_pos);
         }
 
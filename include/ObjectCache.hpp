@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+#if LLVM_VERSION_MAJOR >= 17
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
+
+#include "Optimizer.hpp"
+
+struct ObjectCacheStats{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stores = 0;
+    size_t evictions = 0;
+
+    void print(std::ostream& out) const {
+        out << "object cache: " << this->hits << " hits, " << this->misses << " misses, " << this->stores << " stored, "
+            << this->evictions << " evicted" << '\n';
+    }
+};
+
+// llvm::ObjectCache on disk for the JIT. Every module that reaches codegen is keyed by a SHA-1 of
+// its IR together with the cache format version, the LLVM version, the optimization level and the
+// host CPU, and its object code is stored as <key>.o in the cache directory. A repeat of the same
+// module loads the object instead of running codegen.
+//
+// The directory is kept under max_bytes: after each store the least recently used objects (by
+// modification time, which a hit refreshes) are removed until it fits.
+class DiskObjectCache : public llvm::ObjectCache{
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        DiskObjectCache(std::filesystem::path directory, OptLevel level, uint64_t max_bytes = 256ull * 1024 * 1024)
+            : directory(std::move(directory)), level(level), max_bytes(max_bytes), cpu(llvm::sys::getHostCPUName().str()){
+            std::error_code ec;
+            std::filesystem::create_directories(this->directory, ec);
+        }
+
+        // default cache directory: $LIGMA_CACHE_DIR, else $XDG_CACHE_HOME/ligma, else ~/.cache/ligma
+        static std::filesystem::path default_directory(){
+            if (const char* dir = std::getenv("LIGMA_CACHE_DIR"); dir && *dir){
+                return dir;
+            }
+            if (const char* dir = std::getenv("XDG_CACHE_HOME"); dir && *dir){
+                return std::filesystem::path(dir) / "ligma";
+            }
+            if (const char* home = std::getenv("HOME"); home && *home){
+                return std::filesystem::path(home) / ".cache" / "ligma";
+            }
+            return std::filesystem::temp_directory_path() / "ligma-cache";
+        }
+
+        std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override {
+            std::filesystem::path path = object_path(*module);
+            auto buffer = llvm::MemoryBuffer::getFile(path.string(), false, false);
+            if (!buffer){
+                // codegen changes the IR (it drops unreachable blocks, for one), so the object is
+                // stored under the key of the module as it was looked up
+                std::lock_guard<std::mutex> lock(this->pending_mutex);
+                this->pending[module] = path;
+                this->misses++;
+                return nullptr;
+            }
+
+            // a hit makes the object the most recently used one
+            std::error_code ec;
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+            this->hits++;
+            return std::move(*buffer);
+        }
+
+        void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override {
+            std::filesystem::path path;
+            {
+                std::lock_guard<std::mutex> lock(this->pending_mutex);
+                auto it = this->pending.find(module);
+                if (it == this->pending.end()){
+                    return;
+                }
+                path = std::move(it->second);
+                this->pending.erase(it);
+            }
+
+            // written to a file of its own and renamed, so a concurrent reader never sees half an object
+            // and concurrent writers of the same object don't write into each other's file
+            int fd = -1;
+            llvm::SmallString<128> tmp_path;
+            if (llvm::sys::fs::createUniqueFile(path.string() + ".%%%%%%%%.tmp", fd, tmp_path)){
+                return;
+            }
+            {
+                llvm::raw_fd_ostream out(fd, true);
+                out.write(object.getBufferStart(), object.getBufferSize());
+                out.close();
+                if (out.has_error()){
+                    out.clear_error();
+                    llvm::sys::fs::remove(tmp_path);
+                    return;
+                }
+            }
+            if (llvm::sys::fs::rename(tmp_path, path.string())){
+                llvm::sys::fs::remove(tmp_path);
+                return;
+            }
+            this->stores++;
+            evict();
+        }
+
+        ObjectCacheStats stats() const {
+            return ObjectCacheStats{this->hits.load(), this->misses.load(), this->stores.load(), this->evictions.load()};
+        }
+
+    private:
+        std::filesystem::path directory;
+        OptLevel level;
+        uint64_t max_bytes;
+        std::string cpu;
+
+        std::mutex eviction_mutex;
+        std::mutex pending_mutex;
+        std::map<const llvm::Module*, std::filesystem::path> pending = {}; // object paths of the modules being compiled
+        std::atomic<size_t> hits = 0;
+        std::atomic<size_t> misses = 0;
+        std::atomic<size_t> stores = 0;
+        std::atomic<size_t> evictions = 0;
+
+        std::filesystem::path object_path(const llvm::Module& module) const {
+            return this->directory / (key(module) + ".o");
+        }
+
+        std::string key(const llvm::Module& module) const {
+            std::string text;
+            llvm::raw_string_ostream stream(text);
+            stream << "ligma-object-cache " << VERSION << '\n' << "llvm " << LLVM_VERSION_STRING << '\n'
+                   << "opt " << static_cast<int>(this->level) << '\n' << "cpu " << this->cpu << '\n';
+            module.print(stream, nullptr);
+            stream.flush();
+
+            auto digest = llvm::SHA1::hash(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(text.data()), text.size()));
+            static const char* hex = "0123456789abcdef";
+            std::string name;
+            for (uint8_t byte : digest){
+                name += hex[byte >> 4];
+                name += hex[byte & 0xf];
+            }
+            return name;
+        }
+
+        // drop the least recently used objects until the directory fits in max_bytes
+        void evict(){
+            std::lock_guard<std::mutex> lock(this->eviction_mutex);
+
+            struct Entry{
+                std::filesystem::path path;
+                std::filesystem::file_time_type time;
+                uint64_t size;
+            };
+            std::vector<Entry> entries;
+            uint64_t total = 0;
+
+            std::error_code ec;
+            for (const auto& file : std::filesystem::directory_iterator(this->directory, ec)){
+                if (!file.is_regular_file(ec) || file.path().extension() != ".o"){
+                    continue;
+                }
+                uint64_t size = file.file_size(ec);
+                if (ec){
+                    continue;
+                }
+                entries.push_back({file.path(), file.last_write_time(ec), size});
+                total += size;
+            }
+            if (total <= this->max_bytes){
+                return;
+            }
+
+            std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){ return a.time < b.time; });
+            for (const Entry& entry : entries){
+                if (total <= this->max_bytes){
+                    break;
+                }
+                if (std::filesystem::remove(entry.path, ec)){
+                    total -= entry.size;
+                    this->evictions++;
+                }
+            }
+        }
+};
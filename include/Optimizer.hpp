@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+enum class OptLevel{
+    O0,
+    O1,
+    O2,
+    O3,
+};
+
+// instruction counts of a module before and after optimization, per function and in total
+struct OptimizationReport{
+    struct Function{
+        std::string name;
+        size_t before;
+        size_t after;
+    };
+
+    OptLevel level = OptLevel::O0;
+    std::vector<Function> functions = {};
+    size_t before = 0;
+    size_t after = 0;
+    bool ran = false; // false when the module failed verification and was left alone
+
+    void print(std::ostream& out) const {
+        out << "-O" << static_cast<int>(this->level) << ": " << this->before << " -> " << this->after << " instructions";
+        if (!this->ran){
+            out << " (not optimized, module is invalid)";
+        }
+        out << '\n';
+        for (const Function& func : this->functions){
+            out << "    " << func.name << ": " << func.before << " -> " << func.after << '\n';
+        }
+    }
+};
+
+// Runs LLVM's default new pass manager pipeline for an optimization level over a module
+class Optimizer{
+    public:
+        OptLevel level;
+
+        // the target machine, when there is one, lets passes query the target's costs
+        Optimizer(OptLevel level, llvm::TargetMachine* target = nullptr) : level(level), target(target){}
+
+        // "-O0" .. "-O3", std::nullopt for anything else
+        static std::optional<OptLevel> parse_level(std::string_view flag){
+            if (flag.size() != 3 || flag[0] != '-' || flag[1] != 'O' || flag[2] < '0' || flag[2] > '3'){
+                return std::nullopt;
+            }
+            return static_cast<OptLevel>(flag[2] - '0');
+        }
+
+        OptimizationReport run(llvm::Module& module){
+            OptimizationReport report;
+            report.level = this->level;
+            for (llvm::Function& func : module){
+                if (!func.isDeclaration()){
+                    report.functions.push_back({func.getName().str(), func.getInstructionCount(), 0});
+                    report.before += func.getInstructionCount();
+                }
+            }
+
+            // the passes assume well formed IR, so a broken module goes through untouched
+            std::string problems;
+            llvm::raw_string_ostream problems_stream(problems);
+            if (llvm::verifyModule(module, &problems_stream)){
+                std::cerr << "Module verification failed, skipping optimization:\n" << problems_stream.str();
+                report.after = report.before;
+                for (auto& func : report.functions){
+                    func.after = func.before;
+                }
+                return report;
+            }
+
+            llvm::LoopAnalysisManager loop_am;
+            llvm::FunctionAnalysisManager function_am;
+            llvm::CGSCCAnalysisManager cgscc_am;
+            llvm::ModuleAnalysisManager module_am;
+
+            llvm::PassBuilder builder(this->target);
+            builder.registerModuleAnalyses(module_am);
+            builder.registerCGSCCAnalyses(cgscc_am);
+            builder.registerFunctionAnalyses(function_am);
+            builder.registerLoopAnalyses(loop_am);
+            builder.crossRegisterProxies(loop_am, function_am, cgscc_am, module_am);
+
+            llvm::ModulePassManager passes = this->level == OptLevel::O0
+                ? builder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0)
+                : builder.buildPerModuleDefaultPipeline(llvm_level());
+            passes.run(module, module_am);
+            report.ran = true;
+
+            // functions the pipeline removed count as zero instructions
+            for (auto& func : report.functions){
+                llvm::Function* optimized = module.getFunction(func.name);
+                func.after = (optimized && !optimized->isDeclaration()) ? optimized->getInstructionCount() : 0;
+                report.after += func.after;
+            }
+            return report;
+        }
+
+    private:
+        llvm::TargetMachine* target;
+
+        llvm::OptimizationLevel llvm_level() const {
+            switch (this->level){
+                case OptLevel::O1: return llvm::OptimizationLevel::O1;
+                case OptLevel::O2: return llvm::OptimizationLevel::O2;
+                case OptLevel::O3: return llvm::OptimizationLevel::O3;
+                default: return llvm::OptimizationLevel::O0;
+            }
+        }
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <future>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "FlatAst.hpp"
+#include "Compiler.hpp"
+#include "Jit.hpp"
+#include "Optimizer.hpp"
+#include "ThreadPool.hpp"
+
+// a module together with the context it lives in, the module has to go before the context
+struct CompiledModule{
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+};
+
+// Compiles every top-level function of a program in its own LLVMContext and module on a thread pool.
+//
+// The signatures of all top-level functions are collected first, and every module declares the ones
+// it calls but doesn't define, so calls resolve across modules (and forward). The first module defines the
+// builtin globals and holds the remaining top-level statements; every other module holds one function,
+// lowered and optimized for the host by a worker. Top-level lets bind values in the compiler's environment
+// rather than emitting globals, so a worker binds the ones before its function again, as the serial
+// compiler would have seen them. The modules can go to the JIT as they are or be linked into one.
+class ParallelCompiler{
+    public:
+        OptLevel level; // per-function optimization done by the workers
+
+        ParallelCompiler(size_t threads = std::thread::hardware_concurrency(), OptLevel level = OptLevel::O0) : level(level), pool(threads){}
+
+        std::vector<CompiledModule> compile(const FlatAst& ast){
+            std::vector<Signature> signatures;
+            std::vector<uint32_t> other_statements;
+            std::vector<uint32_t> lets; // the top-level lets, in order
+            if (ast.root != FLAT_NONE){
+                for (uint32_t stmt : ast.list(ast.node(ast.root).a)){
+                    if (stmt != FLAT_NONE && ast.tag(stmt) == NodeType::FunctionStatement){
+                        signatures.push_back(signature(ast, stmt));
+                        signatures.back().lets_before = lets.size();
+                    } else {
+                        other_statements.push_back(stmt);
+                        if (stmt != FLAT_NONE && ast.tag(stmt) == NodeType::LetStatement){
+                            lets.push_back(stmt);
+                        }
+                    }
+                }
+            }
+
+            std::vector<std::future<CompiledModule>> pending;
+            for (size_t i = 0; i < signatures.size(); i++){
+                pending.push_back(this->pool.submit([this, &ast, &signatures, &lets, i](){
+                    std::set<std::string> called = called_functions(ast, signatures[i].index);
+                    for (size_t let = 0; let < signatures[i].lets_before; let++){
+                        collect_calls(ast, lets[let], called);
+                    }
+
+                    Compiler compiler = Compiler(false);
+                    declare(compiler, signatures, i, called);
+                    for (size_t let = 0; let < signatures[i].lets_before; let++){
+                        compiler.compile(ast, lets[let]);
+                    }
+                    compiler.compile(ast, signatures[i].index);
+
+                    auto [context, module] = compiler.take_module();
+                    module->setModuleIdentifier(signatures[i].name);
+                    if (this->level != OptLevel::O0){
+                        std::unique_ptr<llvm::TargetMachine> target = Jit::host_target_machine();
+                        if (target){
+                            Jit::prepare_module(*module, *target);
+                        }
+                        Optimizer(this->level, target.get()).run(*module);
+                    }
+                    return CompiledModule{std::move(context), std::move(module)};
+                }));
+            }
+
+            // the first module, compiled here while the workers run
+            std::set<std::string> called;
+            for (uint32_t stmt : other_statements){
+                collect_calls(ast, stmt, called);
+            }
+            Compiler compiler = Compiler();
+            declare(compiler, signatures, signatures.size(), called);
+            for (uint32_t stmt : other_statements){
+                compiler.compile(ast, stmt);
+            }
+            auto [context, module] = compiler.take_module();
+
+            std::vector<CompiledModule> modules;
+            modules.push_back(CompiledModule{std::move(context), std::move(module)});
+            for (auto& result : pending){
+                modules.push_back(result.get());
+            }
+            return modules;
+        }
+
+        // link modules into the first one's context; every other module makes a bitcode round trip,
+        // since the linker only works within a single context. nullptr module if linking fails.
+        static CompiledModule link(std::vector<CompiledModule> modules){
+            if (modules.empty()){
+                return CompiledModule{nullptr, nullptr};
+            }
+            CompiledModule linked = std::move(modules[0]);
+            for (size_t i = 1; i < modules.size(); i++){
+                llvm::SmallVector<char, 0> bitcode;
+                llvm::raw_svector_ostream out(bitcode);
+                llvm::WriteBitcodeToFile(*modules[i].module, out);
+                std::string name = modules[i].module->getModuleIdentifier();
+                modules[i].module.reset(); // before its context
+                modules[i].context.reset();
+
+                auto module = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), name), *linked.context);
+                if (!module){
+                    llvm::consumeError(module.takeError());
+                    std::cerr << "Unable to reload module " << name << " for linking\n";
+                    return CompiledModule{std::move(linked.context), nullptr};
+                }
+                if (llvm::Linker::linkModules(*linked.module, std::move(*module))){
+                    std::cerr << "Unable to link module " << name << '\n';
+                    return CompiledModule{std::move(linked.context), nullptr};
+                }
+            }
+            return linked;
+        }
+
+    private:
+        ThreadPool pool;
+
+        struct Signature{
+            uint32_t index; // the FunctionStatement node
+            std::string name;
+            std::vector<std::string> param_types;
+            std::string return_type;
+            size_t lets_before = 0; // top-level lets that come before the function
+        };
+
+        static Signature signature(const FlatAst& ast, uint32_t index){
+            const FlatNode& func = ast.node(index);
+            Signature sig = {index, std::string(ast.string(ast.node(func.a).a)), {}, std::string(ast.string(func.c))};
+            for (uint32_t param : ast.list(func.d)){
+                sig.param_types.push_back(std::string(ast.string(ast.node(param).b)));
+            }
+            return sig;
+        }
+
+        static std::set<std::string> called_functions(const FlatAst& ast, uint32_t index){
+            std::set<std::string> called;
+            collect_calls(ast, index, called);
+            return called;
+        }
+
+        // names of the functions called or referenced (e.g. passed to map) anywhere under a node,
+        // along with other identifiers, which declare() skips
+        static void collect_calls(const FlatAst& ast, uint32_t index, std::set<std::string>& called){
+            if (index == FLAT_NONE){
+                return;
+            }
+
+            const FlatNode& node = ast.node(index);
+            switch (ast.tag(index)){
+                case NodeType::Program:
+                case NodeType::BlockStatement:
+                    for (uint32_t stmt : ast.list(node.a)){
+                        collect_calls(ast, stmt, called);
+                    }
+                    break;
+                case NodeType::ExpressionStatement:
+                case NodeType::ReturnStatement:
+                    collect_calls(ast, node.a, called);
+                    break;
+                case NodeType::LetStatement:
+                case NodeType::AssignStatement:
+                case NodeType::FunctionStatement:
+                    collect_calls(ast, node.b, called);
+                    break;
+                case NodeType::IfStatement:
+                    collect_calls(ast, node.a, called);
+                    collect_calls(ast, node.b, called);
+                    collect_calls(ast, node.c, called);
+                    break;
+                case NodeType::InfixExpression:
+                case NodeType::WhileStatement:
+                case NodeType::IndexAssignStatement:
+                case NodeType::IndexExpression:
+                    collect_calls(ast, node.a, called);
+                    collect_calls(ast, node.b, called);
+                    break;
+                case NodeType::ForStatement:
+                    for (uint32_t bound : ast.list(node.b)){
+                        collect_calls(ast, bound, called);
+                    }
+                    collect_calls(ast, node.c, called);
+                    break;
+                case NodeType::CallExpression:
+                    called.insert(std::string(ast.string(ast.node(node.a).a)));
+                    for (uint32_t arg : ast.list(node.b)){
+                        collect_calls(ast, arg, called);
+                    }
+                    break;
+                case NodeType::ArrayLiteral:
+                    for (uint32_t element : ast.list(node.a)){
+                        collect_calls(ast, element, called);
+                    }
+                    break;
+                case NodeType::IdentifierLiteral:
+                    called.insert(std::string(ast.string(node.a)));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // declare the called functions, but not the one the module defines itself
+        static void declare(Compiler& compiler, const std::vector<Signature>& signatures, size_t defined, const std::set<std::string>& called){
+            for (size_t i = 0; i < signatures.size(); i++){
+                if (i != defined && called.count(signatures[i].name) > 0){
+                    compiler.declare_function(signatures[i].name, signatures[i].param_types, signatures[i].return_type);
+                }
+            }
+        }
+};
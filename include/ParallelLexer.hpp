@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <string_view>
+
+#include "Lexer.hpp"
+#include "TokenBuffer.hpp"
+#include "ThreadPool.hpp"
+
+// Lexes a large source in parallel: the source is split into chunks at newlines, the newlines of every
+// chunk are counted to know the line it starts at, then every chunk is lexed into its own token buffer
+// on the pool and the buffers are stitched. The result is identical to Lexer::tokenize() over the
+// whole file, diagnostics of a chunk name the lines of the file too.
+//
+// A newline is always a safe split point because no token can contain one: newlines only ever
+// appear in whitespace runs. Keep it that way when adding tokens (e.g. reject raw newlines in literals).
+class ParallelLexer{
+    public:
+        std::shared_ptr<const SourceBuffer> buffer;
+        size_t min_chunk_size; // below this a chunk isn't worth a task
+
+        ParallelLexer(std::shared_ptr<const SourceBuffer> buffer, size_t threads = std::thread::hardware_concurrency(), size_t min_chunk_size = 256 * 1024)
+            : buffer(buffer), min_chunk_size(min_chunk_size), pool(threads){}
+
+        TokenBuffer tokenize(){
+            std::vector<size_t> bounds = split();
+            size_t chunk_count = bounds.size() - 1;
+
+            if (chunk_count == 1){
+                return Lexer(this->buffer).tokenize();
+            }
+
+            // lex every chunk with its lines counted from the line it starts at
+            std::vector<int> lines = start_lines(bounds);
+            std::vector<std::future<TokenBuffer>> pending;
+            for (size_t i = 0; i < chunk_count; i++){
+                size_t begin = bounds[i];
+                size_t end = bounds[i + 1];
+                int line = lines[i];
+                pending.push_back(this->pool.submit([this, begin, end, line](){
+                    return Lexer(this->buffer, begin, end, line).tokenize();
+                }));
+            }
+
+            std::vector<TokenBuffer> chunks;
+            for (auto& result : pending){
+                chunks.push_back(result.get());
+            }
+
+            return stitch(chunks);
+        }
+
+    private:
+        ThreadPool pool;
+
+        // chunk boundaries: [bounds[i], bounds[i + 1]) is chunk i, every inner bound sits just after a newline
+        std::vector<size_t> split(){
+            std::string_view source = this->buffer->view();
+            size_t chunk_count = std::min(this->pool.size() * 4, source.length() / this->min_chunk_size);
+            if (chunk_count < 2){
+                return {0, source.length()};
+            }
+
+            size_t target = source.length() / chunk_count;
+            std::vector<size_t> bounds = {0};
+            for (size_t i = 1; i < chunk_count; i++){
+                size_t newline = source.find('\n', std::max(bounds.back(), i * target));
+                if (newline == std::string_view::npos){
+                    break;
+                }
+                if (newline + 1 < source.length()){
+                    bounds.push_back(newline + 1);
+                }
+            }
+            bounds.push_back(source.length());
+            return bounds;
+        }
+
+        // the line chunk i starts at, the newlines of the chunks before it are counted on the pool
+        std::vector<int> start_lines(const std::vector<size_t>& bounds){
+            std::string_view source = this->buffer->view();
+            std::vector<std::future<int>> pending;
+            for (size_t i = 0; i + 2 < bounds.size(); i++){
+                size_t begin = bounds[i];
+                size_t end = bounds[i + 1];
+                pending.push_back(this->pool.submit([source, begin, end](){
+                    return int(std::count(source.begin() + begin, source.begin() + end, '\n'));
+                }));
+            }
+
+            std::vector<int> lines = {1};
+            for (auto& result : pending){
+                lines.push_back(lines.back() + result.get());
+            }
+            return lines;
+        }
+
+        TokenBuffer stitch(std::vector<TokenBuffer>& chunks){
+            // every chunk ends with its own EOF token, only the last one is kept
+            std::vector<size_t> starts = {};
+            size_t total = 0;
+            for (size_t i = 0; i < chunks.size(); i++){
+                starts.push_back(total);
+                total += chunks[i].size() - (i + 1 < chunks.size() ? 1 : 0);
+            }
+
+            TokenBuffer tokens = TokenBuffer(this->buffer);
+            tokens.types.resize(total);
+            tokens.offsets.resize(total);
+            tokens.lengths.resize(total);
+            tokens.lines.resize(total);
+            tokens.cols.resize(total);
+
+            // copy the chunks into place in parallel
+            std::vector<std::future<void>> pending;
+            for (size_t i = 0; i < chunks.size(); i++){
+                pending.push_back(this->pool.submit([&, i](){
+                    const TokenBuffer& chunk = chunks[i];
+                    size_t count = chunk.size() - (i + 1 < chunks.size() ? 1 : 0);
+                    size_t start = starts[i];
+                    std::copy_n(chunk.types.begin(), count, tokens.types.begin() + start);
+                    std::copy_n(chunk.offsets.begin(), count, tokens.offsets.begin() + start);
+                    std::copy_n(chunk.lengths.begin(), count, tokens.lengths.begin() + start);
+                    std::copy_n(chunk.lines.begin(), count, tokens.lines.begin() + start);
+                    std::copy_n(chunk.cols.begin(), count, tokens.cols.begin() + start);
+                }));
+            }
+            for (auto& result : pending){
+                result.get();
+            }
+
+            return tokens;
+        }
+};
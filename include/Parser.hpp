@@ -5,9 +5,11 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <array>
 
 #include "Lexer.hpp"
 #include "Token.hpp"
+#include "TokenBuffer.hpp"
 #include "Ast.hpp"
 
 
@@ -25,84 +27,67 @@ enum class PrecedenceType{
     INDEX
 };
 
-// Precedence map
-std::map<TokenType, PrecedenceType> precedence_map = {
-    {TokenType::PLUS, PrecedenceType::SUM},
-    {TokenType::MINUS, PrecedenceType::SUM},
-    {TokenType::ASTERISK, PrecedenceType::PRODUCT},
-    {TokenType::SLASH, PrecedenceType::PRODUCT},
-    {TokenType::POW, PrecedenceType::EXPONENT},
-    {TokenType::MODULUS, PrecedenceType::PRODUCT},
-    
-    {TokenType::EQ_EQ, PrecedenceType::EQUALS},
-    {TokenType::NOT_EQ, PrecedenceType::EQUALS},
-    {TokenType::LT, PrecedenceType::LESSGREATER},
-    {TokenType::GT, PrecedenceType::LESSGREATER},
-    {TokenType::LT_EQ, PrecedenceType::LESSGREATER},
-    {TokenType::GT_EQ, PrecedenceType::LESSGREATER},
-
-    {TokenType::LPAREN, PrecedenceType::CALL},
+// largest count a loop hint takes, e.g. @unroll(1024)
+constexpr int MAX_LOOP_HINT = 1024;
 
-};
+// Precedence of each token type as an infix operator, indexed by TokenType (LOWEST if it isn't one)
+constexpr std::array<PrecedenceType, TOKEN_TYPE_COUNT> PRECEDENCES = [](){
+    std::array<PrecedenceType, TOKEN_TYPE_COUNT> table = {};
+    table.fill(PrecedenceType::LOWEST);
+
+    table[static_cast<size_t>(TokenType::PLUS)] = PrecedenceType::SUM;
+    table[static_cast<size_t>(TokenType::MINUS)] = PrecedenceType::SUM;
+    table[static_cast<size_t>(TokenType::ASTERISK)] = PrecedenceType::PRODUCT;
+    table[static_cast<size_t>(TokenType::SLASH)] = PrecedenceType::PRODUCT;
+    table[static_cast<size_t>(TokenType::POW)] = PrecedenceType::EXPONENT;
+    table[static_cast<size_t>(TokenType::MODULUS)] = PrecedenceType::PRODUCT;
+
+    table[static_cast<size_t>(TokenType::EQ_EQ)] = PrecedenceType::EQUALS;
+    table[static_cast<size_t>(TokenType::NOT_EQ)] = PrecedenceType::EQUALS;
+    table[static_cast<size_t>(TokenType::LT)] = PrecedenceType::LESSGREATER;
+    table[static_cast<size_t>(TokenType::GT)] = PrecedenceType::LESSGREATER;
+    table[static_cast<size_t>(TokenType::LT_EQ)] = PrecedenceType::LESSGREATER;
+    table[static_cast<size_t>(TokenType::GT_EQ)] = PrecedenceType::LESSGREATER;
+
+    table[static_cast<size_t>(TokenType::LPAREN)] = PrecedenceType::CALL;
+    table[static_cast<size_t>(TokenType::LBRACKET)] = PrecedenceType::INDEX;
+
+    return table;
+}();
 
 class Parser{ // Pratt parser
     public:
         Lexer lexer;
+        TokenBuffer tokens; // pre-lexed tokens, walked by index instead of pulling from the lexer
+        size_t token_index = 0; // index of the next token to shift into peek_token
+        bool buffered = false;
         std::vector<std::string> errors = {}; // error messages
+        AstArena* arena = nullptr; // arena of the program being parsed, every node is allocated from it
         Token current_token = Token(TokenType::EOF_, "", 0, 0); // current token
         Token peek_token = Token(TokenType::EOF_, "", 0, 0); // next token
         
 
-        // type alias for prefix parse functions that return an Expression*
-        using prefix_func_expr = std::function<Expression*(Parser*)>;
-
-        // type alias for infix parse functions that return an Expression*
-        using infix_func_expr = std::function<Expression*(Expression*, Parser*)>;
-
-        // map of prefix parse functions
-        std::map<TokenType, prefix_func_expr> prefix_parse_fns = {};
-        
-        
-        // map of infix parse functions
-        std::map<TokenType, infix_func_expr> infix_parse_fns = {};
-
-        // constructor
-        Parser(Lexer lexer) : lexer(lexer){
-            this->next_token();
-            this->next_token();
+        // parse functions are plain function pointers, looked up in tables indexed by token type
+        using prefix_parse_fn = Expression* (*)(Parser*);
+        using infix_parse_fn = Expression* (*)(Expression*, Parser*);
 
-            // prefix parse functions
-            this->prefix_parse_fns[TokenType::INT] = [](Parser* p){ return p->parse_integer_literal(); };
-            this->prefix_parse_fns[TokenType::FLOAT] = [](Parser* p){ return p->parse_float_literal(); };
-            this->prefix_parse_fns[TokenType::LPAREN] = [](Parser* p){ return p->parse_grouped_expression(); };
-            this->prefix_parse_fns[TokenType::IDENT] = [](Parser* p){ return p->parse_identifier(); };
-            
-            //this->prefix_parse_fns[TokenType::IF] = [](Parser* p){ return p->parse_if_statement(); };
-            
-            this->prefix_parse_fns[TokenType::TRUE] = [](Parser* p){ return p->parse_boolean_literal(); };
-            this->prefix_parse_fns[TokenType::FALSE] = [](Parser* p){ return p->parse_boolean_literal(); };
-            
+        static const std::array<prefix_parse_fn, TOKEN_TYPE_COUNT> prefix_parse_fns;
+        static const std::array<infix_parse_fn, TOKEN_TYPE_COUNT> infix_parse_fns;
 
-            // infix parse functions
-            this->infix_parse_fns[TokenType::PLUS] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::MINUS] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::ASTERISK] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::SLASH] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::POW] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::MODULUS] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::EQ_EQ] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::NOT_EQ] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::LT] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::GT] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::LT_EQ] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::GT_EQ] = [](Expression* left, Parser* p){ return p->parse_infix_expression(left); };
-            this->infix_parse_fns[TokenType::LPAREN] = [](Expression* left, Parser* p){ return p->parse_call_expression(left); };
+        // constructor, pulls tokens from the lexer one at a time
+        Parser(Lexer lexer) : lexer(lexer), tokens(lexer.buffer){
+            this->init();
+        }
 
+        // constructor over a pre-lexed token buffer
+        Parser(TokenBuffer tokens) : lexer(tokens.buffer), tokens(std::move(tokens)), buffered(true){
+            this->init();
         }
 
         // parse the program
         Program parse_program(){
             Program program = Program();
+            this->arena = program.arena.get();
 
             while (this->current_token.type != TokenType::EOF_){
                 Statement* stmt = this->parse_statement();
@@ -119,10 +104,38 @@ class Parser{ // Pratt parser
 
     private:
 // --------------------------------------- HELPER FUNCTIONS ---------------------------------------
+        // shared constructor setup: fill current/peek token
+        void init(){
+            this->next_token();
+            this->next_token();
+        }
+
         // advance the current token and peek token
         void next_token(){
             this->current_token = this->peek_token;
-            this->peek_token = this->lexer.next_token();
+            if (this->buffered){
+                this->peek_token = this->tokens.token_at(this->token_index++);
+            } else {
+                this->peek_token = this->lexer.next_token();
+            }
+        }
+
+        // look `distance` tokens past the current one (1 is peek_token)
+        Token peek_ahead(size_t distance){
+            if (distance == 0){
+                return this->current_token;
+            }
+            if (this->buffered){
+                return this->tokens.token_at(this->token_index + distance - 2);
+            }
+
+            // streaming: lex ahead on a copy, the lexer is only a cursor into the shared source
+            Lexer ahead = this->lexer;
+            Token tok = this->peek_token;
+            for (size_t i = 1; i < distance; i++){
+                tok = ahead.next_token();
+            }
+            return tok;
         }
 
         bool peek_token_is(TokenType type){
@@ -144,17 +157,11 @@ class Parser{ // Pratt parser
         }
 
         PrecedenceType current_precedence(){
-            if (precedence_map.find(this->current_token.type) != precedence_map.end()){
-                return precedence_map[this->current_token.type];
-            }
-            return PrecedenceType::LOWEST;
+            return PRECEDENCES[static_cast<size_t>(this->current_token.type)];
         }
 
         PrecedenceType peek_precedence(){
-            if (precedence_map.find(this->peek_token.type) != precedence_map.end()){
-                return precedence_map[this->peek_token.type];
-            }
-            return PrecedenceType::LOWEST;
+            return PRECEDENCES[static_cast<size_t>(this->peek_token.type)];
         }
 
         void peek_error(TokenType type){
@@ -166,6 +173,78 @@ class Parser{ // Pratt parser
             std::string msg = "no prefix parse function for " + token_type_map[type] + " found";
             this->errors.push_back(msg);
         }
+        // parse the type at the current token: a type keyword, [type; N] for a fixed-size array,
+        // [type] for a dynamic one or map[key, value]. Returns the type's name, empty on error.
+        std::string parse_type(){
+            if (this->current_token_is(TokenType::IDENT) && this->current_token.lexeme == "map" && this->peek_token_is(TokenType::LBRACKET)){
+                return this->parse_map_type();
+            }
+            if (this->current_token_is(TokenType::TYPE)){
+                return this->current_token.literal();
+            }
+            if (!this->current_token_is(TokenType::LBRACKET)){
+                this->errors.push_back("expected a type, got " + token_type_map[this->current_token.type] + " instead");
+                return "";
+            }
+
+            // [float; 8] or [float]
+            if (!this->expect_peek(TokenType::TYPE)){
+                return "";
+            }
+            std::string element = this->current_token.literal();
+            if (element != "int" && element != "float"){
+                this->errors.push_back("arrays hold int or float elements, not " + element);
+                return "";
+            }
+
+            std::string name = "[" + element;
+            if (this->peek_token_is(TokenType::SEMICOLON)){
+                this->next_token();
+                if (!this->expect_peek(TokenType::INT)){
+                    return "";
+                }
+                int length = std::stoi(this->current_token.literal());
+                if (length < 1){
+                    this->errors.push_back("array length must be at least 1");
+                    return "";
+                }
+                name += "; " + std::to_string(length);
+            }
+            if (!this->expect_peek(TokenType::RBRACKET)){
+                return "";
+            }
+            return name + "]";
+        }
+
+        // map isn't reserved, so programs can still name a variable or function map: it is a type only
+        // in a type position or, in an expression, when followed by [ and a type keyword (which never
+        // index anything)
+        bool at_map_type(){
+            return this->current_token_is(TokenType::IDENT) && this->current_token.lexeme == "map"
+                && this->peek_token_is(TokenType::LBRACKET) && this->peek_ahead(2).type == TokenType::TYPE;
+        }
+
+        // map[string, int], keys and values are int, float, bool or string
+        std::string parse_map_type(){
+            if (!this->expect_peek(TokenType::LBRACKET) || !this->expect_peek(TokenType::TYPE)){
+                return "";
+            }
+            std::string key = this->current_token.literal();
+            if (!this->expect_peek(TokenType::COMMA) || !this->expect_peek(TokenType::TYPE)){
+                return "";
+            }
+            std::string value = this->current_token.literal();
+            for (const std::string& type : {key, value}){
+                if (type != "int" && type != "float" && type != "bool" && type != "string"){
+                    this->errors.push_back("maps hold int, float, bool or string keys and values, not " + type);
+                    return "";
+                }
+            }
+            if (!this->expect_peek(TokenType::RBRACKET)){
+                return "";
+            }
+            return "map[" + key + ", " + value + "]";
+        }
 // --------------------------------------- PARSING STATEMENTS ---------------------------------------
         // parse a statement
         Statement* parse_statement(){
@@ -189,20 +268,40 @@ class Parser{ // Pratt parser
                 case TokenType::IF:
                     return this->parse_if_statement();
 
+                case TokenType::WHILE:
+                    return this->parse_while_statement({});
+
+                case TokenType::FOR:
+                    return this->parse_for_statement({});
+
+                case TokenType::AT:
+                    return this->parse_hinted_loop();
+
                 default:
                     return this->parse_expression_statement();;
             }
         }
 
-        // parse an expression statement
-        ExpressionStatement* parse_expression_statement(){
+        // parse an expression statement, or an index assignment: a[i] = 5;
+        Statement* parse_expression_statement(){
             Expression* expr = this->parse_expression(PrecedenceType::LOWEST);
 
+            if (expr != nullptr && expr->type_enum() == NodeType::IndexExpression && this->peek_token_is(TokenType::EQ)){
+                this->next_token(); // move to =
+                this->next_token(); // skip =
+
+                // parse expression to the right of the =
+                Expression* right_value = this->parse_expression(PrecedenceType::LOWEST);
+                this->next_token();
+
+                return this->arena->make<IndexAssignStatement>(static_cast<IndexExpression*>(expr), right_value);
+            }
+
             if (this->peek_token_is(TokenType::SEMICOLON)){
                 this->next_token();
             }
 
-            return new ExpressionStatement(expr);
+            return this->arena->make<ExpressionStatement>(expr);
         }
 
         // parse a let statement
@@ -210,7 +309,7 @@ class Parser{ // Pratt parser
             // let x:int = 5;
             //  ^
 
-            LetStatement* stmt = new LetStatement();
+            LetStatement* stmt = this->arena->make<LetStatement>();
 
             // after let expect an identifier
             if (!this->expect_peek(TokenType::IDENT)){
@@ -218,7 +317,7 @@ class Parser{ // Pratt parser
             }
 
             // set the name of the variable
-            stmt->name = new IdentifierLiteral(this->current_token.literal);
+            stmt->name = this->arena->make<IdentifierLiteral>(this->current_token.literal());
 
             // after the identifier expect a colon
             if (!this->expect_peek(TokenType::COLON)){
@@ -226,13 +325,12 @@ class Parser{ // Pratt parser
             }
 
             // after the colon expect a type
-            if (!this->expect_peek(TokenType::TYPE)){
+            this->next_token();
+            stmt->value_type = this->parse_type();
+            if (stmt->value_type.empty()){
                 return nullptr;
             }
 
-            // set the type of the variable
-            stmt->value_type = this->current_token.literal;
-
             // after the type expect an equal sign
             if (!this->expect_peek(TokenType::EQ)){
                 return nullptr;
@@ -252,7 +350,7 @@ class Parser{ // Pratt parser
 
         // parse a function statement
         FunctionStatement* parse_function_statement(){
-            FunctionStatement* smt = new FunctionStatement();
+            FunctionStatement* smt = this->arena->make<FunctionStatement>();
 
             // def add() -> int { return 10; }
             //  ^
@@ -263,7 +361,7 @@ class Parser{ // Pratt parser
             }
 
             // set the name of the function
-            smt->name = new IdentifierLiteral(this->current_token.literal);
+            smt->name = this->arena->make<IdentifierLiteral>(this->current_token.literal());
 
             // after the identifier expect a left parenthesis
             if (!this->expect_peek(TokenType::LPAREN)){
@@ -279,13 +377,12 @@ class Parser{ // Pratt parser
             }
 
             // after the arrow expect a type
-            if (!this->expect_peek(TokenType::TYPE)){
+            this->next_token();
+            smt->return_type = this->parse_type();
+            if (smt->return_type.empty()){
                 return nullptr;
             }
 
-            // set the return type
-            smt->return_type = this->current_token.literal;
-
             // after the type expect a left brace
             if (!this->expect_peek(TokenType::LBRACE)){
                 return nullptr;
@@ -314,7 +411,7 @@ class Parser{ // Pratt parser
             // skip the left parenthesis
             this->next_token();
 
-            FunctionParameter* first_param = new FunctionParameter(this->current_token.literal);
+            FunctionParameter* first_param = this->arena->make<FunctionParameter>(this->current_token.literal());
 
             // expect a colon after parameter name
             if (!this->expect_peek(TokenType::COLON)){
@@ -322,12 +419,11 @@ class Parser{ // Pratt parser
             }
 
             // expect a type after colon
-            if (!this->expect_peek(TokenType::TYPE)){
+            this->next_token();
+            first_param->value_type = this->parse_type();
+            if (first_param->value_type.empty()){
                 return {nullptr};
             }
-
-            // set the type of the parameter
-            first_param->value_type = this->current_token.literal;
             params.push_back(first_param);
 
             // parse the rest of the parameters if any
@@ -335,16 +431,16 @@ class Parser{ // Pratt parser
                 this->next_token();
                 this->next_token();
                 
-                FunctionParameter* param = new FunctionParameter(this->current_token.literal);
+                FunctionParameter* param = this->arena->make<FunctionParameter>(this->current_token.literal());
                 if (!this->expect_peek(TokenType::COLON)){
                     return {nullptr};
                 }
 
-                if (!this->expect_peek(TokenType::TYPE)){
+                this->next_token();
+                param->value_type = this->parse_type();
+                if (param->value_type.empty()){
                     return {nullptr};
                 }
-
-                param->value_type = this->current_token.literal;
                 params.push_back(param);
                 
             }
@@ -358,7 +454,7 @@ class Parser{ // Pratt parser
 
         // parse a return statement
         ReturnStatement* parse_return_statement(){
-            ReturnStatement* stmt = new ReturnStatement();
+            ReturnStatement* stmt = this->arena->make<ReturnStatement>();
 
             this->next_token(); // skip return token
 
@@ -375,7 +471,7 @@ class Parser{ // Pratt parser
         // parse a block statement
         BlockStatement* parse_block_statement(){ // inside { }
             
-            BlockStatement* block = new BlockStatement();
+            BlockStatement* block = this->arena->make<BlockStatement>();
             this->next_token(); // skip left brace
 
             // parse all the statements inside the block
@@ -392,9 +488,9 @@ class Parser{ // Pratt parser
 
         // parse an assignment statement
         AssignStatement* parse_assignment_statement(){
-            AssignStatement* stmt = new AssignStatement();
+            AssignStatement* stmt = this->arena->make<AssignStatement>();
 
-            stmt->ident = new IdentifierLiteral(this->current_token.literal);
+            stmt->ident = this->arena->make<IdentifierLiteral>(this->current_token.literal());
 
             this->next_token(); // skip ident token
             this->next_token(); // skip =
@@ -444,17 +540,125 @@ class Parser{ // Pratt parser
                 alternative = parse_block_statement();
             }
 
-            return new IfStatement(condition, concequence, alternative);
+            return this->arena->make<IfStatement>(condition, concequence, alternative);
 
         }
 
+        WhileStatement* parse_while_statement(LoopHints hints){
+
+            // while x < 10 do { x = x + 1; }
+            //  ^
+
+            // move past while token
+            next_token();
+
+            // parse the condition
+            Expression* condition = parse_expression(PrecedenceType::LOWEST);
+
+            if (!this->expect_peek(TokenType::DO)){
+                return nullptr;
+            }
+            if (!this->expect_peek(TokenType::LBRACE)){
+                return nullptr;
+            }
+
+            BlockStatement* body = parse_block_statement();
+            return this->arena->make<WhileStatement>(condition, body, hints);
+        }
+
+        ForStatement* parse_for_statement(LoopHints hints){
+
+            // for i in 0..10 do { x = x + i; }
+            //  ^
+
+            if (!this->expect_peek(TokenType::IDENT)){
+                return nullptr;
+            }
+            IdentifierLiteral* variable = this->arena->make<IdentifierLiteral>(this->current_token.literal());
+
+            if (!this->expect_peek(TokenType::IN)){
+                return nullptr;
+            }
+            next_token();
+
+            // parse the range
+            Expression* start = parse_expression(PrecedenceType::LOWEST);
+            if (!this->expect_peek(TokenType::DOT_DOT)){
+                return nullptr;
+            }
+            next_token();
+            Expression* end = parse_expression(PrecedenceType::LOWEST);
+
+            if (!this->expect_peek(TokenType::DO)){
+                return nullptr;
+            }
+            if (!this->expect_peek(TokenType::LBRACE)){
+                return nullptr;
+            }
+
+            BlockStatement* body = parse_block_statement();
+            return this->arena->make<ForStatement>(variable, start, end, body, hints);
+        }
+
+        // loop hints, then the loop they apply to
+        Statement* parse_hinted_loop(){
+
+            // @unroll(4) @vectorize for i in 0..n do { ... }
+            // ^
+
+            LoopHints hints;
+            while (this->current_token_is(TokenType::AT)){
+                if (!this->expect_peek(TokenType::IDENT)){
+                    return nullptr;
+                }
+                std::string name = this->current_token.literal();
+
+                // an optional count, @unroll(4)
+                int count = 0;
+                if (this->peek_token_is(TokenType::LPAREN)){
+                    next_token();
+                    if (!this->expect_peek(TokenType::INT)){
+                        return nullptr;
+                    }
+                    count = std::stoi(this->current_token.literal());
+                    if (count < 1 || count > MAX_LOOP_HINT){
+                        this->errors.push_back("loop hint @" + name + " needs a count between 1 and " + std::to_string(MAX_LOOP_HINT));
+                        return nullptr;
+                    }
+                    if (!this->expect_peek(TokenType::RPAREN)){
+                        return nullptr;
+                    }
+                }
+
+                if (name == "unroll"){
+                    hints.unroll = count;
+                } else if (name == "vectorize"){
+                    hints.vectorize = count;
+                } else {
+                    this->errors.push_back("unknown loop hint @" + name);
+                    return nullptr;
+                }
+                next_token();
+            }
+
+            switch (this->current_token.type){
+                case TokenType::WHILE:
+                    return this->parse_while_statement(hints);
+                case TokenType::FOR:
+                    return this->parse_for_statement(hints);
+                default:
+                    this->errors.push_back("expected a loop after loop hints, got " + token_type_map[this->current_token.type] + " instead");
+                    return nullptr;
+            }
+        }
+
 // --------------------------------------- PARSING EXPRESSIONS ---------------------------------------
 
         // parse an expression
         Expression* parse_expression(PrecedenceType precedence){
 
             // get the prefix parse function for the current token
-            auto prefix = this->prefix_parse_fns[this->current_token.type];
+            prefix_parse_fn prefix = prefix_parse_fns[static_cast<size_t>(this->current_token.type)];
             
             if (prefix == nullptr){
                 this->no_prefix_parse_fn_error(this->current_token.type);
@@ -469,7 +673,7 @@ class Parser{ // Pratt parser
             while (!this->peek_token_is(TokenType::SEMICOLON) && precedence < this->peek_precedence()){
 
                 // get the infix parse function for the peek token
-                auto infix = this->infix_parse_fns[this->peek_token.type];
+                infix_parse_fn infix = infix_parse_fns[static_cast<size_t>(this->peek_token.type)];
                 
                 if (infix == nullptr){
                     return left_exp;
@@ -486,7 +690,7 @@ class Parser{ // Pratt parser
         // parse an infix expression
         Expression* parse_infix_expression(Expression* left){
 
-            InfixExpression* infix_expr = new InfixExpression(left, this->current_token.literal);
+            InfixExpression* infix_expr = this->arena->make<InfixExpression>(left, this->current_token.literal());
             auto precedence = this->current_precedence();
             this->next_token();
 
@@ -514,13 +718,28 @@ class Parser{ // Pratt parser
 
         // parse a call expression
         CallExpression* parse_call_expression(Expression* function){
-            CallExpression* call_expr = new CallExpression(static_cast<IdentifierLiteral*>(function));
+            CallExpression* call_expr = this->arena->make<CallExpression>(static_cast<IdentifierLiteral*>(function));
             call_expr->arguments = parse_expression_list(TokenType::RPAREN);
 
             return call_expr;
 
         }
 
+        // parse an index expression
+        Expression* parse_index_expression(Expression* array){
+
+            // skip the left bracket
+            this->next_token();
+
+            Expression* index = this->parse_expression(PrecedenceType::LOWEST);
+
+            if (!this->expect_peek(TokenType::RBRACKET)){
+                return nullptr;
+            }
+
+            return this->arena->make<IndexExpression>(array, index);
+        }
+
         // parse an expression list
         std::vector<Expression*> parse_expression_list(TokenType end){
             std::vector<Expression*> expr_list = {};
@@ -550,26 +769,152 @@ class Parser{ // Pratt parser
 
         // parse an identifier
         Expression* parse_identifier(){
-            return new IdentifierLiteral(this->current_token.literal);
+            if (this->at_map_type()){
+                return this->parse_type_constructor();
+            }
+            return this->arena->make<IdentifierLiteral>(this->current_token.literal());
         }
 
         // parse an integer literal
         Expression* parse_integer_literal(){
-            int value = std::stoi(this->current_token.literal);
-            return new IntegerLiteral(value);
+            int value = std::stoi(this->current_token.literal());
+            return this->arena->make<IntegerLiteral>(value);
         }
 
         // parse a float literal
         Expression* parse_float_literal(){
-            float value = std::stof(this->current_token.literal);
-            return new FloatLiteral(value);
+            float value = std::stof(this->current_token.literal());
+            return this->arena->make<FloatLiteral>(value);
         }
 
         BooleanLiteral* parse_boolean_literal(){
             bool value = current_token_is(TokenType::TRUE);
-            return new BooleanLiteral(value);
+            return this->arena->make<BooleanLiteral>(value);
+        }
+
+        // parse a string literal, resolving the escapes \n, \t, \r, \0, \" and \\ in it
+        Expression* parse_string_literal(){
+            std::string_view text = this->current_token.lexeme;
+            std::string value;
+            value.reserve(text.size());
+            for (size_t i = 0; i < text.size(); i++){
+                if (text[i] != '\\'){
+                    value += text[i];
+                    continue;
+                }
+                switch (text[++i]){
+                    case 'n': value += '\n'; break;
+                    case 't': value += '\t'; break;
+                    case 'r': value += '\r'; break;
+                    case '0': value += '\0'; break;
+                    case '"': value += '"'; break;
+                    case '\\': value += '\\'; break;
+                    default:
+                        this->errors.push_back(std::string("unknown escape sequence \\") + text[i] + " in a string literal");
+                        return nullptr;
+                }
+            }
+            return this->arena->make<StringLiteral>(std::move(value));
+        }
+
+        // parse a type used as a constructor, vec4f(1.0, 2.0, 3.0, 4.0) or map[string, int](): the call is
+        // made by the infix parser on the ( that has to follow, with the type's name as the function
+        Expression* parse_type_constructor(){
+            std::string name = this->current_token.literal();
+            if (name == "map" && this->peek_token_is(TokenType::LBRACKET)){
+                name = this->parse_type();
+                if (name.empty()){
+                    return nullptr;
+                }
+            }
+            if (!this->peek_token_is(TokenType::LPAREN)){
+                this->errors.push_back("a type can only be used in an expression to construct a value, e.g. " + name + "(...)");
+                return nullptr;
+            }
+            return this->arena->make<IdentifierLiteral>(name);
+        }
+
+        // parse an array literal, [1.0, 2.0, 3.0] or [0.0; 8]
+        Expression* parse_array_literal(){
+            if (this->peek_token_is(TokenType::RBRACKET)){
+                this->errors.push_back("an array literal needs at least one element");
+                return nullptr;
+            }
+
+            // skip the left bracket
+            this->next_token();
+            Expression* first = this->parse_expression(PrecedenceType::LOWEST);
+
+            // one element repeated
+            if (this->peek_token_is(TokenType::SEMICOLON)){
+                this->next_token();
+                if (!this->expect_peek(TokenType::INT)){
+                    return nullptr;
+                }
+                int repeat = std::stoi(this->current_token.literal());
+                if (repeat < 1){
+                    this->errors.push_back("array length must be at least 1");
+                    return nullptr;
+                }
+                if (!this->expect_peek(TokenType::RBRACKET)){
+                    return nullptr;
+                }
+                return this->arena->make<ArrayLiteral>(std::vector<Expression*>{first}, repeat);
+            }
+
+            std::vector<Expression*> elements = {first};
+            while (this->peek_token_is(TokenType::COMMA)){
+                this->next_token();
+                this->next_token();
+                elements.push_back(this->parse_expression(PrecedenceType::LOWEST));
+            }
+
+            if (!this->expect_peek(TokenType::RBRACKET)){
+                return nullptr;
+            }
+
+            return this->arena->make<ArrayLiteral>(elements);
         }
 
 
 
-};
\ No newline at end of file
+};
+
+// prefix parse functions, indexed by the token type that starts the expression
+constexpr std::array<Parser::prefix_parse_fn, TOKEN_TYPE_COUNT> Parser::prefix_parse_fns = [](){
+    std::array<prefix_parse_fn, TOKEN_TYPE_COUNT> fns = {};
+
+    fns[static_cast<size_t>(TokenType::INT)] = [](Parser* p) -> Expression* { return p->parse_integer_literal(); };
+    fns[static_cast<size_t>(TokenType::FLOAT)] = [](Parser* p) -> Expression* { return p->parse_float_literal(); };
+    fns[static_cast<size_t>(TokenType::STRING)] = [](Parser* p) -> Expression* { return p->parse_string_literal(); };
+    fns[static_cast<size_t>(TokenType::LPAREN)] = [](Parser* p) -> Expression* { return p->parse_grouped_expression(); };
+    fns[static_cast<size_t>(TokenType::IDENT)] = [](Parser* p) -> Expression* { return p->parse_identifier(); };
+    fns[static_cast<size_t>(TokenType::TYPE)] = [](Parser* p) -> Expression* { return p->parse_type_constructor(); };
+    fns[static_cast<size_t>(TokenType::TRUE)] = [](Parser* p) -> Expression* { return p->parse_boolean_literal(); };
+    fns[static_cast<size_t>(TokenType::FALSE)] = [](Parser* p) -> Expression* { return p->parse_boolean_literal(); };
+    fns[static_cast<size_t>(TokenType::LBRACKET)] = [](Parser* p) -> Expression* { return p->parse_array_literal(); };
+
+    return fns;
+}();
+
+// infix parse functions, indexed by the operator token type
+constexpr std::array<Parser::infix_parse_fn, TOKEN_TYPE_COUNT> Parser::infix_parse_fns = [](){
+    std::array<infix_parse_fn, TOKEN_TYPE_COUNT> fns = {};
+
+    fns[static_cast<size_t>(TokenType::PLUS)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::MINUS)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::ASTERISK)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::SLASH)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::POW)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::MODULUS)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::EQ_EQ)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::NOT_EQ)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::LT)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::GT)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::LT_EQ)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::GT_EQ)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_infix_expression(left); };
+    fns[static_cast<size_t>(TokenType::LPAREN)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_call_expression(left); };
+    fns[static_cast<size_t>(TokenType::LBRACKET)] = [](Expression* left, Parser* p) -> Expression* { return p->parse_index_expression(left); };
+
+    return fns;
+}();
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ligma_runtime.h"
+
+// static library of the runtime, for linking AOT executables; the build passes its path
+#ifndef LIGMA_RUNTIME_LIBRARY
+#define LIGMA_RUNTIME_LIBRARY "libligma_runtime.a"
+#endif
+
+// The runtime library (runtime/) as seen by the compiler: the compiler links it in, so a JIT session
+// can bind the runtime symbols to their addresses in this process, and AOT executables link the
+// static library.
+class Runtime{
+    public:
+        // every runtime function compiled code may call, by symbol name
+        static std::vector<std::pair<const char*, void*>> symbols(){
+            return {
+                {"ligma_alloc", reinterpret_cast<void*>(&ligma_alloc)},
+                {"ligma_free", reinterpret_cast<void*>(&ligma_free)},
+                {"ligma_region_enter", reinterpret_cast<void*>(&ligma_region_enter)},
+                {"ligma_region_alloc", reinterpret_cast<void*>(&ligma_region_alloc)},
+                {"ligma_region_leave", reinterpret_cast<void*>(&ligma_region_leave)},
+                {"ligma_counters", reinterpret_cast<void*>(&ligma_counters)},
+                {"ligma_string_concat", reinterpret_cast<void*>(&ligma_string_concat)},
+                {"ligma_string_slice", reinterpret_cast<void*>(&ligma_string_slice)},
+                {"ligma_string_length", reinterpret_cast<void*>(&ligma_string_length)},
+                {"ligma_string_equal", reinterpret_cast<void*>(&ligma_string_equal)},
+                {"ligma_string_compare", reinterpret_cast<void*>(&ligma_string_compare)},
+                {"ligma_string_retain", reinterpret_cast<void*>(&ligma_string_retain)},
+                {"ligma_string_release", reinterpret_cast<void*>(&ligma_string_release)},
+                {"ligma_map_new", reinterpret_cast<void*>(&ligma_map_new)},
+                {"ligma_map_free", reinterpret_cast<void*>(&ligma_map_free)},
+                {"ligma_map_size", reinterpret_cast<void*>(&ligma_map_size)},
+                {"ligma_map_find_word", reinterpret_cast<void*>(&ligma_map_find_word)},
+                {"ligma_map_find_string", reinterpret_cast<void*>(&ligma_map_find_string)},
+                {"ligma_map_insert_word", reinterpret_cast<void*>(&ligma_map_insert_word)},
+                {"ligma_map_insert_string", reinterpret_cast<void*>(&ligma_map_insert_string)},
+                {"ligma_map_remove_word", reinterpret_cast<void*>(&ligma_map_remove_word)},
+                {"ligma_map_remove_string", reinterpret_cast<void*>(&ligma_map_remove_string)},
+            };
+        }
+
+        // the allocation counters of the calling thread, the one a JIT session ran main on
+        static void print_counters(std::ostream& out){
+            const ligma_alloc_counters* counters = ligma_counters();
+            out << "runtime: " << counters->allocations << " allocations, " << counters->frees << " frees, "
+                << counters->region_allocations << " region allocations (" << counters->region_bytes << " bytes), "
+                << counters->system_allocations << " system allocations" << '\n';
+        }
+
+        // path of the static library, $LIGMA_RUNTIME overrides the one the compiler was built with
+        static std::string library_path(){
+            const char* path = std::getenv("LIGMA_RUNTIME");
+            return path && *path ? path : LIGMA_RUNTIME_LIBRARY;
+        }
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LIGMA_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Byte-run scanners used by the Lexer. Each returns the position of the first byte at or after `pos`
+// that does not belong to the run (or `end`). The SSE2/AVX2 paths classify 16/32 bytes per step,
+// the path is picked once at runtime from the CPU features.
+
+enum class ScanPath{
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+// ---------------------------------------------- SCALAR ----------------------------------------------
+
+bool is_whitespace_char(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_ident_char(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool is_digit_char(char c){
+    return c >= '0' && c <= '9';
+}
+
+size_t scan_whitespace_scalar(const char* data, size_t pos, size_t end, int& newlines){
+    while (pos < end && is_whitespace_char(data[pos])){
+        newlines += data[pos] == '\n';
+        pos++;
+    }
+    return pos;
+}
+
+size_t scan_ident_scalar(const char* data, size_t pos, size_t end){
+    while (pos < end && is_ident_char(data[pos])){
+        pos++;
+    }
+    return pos;
+}
+
+size_t scan_digits_scalar(const char* data, size_t pos, size_t end){
+    while (pos < end && is_digit_char(data[pos])){
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef LIGMA_SCAN_X86
+// ---------------------------------------------- SSE2 ----------------------------------------------
+
+// lanes where lo <= c <= hi (unsigned), SSE2 only has signed compares so both sides are biased by 0x80
+__m128i sse2_in_range(__m128i c, char lo, char hi){
+    const __m128i bias = _mm_set1_epi8(char(0x80));
+    __m128i shifted = _mm_add_epi8(_mm_sub_epi8(c, _mm_set1_epi8(lo)), bias);
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(char(0x80 + (hi - lo) + 1)));
+}
+
+__m128i sse2_ident_mask(__m128i c){
+    __m128i letters = sse2_in_range(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digits = sse2_in_range(c, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(c, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letters, digits), underscore);
+}
+
+size_t scan_whitespace_sse2(const char* data, size_t pos, size_t end, int& newlines){
+    while (pos + 16 <= end){
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i nl = _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))),
+            _mm_or_si128(nl, _mm_cmpeq_epi8(c, _mm_set1_epi8('\r')))
+        );
+        uint32_t ws_bits = uint32_t(_mm_movemask_epi8(ws));
+        uint32_t nl_bits = uint32_t(_mm_movemask_epi8(nl));
+
+        if (ws_bits != 0xFFFF){
+            // only count the newlines before the first non-whitespace byte
+            int stop = __builtin_ctz(~ws_bits);
+            newlines += __builtin_popcount(nl_bits & ((1u << stop) - 1));
+            return pos + stop;
+        }
+        newlines += __builtin_popcount(nl_bits);
+        pos += 16;
+    }
+    return scan_whitespace_scalar(data, pos, end, newlines);
+}
+
+size_t scan_ident_sse2(const char* data, size_t pos, size_t end){
+    while (pos + 16 <= end){
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t bits = uint32_t(_mm_movemask_epi8(sse2_ident_mask(c)));
+        if (bits != 0xFFFF){
+            return pos + __builtin_ctz(~bits);
+        }
+        pos += 16;
+    }
+    return scan_ident_scalar(data, pos, end);
+}
+
+size_t scan_digits_sse2(const char* data, size_t pos, size_t end){
+    while (pos + 16 <= end){
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t bits = uint32_t(_mm_movemask_epi8(sse2_in_range(c, '0', '9')));
+        if (bits != 0xFFFF){
+            return pos + __builtin_ctz(~bits);
+        }
+        pos += 16;
+    }
+    return scan_digits_scalar(data, pos, end);
+}
+
+// ---------------------------------------------- AVX2 ----------------------------------------------
+
+__attribute__((target("avx2"))) __m256i avx2_in_range(__m256i c, char lo, char hi){
+    const __m256i bias = _mm256_set1_epi8(char(0x80));
+    __m256i shifted = _mm256_add_epi8(_mm256_sub_epi8(c, _mm256_set1_epi8(lo)), bias);
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(char(0x80 + (hi - lo) + 1)), shifted);
+}
+
+__attribute__((target("avx2"))) size_t scan_whitespace_avx2(const char* data, size_t pos, size_t end, int& newlines){
+    while (pos + 32 <= end){
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i nl = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(nl, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r')))
+        );
+        uint32_t ws_bits = uint32_t(_mm256_movemask_epi8(ws));
+        uint32_t nl_bits = uint32_t(_mm256_movemask_epi8(nl));
+
+        if (ws_bits != 0xFFFFFFFFu){
+            int stop = __builtin_ctz(~ws_bits);
+            newlines += __builtin_popcount(nl_bits & ((1u << stop) - 1));
+            return pos + stop;
+        }
+        newlines += __builtin_popcount(nl_bits);
+        pos += 32;
+    }
+    return scan_whitespace_sse2(data, pos, end, newlines);
+}
+
+__attribute__((target("avx2"))) size_t scan_ident_avx2(const char* data, size_t pos, size_t end){
+    while (pos + 32 <= end){
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i letters = avx2_in_range(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digits = avx2_in_range(c, '0', '9');
+        __m256i underscore = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'));
+        uint32_t bits = uint32_t(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letters, digits), underscore)));
+        if (bits != 0xFFFFFFFFu){
+            return pos + __builtin_ctz(~bits);
+        }
+        pos += 32;
+    }
+    return scan_ident_sse2(data, pos, end);
+}
+
+__attribute__((target("avx2"))) size_t scan_digits_avx2(const char* data, size_t pos, size_t end){
+    while (pos + 32 <= end){
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        uint32_t bits = uint32_t(_mm256_movemask_epi8(avx2_in_range(c, '0', '9')));
+        if (bits != 0xFFFFFFFFu){
+            return pos + __builtin_ctz(~bits);
+        }
+        pos += 32;
+    }
+    return scan_digits_sse2(data, pos, end);
+}
+#endif
+
+// ---------------------------------------------- DISPATCH ----------------------------------------------
+
+struct ScanFunctions{
+    ScanPath path;
+    size_t (*whitespace)(const char*, size_t, size_t, int&);
+    size_t (*ident)(const char*, size_t, size_t);
+    size_t (*digits)(const char*, size_t, size_t);
+};
+
+ScanFunctions scan_functions_for(ScanPath path){
+#ifdef LIGMA_SCAN_X86
+    switch (path){
+        case ScanPath::AVX2:
+            return {ScanPath::AVX2, scan_whitespace_avx2, scan_ident_avx2, scan_digits_avx2};
+        case ScanPath::SSE2:
+            return {ScanPath::SSE2, scan_whitespace_sse2, scan_ident_sse2, scan_digits_sse2};
+        default:
+            break;
+    }
+#endif
+    return {ScanPath::SCALAR, scan_whitespace_scalar, scan_ident_scalar, scan_digits_scalar};
+}
+
+// best path the CPU supports
+ScanPath detect_scan_path(){
+#ifdef LIGMA_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        return ScanPath::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")){
+        return ScanPath::SSE2;
+    }
+#endif
+    return ScanPath::SCALAR;
+}
+
+ScanFunctions& scan_functions(){
+    static ScanFunctions functions = scan_functions_for(detect_scan_path());
+    return functions;
+}
+
+// force a scan path (e.g. to compare against the scalar one), a path the CPU lacks falls back to detection
+void set_scan_path(ScanPath path){
+    if (path > detect_scan_path()){
+        path = detect_scan_path();
+    }
+    scan_functions() = scan_functions_for(path);
+}
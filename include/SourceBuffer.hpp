@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// SourceBuffer owns the bytes of a source file, either read-only memory mapped or held in a string.
+// Tokens view into it, so it is shared between every Lexer (and token buffer) created over it.
+class SourceBuffer{
+    public:
+        std::string path;
+
+        // wrap an in-memory source
+        static std::shared_ptr<SourceBuffer> from_string(std::string source, std::string path = ""){
+            auto buffer = std::shared_ptr<SourceBuffer>(new SourceBuffer());
+            buffer->owned = std::move(source);
+            buffer->data = buffer->owned.data();
+            buffer->size = buffer->owned.size();
+            buffer->path = path;
+            return buffer;
+        }
+
+        // memory map a file, returns nullptr if the file can't be opened or mapped
+        static std::shared_ptr<SourceBuffer> map_file(std::string path){
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0){
+                return nullptr;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0){
+                close(fd);
+                return nullptr;
+            }
+
+            auto buffer = std::shared_ptr<SourceBuffer>(new SourceBuffer());
+            buffer->path = path;
+
+            // mmap refuses empty mappings, an empty file is just an empty view
+            if (st.st_size > 0){
+                void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED){
+                    close(fd);
+                    return nullptr;
+                }
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                buffer->data = static_cast<const char*>(addr);
+                buffer->size = st.st_size;
+                buffer->mapped = true;
+            }
+
+            close(fd);
+            return buffer;
+        }
+
+        std::string_view view() const {
+            return std::string_view(this->data, this->size);
+        }
+
+        bool is_mapped() const {
+            return this->mapped;
+        }
+
+        SourceBuffer(const SourceBuffer&) = delete;
+        SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+        ~SourceBuffer(){
+            if (this->mapped){
+                munmap(const_cast<char*>(this->data), this->size);
+            }
+        }
+
+    private:
+        const char* data = "";
+        size_t size = 0;
+        bool mapped = false;
+        std::string owned = "";
+
+        SourceBuffer(){}
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Fixed-size pool of worker threads, tasks are run in submission order
+class ThreadPool{
+    public:
+        ThreadPool(size_t threads = std::thread::hardware_concurrency()){
+            if (threads == 0){
+                threads = 1;
+            }
+            for (size_t i = 0; i < threads; i++){
+                this->workers.emplace_back([this](){ this->work(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->ready.notify_all();
+            for (std::thread& worker : this->workers){
+                worker.join();
+            }
+        }
+
+        size_t size() const {
+            return this->workers.size();
+        }
+
+        // queue a task, the future yields its result (or rethrows its exception)
+        template <typename F>
+        auto submit(F task) -> std::future<decltype(task())>{
+            using Result = decltype(task());
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+            std::future<Result> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->tasks.push([packaged](){ (*packaged)(); });
+            }
+            this->ready.notify_one();
+            return result;
+        }
+
+    private:
+        std::vector<std::thread> workers = {};
+        std::queue<std::function<void()>> tasks = {};
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool stopping = false;
+
+        void work(){
+            while (true){
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->ready.wait(lock, [this](){ return this->stopping || !this->tasks.empty(); });
+                    if (this->stopping && this->tasks.empty()){
+                        return;
+                    }
+                    task = std::move(this->tasks.front());
+                    this->tasks.pop();
+                }
+                task();
+            }
+        }
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <map>
+#include <array>
+#include <cstdint>
 #include <glaze/glaze.hpp>
 
 // Token types
@@ -13,6 +16,7 @@ enum class TokenType{
     IDENT,
     INT,
     FLOAT,
+    STRING,
 
     // Arithmetic operators
     PLUS,
@@ -42,6 +46,10 @@ enum class TokenType{
     ARROW,
     LBRACE,
     RBRACE,
+    LBRACKET,
+    RBRACKET,
+    DOT_DOT,
+    AT,
 
     // Keywords
     LET,
@@ -52,14 +60,19 @@ enum class TokenType{
     ELSE,
     TRUE,
     FALSE,
+    WHILE,
+    FOR,
+    IN,
 
     // Typing
-    TYPE
-
-
+    TYPE,
 
+    // number of token types, keep last
+    COUNT_
 };
 
+constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::COUNT_);
+
 // map token type to string
 std::map<TokenType, std::string> token_type_map = {
     {TokenType::EOF_, "EOF"},
@@ -68,6 +81,7 @@ std::map<TokenType, std::string> token_type_map = {
     {TokenType::IDENT, "IDENT"},
     {TokenType::INT, "INT"},
     {TokenType::FLOAT, "FLOAT"},
+    {TokenType::STRING, "STRING"},
     {TokenType::PLUS, "PLUS"},
     {TokenType::MINUS, "MINUS"},
     {TokenType::ASTERISK, "ASTERISK"},
@@ -93,6 +107,10 @@ std::map<TokenType, std::string> token_type_map = {
     {TokenType::ARROW, "ARROW"},
     {TokenType::LBRACE, "LBRACE"},
     {TokenType::RBRACE, "RBRACE"},
+    {TokenType::LBRACKET, "LBRACKET"},
+    {TokenType::RBRACKET, "RBRACKET"},
+    {TokenType::DOT_DOT, "DOT_DOT"},
+    {TokenType::AT, "AT"},
     
     {TokenType::LET, "LET"},
     {TokenType::DEF, "DEF"},
@@ -102,13 +120,21 @@ std::map<TokenType, std::string> token_type_map = {
     {TokenType::ELSE, "ELSE"},
     {TokenType::TRUE, "TRUE"},
     {TokenType::FALSE, "FALSE"},
+    {TokenType::WHILE, "WHILE"},
+    {TokenType::FOR, "FOR"},
+    {TokenType::IN, "IN"},
 
 
     {TokenType::TYPE, "TYPE"}
 };
 
-// Reserved keywords
-std::map<std::string, TokenType> KEYWORDS = {
+// Reserved words: keywords and type keywords
+struct ReservedWord{
+    std::string_view word;
+    TokenType type;
+};
+
+constexpr ReservedWord RESERVED_WORDS[] = {
     {"let", TokenType::LET},
     {"def", TokenType::DEF},
     {"return", TokenType::RETURN},
@@ -116,46 +142,118 @@ std::map<std::string, TokenType> KEYWORDS = {
     {"do", TokenType::DO},
     {"else", TokenType::ELSE},
     {"true", TokenType::TRUE},
-    {"false", TokenType::FALSE}
-};
+    {"false", TokenType::FALSE},
+    {"while", TokenType::WHILE},
+    {"for", TokenType::FOR},
+    {"in", TokenType::IN},
 
-// Reserved type keywords
-std::vector<std::string> TYPE_KEYWORDS = {
-    "int",
-    "float",
-    "bool"
+    // type keywords
+    {"int", TokenType::TYPE},
+    {"float", TokenType::TYPE},
+    {"bool", TokenType::TYPE},
+    {"string", TokenType::TYPE},
+    {"vec4f", TokenType::TYPE},
+    {"vec8f", TokenType::TYPE},
+    {"vec4i", TokenType::TYPE},
+    {"vec8i", TokenType::TYPE}
+    // map is a contextual type keyword, lexed as an identifier (see Parser::at_map_type)
 };
 
+constexpr size_t RESERVED_WORD_COUNT = sizeof(RESERVED_WORDS) / sizeof(RESERVED_WORDS[0]);
+constexpr size_t RESERVED_TABLE_BITS = 6;
+constexpr size_t RESERVED_TABLE_SIZE = size_t(1) << RESERVED_TABLE_BITS;
+
+// bounds on reserved word length, anything outside can't be reserved
+constexpr size_t RESERVED_MIN_LENGTH = [](){
+    size_t min = RESERVED_WORDS[0].word.size();
+    for (const ReservedWord& r : RESERVED_WORDS){
+        min = r.word.size() < min ? r.word.size() : min;
+    }
+    return min;
+}();
+
+constexpr size_t RESERVED_MAX_LENGTH = [](){
+    size_t max = 0;
+    for (const ReservedWord& r : RESERVED_WORDS){
+        max = r.word.size() > max ? r.word.size() : max;
+    }
+    return max;
+}();
+
+// multiplicative hash over length, first and last two characters (vec4f and vec8f only differ in
+// the one before last), every reserved word has at least two
+constexpr uint32_t reserved_hash(std::string_view word, uint32_t seed){
+    uint32_t key = uint32_t(uint8_t(word.front())) | uint32_t(uint8_t(word.back())) << 8
+        | uint32_t(uint8_t(word[word.size() - 2])) << 16 | uint32_t(word.size()) << 24;
+    return (key * seed) >> (32 - RESERVED_TABLE_BITS);
+}
+
+// search for a seed that maps every reserved word to its own slot
+constexpr uint32_t find_reserved_seed(){
+    for (uint32_t seed = 0x9E3779B1u; seed != 0x9E3779B1u + 2 * 100000; seed += 2){
+        bool used[RESERVED_TABLE_SIZE] = {};
+        bool perfect = true;
+        for (const ReservedWord& r : RESERVED_WORDS){
+            uint32_t slot = reserved_hash(r.word, seed);
+            if (used[slot]){
+                perfect = false;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (perfect){
+            return seed;
+        }
+    }
+    return 0;
+}
+
+constexpr uint32_t RESERVED_SEED = find_reserved_seed();
+static_assert(RESERVED_SEED != 0, "no perfect hash seed found for the reserved words, grow RESERVED_TABLE_BITS");
+
+// slot -> index into RESERVED_WORDS + 1, 0 marks an empty slot
+constexpr std::array<uint8_t, RESERVED_TABLE_SIZE> RESERVED_TABLE = [](){
+    std::array<uint8_t, RESERVED_TABLE_SIZE> table = {};
+    for (size_t i = 0; i < RESERVED_WORD_COUNT; i++){
+        table[reserved_hash(RESERVED_WORDS[i].word, RESERVED_SEED)] = uint8_t(i + 1);
+    }
+    return table;
+}();
+
 
 // Lookup identifier if it is a reserved keyword
-TokenType lookup_ident(std::string ident){
-    if (KEYWORDS.find(ident) != KEYWORDS.end()){
-        return KEYWORDS[ident];
+TokenType lookup_ident(std::string_view ident){
+    if (ident.size() < RESERVED_MIN_LENGTH || ident.size() > RESERVED_MAX_LENGTH){
+        return TokenType::IDENT;
     }
-    
-    if (std::find(TYPE_KEYWORDS.begin(), TYPE_KEYWORDS.end(), ident) != TYPE_KEYWORDS.end()){
-        return TokenType::TYPE;
+
+    uint8_t entry = RESERVED_TABLE[reserved_hash(ident, RESERVED_SEED)];
+    if (entry != 0 && RESERVED_WORDS[entry - 1].word == ident){
+        return RESERVED_WORDS[entry - 1].type;
     }
 
     return TokenType::IDENT;
-
 }
 
 // Token class
 class Token{
     public:
         TokenType type;
-        // literal can be of type int, float, string
-        std::string literal;
+        // view of the token text inside the lexer's source buffer (no copy is made)
+        std::string_view lexeme;
         int line_no;
         int col_no;
 
         // constructor
-        Token(TokenType type, std::string literal, int line_no, int col_no) : type(type), literal(literal), line_no(line_no), col_no(col_no){}
-        
+        Token(TokenType type, std::string_view lexeme, int line_no, int col_no) : type(type), lexeme(lexeme), line_no(line_no), col_no(col_no){}
+
+        // literal can be of type int, float, string, only materialized when asked for
+        std::string literal() const {
+            return std::string(this->lexeme);
+        }
 
         // to_string
         std::string to_string(){
             
-            return "Token[" + token_type_map[type] + ", " + literal + ", " + std::to_string(line_no) + ", " + std::to_string(col_no) + "]";}
+            return "Token[" + token_type_map[type] + ", " + literal() + ", " + std::to_string(line_no) + ", " + std::to_string(col_no) + "]";}
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+#include "Token.hpp"
+#include "SourceBuffer.hpp"
+
+// Structure-of-arrays buffer of a whole pre-lexed source file.
+// Every column is indexed by token number, lexemes are (offset, length) slices of the source buffer.
+class TokenBuffer{
+    public:
+        std::shared_ptr<const SourceBuffer> buffer; // keeps the source alive for the offsets
+        std::vector<uint8_t> types;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> lengths;
+        std::vector<int32_t> lines;
+        std::vector<int32_t> cols;
+
+        TokenBuffer(std::shared_ptr<const SourceBuffer> buffer) : buffer(buffer){}
+
+        size_t size() const {
+            return this->types.size();
+        }
+
+        void reserve(size_t count){
+            this->types.reserve(count);
+            this->offsets.reserve(count);
+            this->lengths.reserve(count);
+            this->lines.reserve(count);
+            this->cols.reserve(count);
+        }
+
+        // append a token whose lexeme views into this buffer's source
+        void push(const Token& tok){
+            this->types.push_back(static_cast<uint8_t>(tok.type));
+            this->offsets.push_back(static_cast<uint32_t>(tok.lexeme.data() - this->buffer->view().data()));
+            this->lengths.push_back(static_cast<uint32_t>(tok.lexeme.length()));
+            this->lines.push_back(tok.line_no);
+            this->cols.push_back(tok.col_no);
+        }
+
+        TokenType type_at(size_t index) const {
+            return static_cast<TokenType>(this->types[clamp(index)]);
+        }
+
+        std::string_view lexeme_at(size_t index) const {
+            index = clamp(index);
+            return this->buffer->view().substr(this->offsets[index], this->lengths[index]);
+        }
+
+        // rebuild the Token at index, reading past the end yields the final (EOF) token
+        Token token_at(size_t index) const {
+            index = clamp(index);
+            return Token(type_at(index), lexeme_at(index), this->lines[index], this->cols[index]);
+        }
+
+        // index of the first token that differs from other, size() when both hold the same tokens
+        size_t first_difference(const TokenBuffer& other) const {
+            size_t count = std::min(this->size(), other.size());
+            for (size_t i = 0; i < count; i++){
+                if (this->types[i] != other.types[i] || this->offsets[i] != other.offsets[i] || this->lengths[i] != other.lengths[i]
+                    || this->lines[i] != other.lines[i] || this->cols[i] != other.cols[i]){
+                    return i;
+                }
+            }
+            return this->size() == other.size() ? this->size() : count;
+        }
+
+    private:
+        size_t clamp(size_t index) const {
+            return index < this->types.size() ? index : this->types.size() - 1;
+        }
+};
@@ -1,22 +1,134 @@
 #include <iostream>
+#include "SourceBuffer.hpp"
 #include "Lexer.hpp"
 #include "Parser.hpp"
+#include "ParallelLexer.hpp"
 #include "json.hpp"
+#include "AstJson.hpp"
+#include "AstCache.hpp"
+#include "ConstantFolder.hpp"
 #include "Compiler.hpp"
+#include "Optimizer.hpp"
+#include "Jit.hpp"
+#include "Aot.hpp"
+#include "ObjectCache.hpp"
+#include "ParallelCompiler.hpp"
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
 #include <llvm/IR/Type.h>
 
-#include <llvm/ExecutionEngine/MCJIT.h>
-#include <llvm/ExecutionEngine/SectionMemoryManager.h>
-#include <llvm/ExecutionEngine/Interpreter.h>
-#include <llvm/ExecutionEngine/GenericValue.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
-#include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+
+
+// milliseconds elapsed since start
+double elapsed_ms(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// parser over the lexer, with prelex the whole file is lexed into a token buffer first (on a thread pool if parallel)
+Parser make_parser(Lexer lexer, bool prelex, bool parallel, bool timings){
+    if (!prelex && !parallel){
+        return Parser(lexer);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TokenBuffer tokens = parallel ? ParallelLexer(lexer.buffer).tokenize() : lexer.tokenize();
+    if (timings){
+        std::cout << "lex: " << elapsed_ms(start) << " ms (" << tokens.size() << " tokens)" << std::endl;
+    }
+    return Parser(std::move(tokens));
+}
+
+Program parse_program(Parser& parser, bool timings, bool ast_stats){
+    auto start = std::chrono::steady_clock::now();
+    Program program = parser.parse_program();
+    if (timings){
+        std::cout << (parser.buffered ? "parse: " : "lex + parse: ") << elapsed_ms(start) << " ms" << std::endl;
+    }
+    if (ast_stats){
+        std::cout << "ast: " << program.arena->nodes_allocated() << " nodes, " << program.arena->bytes_used() << " bytes used, "
+                  << program.arena->bytes_reserved() << " bytes reserved in " << program.arena->page_count() << " pages" << std::endl;
+    }
+    return program;
+}
+
+// fold constants in the program before it is compiled
+void fold_program(Program& program, bool report, bool timings){
+    auto start = std::chrono::steady_clock::now();
+    FoldReport result = ConstantFolder().run(program);
+    if (timings){
+        std::cout << "fold: " << elapsed_ms(start) << " ms" << std::endl;
+    }
+    if (report){
+        result.print(std::cout);
+    }
+}
+
+// lower the program, through the flat AST encoding if asked to
+void compile_program(Compiler& compiler, Program& program, bool flat_ast){
+    if (flat_ast){
+        FlatAst flat = FlatAstBuilder().build(&program);
+        compiler.compile(flat);
+    } else {
+        compiler.compile(&program);
+    }
+}
+
+// flat AST of the source, loaded from the cache next to it while the source is unchanged and
+// written there after a clean parse otherwise
+FlatAst cached_flat_ast(Lexer& lexer, const std::string& cache_path, bool prelex, bool parallel, bool timings, bool ast_stats){
+    std::string_view source = lexer.buffer->view();
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional<FlatAst> cached = AstCache::load(cache_path, source);
+    if (cached){
+        if (timings){
+            std::cout << "ast cache load: " << elapsed_ms(start) << " ms (" << cached->nodes.size() << " nodes)" << std::endl;
+        }
+        return std::move(*cached);
+    }
+
+    Parser parser = make_parser(lexer, prelex, parallel, timings);
+    Program program = parse_program(parser, timings, ast_stats);
+    FlatAst flat = FlatAstBuilder().build(&program);
+    if (parser.errors.empty() && !AstCache::write(flat, source, cache_path)){
+        std::cerr << "Unable to write AST cache " << cache_path << std::endl;
+    }
+    return flat;
+}
+
+// a program that failed to compile leaves invalid IR behind (e.g. an undefined variable), which must
+// not be optimized or run. Reports what is wrong and returns false if any module is invalid
+bool verify_modules(const std::vector<CompiledModule>& modules){
+    bool valid = true;
+    for (const CompiledModule& compiled : modules){
+        std::string problems;
+        llvm::raw_string_ostream problems_stream(problems);
+        if (llvm::verifyModule(*compiled.module, &problems_stream)){
+            std::cerr << "Compile error, module " << compiled.module->getModuleIdentifier() << " is invalid:\n" << problems_stream.str();
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+// run the optimization pipeline over a compiled module
+void optimize_module(llvm::Module& module, OptLevel level, bool report, bool timings, llvm::TargetMachine* target = nullptr){
+    auto start = std::chrono::steady_clock::now();
+    OptimizationReport result = Optimizer(level, target).run(module);
+    if (timings){
+        std::cout << "optimize: " << elapsed_ms(start) << " ms" << std::endl;
+    }
+    if (report){
+        result.print(std::cout);
+    }
+}
 
 
 int main(int argc, char** argv)
@@ -26,22 +138,171 @@ int main(int argc, char** argv)
     bool COMPILER_DEBUG = true;
     bool RUN_CODE = false;
 
-    // read source file
-    std::string source = "";
-    std::string line;
-    std::ifstream file("/home/pirate/projects/ccp_lang_cmake/source.ligma");
-    if (file.is_open()){
-        while (getline(file, line)){
-            source += line + "\n";
+    bool PRELEX = false; // lex the whole file into a token buffer before parsing
+    bool PARALLEL_LEX = false; // pre-lex in chunks on a thread pool
+    bool VERIFY_PARALLEL_LEX = false; // check that the parallel lexer matches the sequential one
+    bool TIMINGS = false; // report the time spent in each phase
+    bool AST_STATS = false; // report AST arena memory use
+    bool FLAT_AST = false; // compile from the flat, index-based AST
+    bool AST_CACHE = false; // reuse the parsed AST cached next to the source file (implies FLAT_AST)
+    OptLevel OPT_LEVEL = OptLevel::O0; // optimization level, -O0 .. -O3
+    bool FOLD = false; // fold constants in the AST before compiling, on at -O1 and up
+    bool OPT_REPORT = false; // report instruction counts before and after optimization
+    JitMode JIT_MODE = JitMode::Eager; // compile the whole module up front, or each function on its first call
+    bool JIT_STATS = false; // report how many functions the JIT compiled
+    bool ALLOC_STATS = false; // report the runtime's allocation counters after the run
+    bool EMIT_OBJECT = false; // write a native object file for the host
+    bool EMIT_EXECUTABLE = false; // link the object file into an executable
+    std::string OUTPUT_PATH = ""; // where the object file or executable goes
+    bool OBJECT_CACHE = false; // reuse JIT object code from the on-disk cache
+    std::string OBJECT_CACHE_DIR = ""; // cache directory, the default one if empty
+    bool PARALLEL_CODEGEN = false; // lower and optimize every top-level function in its own module on a thread pool
+    size_t CODEGEN_THREADS = std::thread::hardware_concurrency(); // workers for parallel codegen
+
+    // source file path, the first argument that isn't a flag
+    std::string source_path = "/home/pirate/projects/ccp_lang_cmake/source.ligma";
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--prelex"){
+            PRELEX = true;
+        } else if (arg == "--parallel-lex"){
+            PARALLEL_LEX = true;
+        } else if (arg == "--verify-parallel-lex"){
+            VERIFY_PARALLEL_LEX = true;
+        } else if (arg == "--timings"){
+            TIMINGS = true;
+        } else if (arg == "--ast-stats"){
+            AST_STATS = true;
+        } else if (arg == "--flat-ast"){
+            FLAT_AST = true;
+        } else if (arg == "--ast-cache"){
+            AST_CACHE = true;
+        } else if (Optimizer::parse_level(arg)){
+            OPT_LEVEL = *Optimizer::parse_level(arg);
+        } else if (arg == "--fold"){
+            FOLD = true;
+        } else if (arg == "--opt-report"){
+            OPT_REPORT = true;
+        } else if (arg == "--run"){
+            RUN_CODE = true;
+        } else if (arg == "--lazy"){
+            JIT_MODE = JitMode::Lazy;
+        } else if (arg == "--jit-stats"){
+            JIT_STATS = true;
+        } else if (arg == "--alloc-stats"){
+            ALLOC_STATS = true;
+        } else if (arg == "--emit-obj"){
+            EMIT_OBJECT = true;
+        } else if (arg == "--emit-exe"){
+            EMIT_EXECUTABLE = true;
+        } else if (arg == "-o" && i + 1 < argc){
+            OUTPUT_PATH = argv[++i];
+        } else if (arg == "--parallel-codegen"){
+            PARALLEL_CODEGEN = true;
+        } else if (arg == "--codegen-threads" && i + 1 < argc){
+            PARALLEL_CODEGEN = true;
+            CODEGEN_THREADS = std::stoul(argv[++i]);
+        } else if (arg == "--obj-cache"){
+            OBJECT_CACHE = true;
+        } else if (arg == "--obj-cache-dir" && i + 1 < argc){
+            OBJECT_CACHE = true;
+            OBJECT_CACHE_DIR = argv[++i];
+        } else {
+            source_path = arg;
         }
-        file.close();
-    } else {
+    }
+
+    FOLD = FOLD || OPT_LEVEL != OptLevel::O0;
+
+    // memory map the source file, tokens view straight into the mapping
+    std::shared_ptr<SourceBuffer> source = SourceBuffer::map_file(source_path);
+    if (!source){
         std::cout << "Unable to open file" << std::endl;
         return 1;
     }
 
     Lexer lexer = Lexer(source);
 
+    // parse the whole program, folding it if asked to
+    auto parse = [&](Parser& parser){
+        Program program = parse_program(parser, TIMINGS, AST_STATS);
+        if (FOLD){
+            fold_program(program, OPT_REPORT, TIMINGS);
+        }
+        return program;
+    };
+
+    // the flat AST of the program, through the AST cache if enabled. The cache holds the program as
+    // parsed, folding happens on the way out of it
+    auto parse_flat = [&](){
+        if (!AST_CACHE){
+            Parser parser = make_parser(lexer, PRELEX, PARALLEL_LEX, TIMINGS);
+            Program program = parse(parser);
+            return FlatAstBuilder().build(&program);
+        }
+        FlatAst flat = cached_flat_ast(lexer, AstCache::path_for(source_path), PRELEX, PARALLEL_LEX, TIMINGS, AST_STATS);
+        if (!FOLD){
+            return flat;
+        }
+        Program program = flat.to_program();
+        fold_program(program, OPT_REPORT, TIMINGS);
+        return FlatAstBuilder().build(&program);
+    };
+
+    // parse and compile the source into one or more modules: a single one from the Compiler, or one per
+    // top-level function with parallel codegen (already optimized per function at parallel_level).
+    // No modules if the program didn't compile
+    auto compile_modules = [&](OptLevel parallel_level){
+        std::vector<CompiledModule> modules;
+        if (PARALLEL_CODEGEN){
+            FlatAst flat = parse_flat();
+
+            auto start = std::chrono::steady_clock::now();
+            modules = ParallelCompiler(CODEGEN_THREADS, parallel_level).compile(flat);
+            if (TIMINGS){
+                std::cout << "parallel codegen: " << elapsed_ms(start) << " ms (" << modules.size() << " modules)" << std::endl;
+            }
+            if (!verify_modules(modules)){
+                modules.clear();
+            }
+            return modules;
+        }
+
+        Compiler compiler = Compiler();
+        if (AST_CACHE){
+            compiler.compile(parse_flat());
+        } else {
+            Parser parser = make_parser(lexer, PRELEX, PARALLEL_LEX, TIMINGS);
+            Program program = parse(parser);
+            compile_program(compiler, program, FLAT_AST);
+        }
+        auto [context, module] = compiler.take_module();
+        modules.push_back(CompiledModule{std::move(context), std::move(module)});
+        if (!verify_modules(modules)){
+            modules.clear();
+        }
+        return modules;
+    };
+
+    // the whole program as a single module, parallel codegen output is linked back together
+    auto compile_module = [&](){
+        return ParallelCompiler::link(compile_modules(OPT_LEVEL));
+    };
+
+    if (VERIFY_PARALLEL_LEX){
+        // tiny chunks so even small files get split and stitched
+        TokenBuffer sequential = Lexer(source).tokenize();
+        TokenBuffer parallel = ParallelLexer(source, std::thread::hardware_concurrency(), 1).tokenize();
+
+        size_t difference = parallel.first_difference(sequential);
+        if (difference != sequential.size() || parallel.size() != sequential.size()){
+            std::cout << "Parallel lexer differs at token " << difference << ": " << parallel.token_at(difference).to_string()
+                      << " vs " << sequential.token_at(difference).to_string() << std::endl;
+            return 1;
+        }
+        std::cout << "Parallel lexer matches (" << sequential.size() << " tokens)" << std::endl;
+    }
+
     if (LEXER_DEBUG){
         Lexer lexer = Lexer(source);
         while (lexer.current_char != '\0'){
@@ -52,8 +313,8 @@ int main(int argc, char** argv)
 
 
     if (PARSER_DEBUG){
-        Parser parser = Parser(lexer);
-        Program program = parser.parse_program();
+        Parser parser = make_parser(lexer, PRELEX, PARALLEL_LEX, TIMINGS);
+        Program program = parse_program(parser, TIMINGS, AST_STATS);
     
         if (parser.errors.size() > 0){
             for (std::string error : parser.errors){
@@ -61,54 +322,125 @@ int main(int argc, char** argv)
             }
             return 1;
         }
-        nlohmann::json program_json = program.json();
-
-        // dump json to file
-        std::string program_json_str = program_json.dump(4);
+        // stream the json to file as the AST is walked
         std::ofstream out("program.json");
-        out << program_json_str;
+        AstJsonWriter(out, 4).write(&program);
         out.close();
     }
 
 
     if (COMPILER_DEBUG){
-        Parser parser = Parser(lexer);
-        Program program = parser.parse_program();
-
-
-        Compiler compiler = Compiler();
-
-        compiler.compile(&program);
+        CompiledModule compiled = compile_module();
+        if (!compiled.module){
+            return 1;
+        }
+        // optimized as the JIT would, for the host
+        std::unique_ptr<llvm::TargetMachine> target = Jit::host_target_machine();
+        if (!target){
+            return 1;
+        }
+        Jit::prepare_module(*compiled.module, *target);
+        optimize_module(*compiled.module, OPT_LEVEL, OPT_REPORT, TIMINGS, target.get());
 
-        auto module = compiler.get_module();
+        auto module = compiled.module.get();
         std::error_code EC;
         llvm::raw_fd_ostream OS("module.ll", EC);
         module->print(OS, nullptr);
         OS.flush();
     }
 
-    // define mcjit execution engine
+    // ahead-of-time compile to an object file, and link it if asked to
+    if (EMIT_OBJECT || EMIT_EXECUTABLE){
+        CompiledModule compiled = compile_module();
+        if (!compiled.module){
+            return 1;
+        }
+
+        std::unique_ptr<llvm::TargetMachine> target = Aot::host_target_machine(OPT_LEVEL);
+        if (!target){
+            return 1;
+        }
+        Aot::prepare_module(*compiled.module, *target);
+        optimize_module(*compiled.module, OPT_LEVEL, OPT_REPORT, TIMINGS, target.get());
+
+        std::string executable_path = OUTPUT_PATH.empty() ? "a.out" : OUTPUT_PATH;
+        std::string object_path = EMIT_EXECUTABLE ? executable_path + ".o" : (OUTPUT_PATH.empty() ? "module.o" : OUTPUT_PATH);
+
+        auto start = std::chrono::steady_clock::now();
+        if (!Aot::emit_object(*compiled.module, *target, object_path)){
+            return 1;
+        }
+        if (EMIT_EXECUTABLE && !Aot::link_executable({object_path}, executable_path)){
+            return 1;
+        }
+        if (TIMINGS){
+            std::cout << (EMIT_EXECUTABLE ? "emit + link: " : "emit: ") << elapsed_ms(start) << " ms" << std::endl;
+        }
+    }
+
+    // run main on the ORC JIT
     if (RUN_CODE){
-        Parser parser = Parser(lexer);
-        Program program = parser.parse_program();
+        // a lazy session optimizes each function as it compiles it, an eager one gets optimized modules.
+        // Parallel codegen modules go to the JIT separately, already optimized by the workers.
+        std::vector<CompiledModule> modules = compile_modules(JIT_MODE == JitMode::Eager ? OPT_LEVEL : OptLevel::O0);
+        if (modules.empty()){
+            return 1;
+        }
+        // main has to come from the program, there is nothing else in the session it could bind to
+        bool defines_main = std::any_of(modules.begin(), modules.end(), [](const CompiledModule& compiled){
+            llvm::Function* func = compiled.module->getFunction("main");
+            return func && !func->isDeclaration();
+        });
+        if (!defines_main){
+            std::cout << "Function main not found" << std::endl;
+            return 1;
+        }
+        if (JIT_MODE == JitMode::Eager && !PARALLEL_CODEGEN){
+            std::unique_ptr<llvm::TargetMachine> target = Jit::host_target_machine();
+            if (!target){
+                return 1;
+            }
+            Jit::prepare_module(*modules[0].module, *target);
+            optimize_module(*modules[0].module, OPT_LEVEL, OPT_REPORT, TIMINGS, target.get());
+        }
 
-        Compiler compiler = Compiler();
-        compiler.compile(&program);
+        // keyed by the level the module was optimized at, which is OPT_LEVEL in either mode
+        std::unique_ptr<DiskObjectCache> object_cache;
+        if (OBJECT_CACHE){
+            object_cache = std::make_unique<DiskObjectCache>(OBJECT_CACHE_DIR.empty() ? DiskObjectCache::default_directory() : std::filesystem::path(OBJECT_CACHE_DIR), OPT_LEVEL);
+        }
 
-        llvm::InitializeNativeTarget();
-        llvm::InitializeNativeTargetAsmPrinter();
-        llvm::InitializeNativeTargetAsmParser();
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Jit> jit = Jit::create(JIT_MODE, JIT_MODE == JitMode::Lazy ? OPT_LEVEL : OptLevel::O0, object_cache.get(),
+                                               PARALLEL_CODEGEN ? CODEGEN_THREADS : 0);
+        if (!jit){
+            return 1;
+        }
+        for (CompiledModule& compiled : modules){
+            if (!jit->add_module(std::move(compiled.context), std::move(compiled.module))){
+                return 1;
+            }
+        }
 
-        llvm::ExecutionEngine* engine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(compiler.get_module())).create();
-        llvm::Function* main = compiler.get_module()->getFunction("main");
+        Jit::MainFunction main = jit->lookup<Jit::MainFunction>("main");
         if (!main){
             std::cout << "Function main not found" << std::endl;
             return 1;
         }
+        if (TIMINGS){
+            std::cout << "jit: " << elapsed_ms(start) << " ms" << std::endl;
+        }
 
-        std::vector<llvm::GenericValue> args;
-        llvm::GenericValue result = engine->runFunction(main, args);
-        std::cout << result.IntVal.getLimitedValue() << std::endl;
+        std::cout << main() << std::endl;
+        if (JIT_STATS){
+            jit->stats().print(std::cout);
+            if (object_cache){
+                object_cache->stats().print(std::cout);
+            }
+        }
+        if (ALLOC_STATS){
+            Runtime::print_counters(std::cout);
+        }
     }
     
     return 0;
@@ -0,0 +1,139 @@
+#include "ligma_internal.h"
+
+// size class c holds blocks of LIGMA_ALIGNMENT << c bytes
+#define SIZE_CLASSES 8
+#define MAX_POOLED ((uint64_t)LIGMA_ALIGNMENT << (SIZE_CLASSES - 1))
+
+#define SLAB_SIZE (64 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct free_block{
+    struct free_block* next;
+} free_block;
+
+typedef struct region_chunk{
+    struct region_chunk* previous;
+    uint64_t size; // bytes after the header
+    uint64_t used;
+} region_chunk;
+
+// the header padded, so the bytes of a chunk start aligned
+#define CHUNK_HEADER (((uint64_t)sizeof(region_chunk) + LIGMA_ALIGNMENT - 1) & ~(uint64_t)(LIGMA_ALIGNMENT - 1))
+
+static _Thread_local free_block* free_lists[SIZE_CLASSES];
+static _Thread_local region_chunk* region; // the chunk being bumped
+static _Thread_local region_chunk* spare; // the last chunk given back, for the next one
+static _Thread_local ligma_alloc_counters counters;
+
+static inline uint64_t round_up(uint64_t size){
+    return (size + LIGMA_ALIGNMENT - 1) & ~(uint64_t)(LIGMA_ALIGNMENT - 1);
+}
+
+// the smallest class that fits size
+static inline unsigned size_class(uint64_t size){
+    if (size <= LIGMA_ALIGNMENT){
+        return 0;
+    }
+    return (unsigned)(64 - __builtin_clzll(size - 1)) - 5;
+}
+
+static void* system_alloc(uint64_t size){
+    void* block = aligned_alloc(LIGMA_ALIGNMENT, round_up(size));
+    if (!block){
+        ligma_fail("out of memory");
+    }
+    counters.system_allocations++;
+    return block;
+}
+
+// carve a new slab into blocks of class c, lowest address first on the list
+static void refill(unsigned c){
+    uint64_t block_size = (uint64_t)LIGMA_ALIGNMENT << c;
+    char* slab = system_alloc(SLAB_SIZE);
+    for (uint64_t offset = SLAB_SIZE - block_size;; offset -= block_size){
+        free_block* block = (free_block*)(slab + offset);
+        block->next = free_lists[c];
+        free_lists[c] = block;
+        if (offset == 0){
+            break;
+        }
+    }
+}
+
+void* ligma_alloc(uint64_t size){
+    counters.allocations++;
+    if (size > MAX_POOLED){
+        return system_alloc(size);
+    }
+    unsigned c = size_class(size);
+    if (!free_lists[c]){
+        refill(c);
+    }
+    free_block* block = free_lists[c];
+    free_lists[c] = block->next;
+    return block;
+}
+
+void ligma_free(void* block, uint64_t size){
+    if (!block){
+        return;
+    }
+    counters.frees++;
+    if (size > MAX_POOLED){
+        free(block);
+        return;
+    }
+    unsigned c = size_class(size);
+    ((free_block*)block)->next = free_lists[c];
+    free_lists[c] = block;
+}
+
+ligma_region_mark ligma_region_enter(void){
+    ligma_region_mark mark = {region, region ? region->used : 0};
+    return mark;
+}
+
+void* ligma_region_alloc(uint64_t size){
+    size = round_up(size);
+    counters.region_allocations++;
+    counters.region_bytes += size;
+
+    if (!region || region->size - region->used < size){
+        region_chunk* chunk = spare;
+        if (chunk && chunk->size >= size){
+            spare = NULL;
+        } else {
+            uint64_t chunk_size = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+            chunk = system_alloc(CHUNK_HEADER + chunk_size);
+            chunk->size = chunk_size;
+        }
+        chunk->previous = region;
+        chunk->used = 0;
+        region = chunk;
+    }
+
+    void* block = (char*)region + CHUNK_HEADER + region->used;
+    region->used += size;
+    return block;
+}
+
+void ligma_region_leave(ligma_region_mark mark){
+    // marks are left in the reverse order they were taken, so the chunk of this one is still there
+    while (region != mark.chunk){
+        region_chunk* chunk = region;
+        region = chunk->previous;
+        if (spare && spare->size >= chunk->size){
+            free(chunk);
+        } else {
+            free(spare);
+            spare = chunk;
+        }
+    }
+    if (region){
+        region->used = mark.used;
+    }
+}
+
+const ligma_alloc_counters* ligma_counters(void){
+    return &counters;
+}
@@ -0,0 +1,28 @@
+#ifndef LIGMA_INTERNAL_H
+#define LIGMA_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ligma_runtime.h"
+
+// Helpers shared by the sources of the runtime, not part of its interface.
+
+static inline int ligma_is_heap(const ligma_string* s){
+    return (s->heap.length & LIGMA_STRING_HEAP) != 0;
+}
+
+static inline uint32_t ligma_length_of(const ligma_string* s){
+    return ligma_is_heap(s) ? s->heap.length & ~LIGMA_STRING_HEAP : s->small.length;
+}
+
+static inline const char* ligma_data_of(const ligma_string* s){
+    return ligma_is_heap(s) ? s->heap.buffer->data + s->heap.offset : s->small.bytes;
+}
+
+static inline void ligma_fail(const char* message){
+    fprintf(stderr, "ligma runtime: %s\n", message);
+    abort();
+}
+
+#endif
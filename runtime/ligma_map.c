@@ -0,0 +1,352 @@
+#include <string.h>
+
+#include "ligma_internal.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GROUP_WIDTH 16
+typedef uint32_t group_mask; // bit i for slot i of the group
+#else
+#define GROUP_WIDTH 8
+typedef uint64_t group_mask; // bit 8 * i + 7 for slot i of the group
+#endif
+
+// control bytes, a full slot's is the 7 low bits of its key's hash
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+// smallest table, at least one group
+#define MIN_CAPACITY 16
+
+#define NOT_FOUND UINT32_MAX
+
+struct ligma_map{
+    int8_t* ctrl; // capacity + GROUP_WIDTH bytes, the ones past capacity mirror the first group
+    char* slots; // in the same allocation as ctrl
+    uint32_t capacity; // 0 or a power of two
+    uint32_t size;
+    uint32_t growth_left; // empty slots that can still be filled before the table has to grow
+    uint32_t flags;
+    uint32_t key_size;
+    uint32_t value_offset;
+    uint32_t slot_size;
+};
+
+// --------------------------------------- GROUPS ---------------------------------------
+// a group is the GROUP_WIDTH control bytes from some slot on, a probe looks at one group at a time
+
+#if defined(__SSE2__)
+static inline group_mask group_match(const int8_t* ctrl, int8_t h2){
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (group_mask)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline group_mask group_match_empty(const int8_t* ctrl){
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+// empty and deleted are the only negative control bytes
+static inline group_mask group_match_free(const int8_t* ctrl){
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (group_mask)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_setzero_si128(), group));
+}
+
+static inline uint32_t mask_first(group_mask mask){
+    return (uint32_t)__builtin_ctz(mask);
+}
+#else
+#define LSBS 0x0101010101010101ull
+#define MSBS 0x8080808080808080ull
+
+static inline uint64_t group_load(const int8_t* ctrl){
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+    return group;
+}
+
+// bytes equal to h2 get their top bit set, and rarely the byte after one of them as well; the keys
+// are compared anyway
+static inline group_mask group_match(const int8_t* ctrl, int8_t h2){
+    uint64_t x = group_load(ctrl) ^ (LSBS * (uint8_t)h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+// empty is the only control byte with the top bit set and bit 1 clear
+static inline group_mask group_match_empty(const int8_t* ctrl){
+    uint64_t group = group_load(ctrl);
+    return group & ~(group << 6) & MSBS;
+}
+
+static inline group_mask group_match_free(const int8_t* ctrl){
+    return group_load(ctrl) & MSBS;
+}
+
+static inline uint32_t mask_first(group_mask mask){
+    return (uint32_t)__builtin_ctzll(mask) >> 3;
+}
+#endif
+
+// --------------------------------------- HASHING ---------------------------------------
+// the top 57 bits pick the group a probe starts at, the low 7 are the slot's control byte
+
+static inline uint64_t mix(uint64_t x){
+    __uint128_t product = (__uint128_t)x * 0x9E3779B97F4A7C15ull;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t hash_word(uint32_t key){
+    return mix(key);
+}
+
+static inline uint64_t hash_string(const ligma_string* key){
+    const char* data = ligma_data_of(key);
+    uint32_t length = ligma_length_of(key);
+    uint64_t hash = 0x243F6A8885A308D3ull ^ length;
+    for (; length >= 8; data += 8, length -= 8){
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        hash = mix(hash ^ word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data, length);
+    return mix(hash ^ tail);
+}
+
+static inline int8_t h2_of(uint64_t hash){
+    return (int8_t)(hash & 0x7f);
+}
+
+// --------------------------------------- TABLE ---------------------------------------
+
+static inline char* slot_at(const ligma_map* map, uint32_t index){
+    return map->slots + (size_t)index * map->slot_size;
+}
+
+static inline void set_ctrl(ligma_map* map, uint32_t index, int8_t ctrl){
+    map->ctrl[index] = ctrl;
+    if (index < GROUP_WIDTH){
+        map->ctrl[map->capacity + index] = ctrl;
+    }
+}
+
+static inline int key_equal(const char* slot, const void* key, int string_key){
+    if (string_key){
+        const ligma_string* a = (const ligma_string*)slot;
+        const ligma_string* b = (const ligma_string*)key;
+        uint32_t length = ligma_length_of(a);
+        return length == ligma_length_of(b) && memcmp(ligma_data_of(a), ligma_data_of(b), length) == 0;
+    }
+    uint32_t word;
+    memcpy(&word, slot, sizeof(word));
+    return word == *(const uint32_t*)key;
+}
+
+// index of the slot holding key, NOT_FOUND if there's none. Groups are probed at triangular
+// offsets, which visit every group of a power of two table once; a table always has an empty slot,
+// and no key is past the first group with one
+static inline uint32_t find_index(const ligma_map* map, const void* key, uint64_t hash, int string_key){
+    if (map->capacity == 0){
+        return NOT_FOUND;
+    }
+    uint32_t mask = map->capacity - 1;
+    uint32_t offset = (uint32_t)(hash >> 7) & mask;
+    int8_t h2 = h2_of(hash);
+    for (uint32_t stride = GROUP_WIDTH;; stride += GROUP_WIDTH){
+        const int8_t* group = map->ctrl + offset;
+        for (group_mask match = group_match(group, h2); match; match &= match - 1){
+            uint32_t index = (offset + mask_first(match)) & mask;
+            if (key_equal(slot_at(map, index), key, string_key)){
+                return index;
+            }
+        }
+        if (group_match_empty(group)){
+            return NOT_FOUND;
+        }
+        offset = (offset + stride) & mask;
+    }
+}
+
+// first empty or deleted slot on the probe sequence of hash
+static uint32_t find_free(const ligma_map* map, uint64_t hash){
+    uint32_t mask = map->capacity - 1;
+    uint32_t offset = (uint32_t)(hash >> 7) & mask;
+    for (uint32_t stride = GROUP_WIDTH;; stride += GROUP_WIDTH){
+        group_mask free = group_match_free(map->ctrl + offset);
+        if (free){
+            return (offset + mask_first(free)) & mask;
+        }
+        offset = (offset + stride) & mask;
+    }
+}
+
+// the slots start 16 byte aligned, after the control bytes
+static inline size_t ctrl_size(uint32_t capacity){
+    return ((size_t)capacity + GROUP_WIDTH + 15) & ~(size_t)15;
+}
+
+static inline size_t table_size(const ligma_map* map, uint32_t capacity){
+    return ctrl_size(capacity) + (size_t)capacity * map->slot_size;
+}
+
+static void allocate_table(ligma_map* map, uint32_t capacity){
+    char* memory = ligma_alloc(table_size(map, capacity));
+    memset(memory, CTRL_EMPTY, (size_t)capacity + GROUP_WIDTH);
+    map->ctrl = (int8_t*)memory;
+    map->slots = memory + ctrl_size(capacity);
+    map->capacity = capacity;
+    map->growth_left = capacity - capacity / 8;
+}
+
+// move every entry into a new table of capacity slots, which drops the deleted ones
+static void rehash(ligma_map* map, uint32_t capacity){
+    int8_t* old_ctrl = map->ctrl;
+    char* old_slots = map->slots;
+    uint32_t old_capacity = map->capacity;
+
+    allocate_table(map, capacity);
+    for (uint32_t i = 0; i < old_capacity; i++){
+        if (old_ctrl[i] < 0){
+            continue;
+        }
+        const char* slot = old_slots + (size_t)i * map->slot_size;
+        uint64_t hash = map->flags & LIGMA_MAP_STRING_KEYS ? hash_string((const ligma_string*)slot) : hash_word(*(const uint32_t*)slot);
+        uint32_t index = find_free(map, hash);
+        set_ctrl(map, index, h2_of(hash));
+        memcpy(slot_at(map, index), slot, map->slot_size);
+    }
+    map->growth_left -= map->size;
+    if (old_ctrl){
+        ligma_free(old_ctrl, table_size(map, old_capacity));
+    }
+}
+
+// a table with an empty slot to fill: the first one, the same size without the deleted slots if
+// they take up most of it, or twice the size
+static void make_room(ligma_map* map){
+    if (map->capacity == 0){
+        rehash(map, MIN_CAPACITY);
+    } else if (map->size <= (map->capacity - map->capacity / 8) / 2){
+        rehash(map, map->capacity);
+    } else if (map->capacity <= UINT32_MAX / 4){
+        rehash(map, map->capacity * 2);
+    } else {
+        ligma_fail("map too large");
+    }
+}
+
+static inline void* insert(ligma_map* map, const void* key, uint64_t hash, int string_key){
+    uint32_t index = find_index(map, key, hash, string_key);
+    if (index != NOT_FOUND){
+        return slot_at(map, index) + map->value_offset;
+    }
+
+    if (map->capacity == 0){
+        make_room(map);
+    }
+    index = find_free(map, hash);
+    if (map->ctrl[index] == CTRL_EMPTY){
+        if (map->growth_left == 0){
+            make_room(map);
+            index = find_free(map, hash);
+        }
+        map->growth_left--;
+    }
+    map->size++;
+    set_ctrl(map, index, h2_of(hash));
+
+    char* slot = slot_at(map, index);
+    memcpy(slot, key, map->key_size);
+    if (string_key){
+        ligma_string_retain(*(const ligma_string*)key);
+    }
+    memset(slot + map->value_offset, 0, map->slot_size - map->value_offset);
+    return slot + map->value_offset;
+}
+
+// release the strings of the slot at index, if the map holds any
+static void release_slot(ligma_map* map, uint32_t index){
+    char* slot = slot_at(map, index);
+    if (map->flags & LIGMA_MAP_STRING_KEYS){
+        ligma_string_release(*(ligma_string*)slot);
+    }
+    if (map->flags & LIGMA_MAP_STRING_VALUES){
+        ligma_string_release(*(ligma_string*)(slot + map->value_offset));
+    }
+}
+
+static inline int32_t remove_index(ligma_map* map, uint32_t index){
+    if (index == NOT_FOUND){
+        return 0;
+    }
+    release_slot(map, index);
+    set_ctrl(map, index, CTRL_DELETED);
+    map->size--;
+    return 1;
+}
+
+// --------------------------------------- INTERFACE ---------------------------------------
+
+ligma_map* ligma_map_new(uint32_t flags, uint32_t value_size){
+    ligma_map* map = ligma_alloc(sizeof(ligma_map));
+    uint32_t key_size = flags & LIGMA_MAP_STRING_KEYS ? sizeof(ligma_string) : sizeof(uint32_t);
+    uint32_t value_align = value_size >= 8 ? 8 : value_size >= 4 ? 4 : value_size >= 2 ? 2 : 1;
+    uint32_t align = key_size > value_align ? (key_size > 8 ? 8 : key_size) : value_align;
+
+    map->ctrl = NULL;
+    map->slots = NULL;
+    map->capacity = 0;
+    map->size = 0;
+    map->growth_left = 0;
+    map->flags = flags;
+    map->key_size = key_size;
+    map->value_offset = (key_size + value_align - 1) & ~(value_align - 1);
+    map->slot_size = (map->value_offset + value_size + align - 1) & ~(align - 1);
+    return map;
+}
+
+void ligma_map_free(ligma_map* map){
+    if (!map){
+        return;
+    }
+    if (map->flags & (LIGMA_MAP_STRING_KEYS | LIGMA_MAP_STRING_VALUES)){
+        for (uint32_t i = 0; i < map->capacity; i++){
+            if (map->ctrl[i] >= 0){
+                release_slot(map, i);
+            }
+        }
+    }
+    if (map->ctrl){
+        ligma_free(map->ctrl, table_size(map, map->capacity));
+    }
+    ligma_free(map, sizeof(ligma_map));
+}
+
+int32_t ligma_map_size(const ligma_map* map){
+    return (int32_t)map->size;
+}
+
+void* ligma_map_find_word(const ligma_map* map, uint32_t key){
+    uint32_t index = find_index(map, &key, hash_word(key), 0);
+    return index == NOT_FOUND ? NULL : slot_at(map, index) + map->value_offset;
+}
+
+void* ligma_map_find_string(const ligma_map* map, ligma_string key){
+    uint32_t index = find_index(map, &key, hash_string(&key), 1);
+    return index == NOT_FOUND ? NULL : slot_at(map, index) + map->value_offset;
+}
+
+void* ligma_map_insert_word(ligma_map* map, uint32_t key){
+    return insert(map, &key, hash_word(key), 0);
+}
+
+void* ligma_map_insert_string(ligma_map* map, ligma_string key){
+    return insert(map, &key, hash_string(&key), 1);
+}
+
+int32_t ligma_map_remove_word(ligma_map* map, uint32_t key){
+    return remove_index(map, find_index(map, &key, hash_word(key), 0));
+}
+
+int32_t ligma_map_remove_string(ligma_map* map, ligma_string key){
+    return remove_index(map, find_index(map, &key, hash_string(&key), 1));
+}
@@ -0,0 +1,145 @@
+#ifndef LIGMA_RUNTIME_H
+#define LIGMA_RUNTIME_H
+
+#include <stdint.h>
+
+// Runtime library of compiled ligma programs. The JIT resolves these symbols in the compiler
+// process itself, AOT executables are linked against the static library.
+//
+// Every value type here is passed and returned by value. A ligma_string is 16 bytes of integer
+// class, so it travels in two registers and the compiler can treat it as an { i64, i64 } pair.
+//
+// The runtime isn't thread safe: a ligma program runs on the thread that called its main.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -------------------------------------- ALLOCATION --------------------------------------
+// Every heap block of a program comes from here, LIGMA_ALIGNMENT aligned, and goes back with the
+// size it was allocated with, on the thread that allocated it.
+//
+// A region is a stack of bump allocated chunks, one per thread. A function whose arrays the compiler
+// proved don't outlive the call takes a mark on entry and leaves the region at that mark when it
+// returns, which frees them all at once; the last chunk given back is kept for the next one, so a
+// hot function doesn't reach the system allocator. Everything else comes from pools of power of two
+// size classes, 32 to 4096 bytes, with a free list per class and thread refilled a slab at a time
+// (slabs are kept for the life of the thread); larger blocks go to the system allocator.
+
+#define LIGMA_ALIGNMENT 32
+
+// of one thread, from its start
+typedef struct ligma_alloc_counters{
+    uint64_t allocations; // blocks from ligma_alloc
+    uint64_t frees;
+    uint64_t region_allocations;
+    uint64_t region_bytes;
+    uint64_t system_allocations; // slabs, region chunks and large blocks
+} ligma_alloc_counters;
+
+typedef struct ligma_region_mark{
+    void* chunk;
+    uint64_t used;
+} ligma_region_mark;
+
+void* ligma_alloc(uint64_t size);
+void ligma_free(void* block, uint64_t size);
+
+ligma_region_mark ligma_region_enter(void);
+void* ligma_region_alloc(uint64_t size);
+// free everything allocated in the region since the mark was taken
+void ligma_region_leave(ligma_region_mark mark);
+
+// the counters of the calling thread
+const ligma_alloc_counters* ligma_counters(void);
+
+// --------------------------------------- STRINGS ---------------------------------------
+// A string is either small, its bytes held inline, or a view of [offset, offset + length) of a
+// reference counted heap buffer. Buffers are immutable up to `used`: copying a string shares its
+// buffer and slicing a long one is a view of the same buffer, neither copies a byte. Concatenation
+// appends in place when the left string ends at its buffer's `used` and there is room after it,
+// and grows new buffers geometrically, so building a string in a loop is linear overall.
+//
+// The all zero string is the empty string. A heap string has LIGMA_STRING_HEAP set in its length
+// word, which overlaps the length byte of a small string (that never has it set), so the layout
+// needs a little endian target.
+
+#define LIGMA_STRING_INLINE 15 // longest string held inline
+#define LIGMA_STRING_HEAP 0x80000000u // flag in heap.length
+#define LIGMA_STRING_MAX_LENGTH 0x7fffffffu
+#define LIGMA_BUFFER_IMMORTAL UINT32_MAX // refcount of buffers that are never freed, e.g. of literals
+
+typedef struct ligma_buffer{
+    uint32_t refcount;
+    uint32_t capacity;
+    uint32_t used; // bytes written, the only ones a string can view
+    char data[];
+} ligma_buffer;
+
+typedef struct ligma_string{
+    union {
+        struct {
+            ligma_buffer* buffer;
+            uint32_t offset;
+            uint32_t length; // | LIGMA_STRING_HEAP
+        } heap;
+        struct {
+            char bytes[LIGMA_STRING_INLINE];
+            uint8_t length;
+        } small;
+    };
+} ligma_string;
+
+// strings from these are owned by the caller, which releases them
+ligma_string ligma_string_concat(ligma_string a, ligma_string b);
+// [start, end) clamped to the string, empty if end <= start
+ligma_string ligma_string_slice(ligma_string s, int32_t start, int32_t end);
+
+// these borrow their arguments
+int32_t ligma_string_length(ligma_string s);
+int32_t ligma_string_equal(ligma_string a, ligma_string b); // 1 or 0
+int32_t ligma_string_compare(ligma_string a, ligma_string b); // -1, 0 or 1, bytewise
+
+void ligma_string_retain(ligma_string s);
+void ligma_string_release(ligma_string s);
+
+// ---------------------------------------- MAPS -----------------------------------------
+// An open addressing hash table in the layout of SwissTable: a control byte per slot, either empty,
+// deleted or the 7 low bits of the hash of the key it holds, followed by the slots themselves. A
+// lookup hashes the key once, then compares the control bytes of a whole group of slots against
+// those 7 bits at a time (16 with SSE2, 8 otherwise), so keys are only compared on a likely match
+// and a probe ends at the first group with an empty slot. The table grows by doubling when it
+// would be more than 7/8 full.
+//
+// Keys are 32-bit words (an int, the bits of a float or a bool) or strings; a slot holds the key,
+// then its value of value_size bytes, which the caller reads and writes through the pointer the
+// map gives out. Such a pointer is good until the next insertion. A map with string keys or values
+// holds a reference to each of them, and releases them on removal and when it's freed.
+
+#define LIGMA_MAP_STRING_KEYS 1u
+#define LIGMA_MAP_STRING_VALUES 2u
+
+typedef struct ligma_map ligma_map;
+
+// empty map, allocating nothing until the first insertion
+ligma_map* ligma_map_new(uint32_t flags, uint32_t value_size);
+void ligma_map_free(ligma_map* map);
+int32_t ligma_map_size(const ligma_map* map);
+
+// the value of key, NULL if it isn't in the map
+void* ligma_map_find_word(const ligma_map* map, uint32_t key);
+void* ligma_map_find_string(const ligma_map* map, ligma_string key);
+
+// the value of key, added with all bytes zero if it isn't in the map yet
+void* ligma_map_insert_word(ligma_map* map, uint32_t key);
+void* ligma_map_insert_string(ligma_map* map, ligma_string key);
+
+// 1 if key was in the map, 0 if not
+int32_t ligma_map_remove_word(ligma_map* map, uint32_t key);
+int32_t ligma_map_remove_string(ligma_map* map, ligma_string key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+#include <string.h>
+
+#include "ligma_internal.h"
+
+_Static_assert(sizeof(ligma_string) == 16, "ligma_string has to be two 64-bit words");
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the small string length byte has to overlap the top of heap.length");
+
+// smallest buffer allocated for a concatenation
+#define MIN_CAPACITY 32
+
+static ligma_string make_small(const char* a, uint32_t a_length, const char* b, uint32_t b_length){
+    ligma_string s;
+    memset(&s, 0, sizeof(s));
+    memcpy(s.small.bytes, a, a_length);
+    memcpy(s.small.bytes + a_length, b, b_length);
+    s.small.length = (uint8_t)(a_length + b_length);
+    return s;
+}
+
+static ligma_string make_heap(ligma_buffer* buffer, uint32_t offset, uint32_t length){
+    ligma_string s;
+    s.heap.buffer = buffer;
+    s.heap.offset = offset;
+    s.heap.length = length | LIGMA_STRING_HEAP;
+    return s;
+}
+
+static ligma_buffer* allocate_buffer(uint32_t capacity){
+    ligma_buffer* buffer = ligma_alloc(sizeof(ligma_buffer) + capacity);
+    buffer->refcount = 1;
+    buffer->capacity = capacity;
+    buffer->used = 0;
+    return buffer;
+}
+
+ligma_string ligma_string_concat(ligma_string a, ligma_string b){
+    uint32_t a_length = ligma_length_of(&a);
+    uint32_t b_length = ligma_length_of(&b);
+    if (b_length == 0){
+        ligma_string_retain(a);
+        return a;
+    }
+    if (a_length == 0){
+        ligma_string_retain(b);
+        return b;
+    }
+
+    uint64_t length = (uint64_t)a_length + b_length;
+    if (length > LIGMA_STRING_MAX_LENGTH){
+        ligma_fail("string too long");
+    }
+    if (length <= LIGMA_STRING_INLINE){
+        return make_small(ligma_data_of(&a), a_length, ligma_data_of(&b), b_length);
+    }
+
+    // append in place: nothing can view the bytes past `used`, so writing there changes no string
+    if (ligma_is_heap(&a)){
+        ligma_buffer* buffer = a.heap.buffer;
+        if (buffer->refcount != LIGMA_BUFFER_IMMORTAL && a.heap.offset + a_length == buffer->used && buffer->capacity - buffer->used >= b_length){
+            memcpy(buffer->data + buffer->used, ligma_data_of(&b), b_length);
+            buffer->used += b_length;
+            buffer->refcount++;
+            return make_heap(buffer, a.heap.offset, (uint32_t)length);
+        }
+    }
+
+    // a new buffer with as much room again for what gets appended next
+    uint64_t capacity = length * 2 < MIN_CAPACITY ? MIN_CAPACITY : length * 2;
+    if (capacity > LIGMA_STRING_MAX_LENGTH){
+        capacity = LIGMA_STRING_MAX_LENGTH;
+    }
+    ligma_buffer* buffer = allocate_buffer((uint32_t)capacity);
+    memcpy(buffer->data, ligma_data_of(&a), a_length);
+    memcpy(buffer->data + a_length, ligma_data_of(&b), b_length);
+    buffer->used = (uint32_t)length;
+    return make_heap(buffer, 0, (uint32_t)length);
+}
+
+ligma_string ligma_string_slice(ligma_string s, int32_t start, int32_t end){
+    int32_t length = (int32_t)ligma_length_of(&s);
+    start = start < 0 ? 0 : (start > length ? length : start);
+    end = end < start ? start : (end > length ? length : end);
+
+    // short slices are copied so they don't keep a large buffer alive
+    uint32_t slice_length = (uint32_t)(end - start);
+    if (slice_length <= LIGMA_STRING_INLINE){
+        return make_small(ligma_data_of(&s) + start, slice_length, "", 0);
+    }
+    ligma_string_retain(s);
+    return make_heap(s.heap.buffer, s.heap.offset + (uint32_t)start, slice_length);
+}
+
+int32_t ligma_string_length(ligma_string s){
+    return (int32_t)ligma_length_of(&s);
+}
+
+int32_t ligma_string_equal(ligma_string a, ligma_string b){
+    uint32_t length = ligma_length_of(&a);
+    return length == ligma_length_of(&b) && memcmp(ligma_data_of(&a), ligma_data_of(&b), length) == 0;
+}
+
+int32_t ligma_string_compare(ligma_string a, ligma_string b){
+    uint32_t a_length = ligma_length_of(&a);
+    uint32_t b_length = ligma_length_of(&b);
+    int order = memcmp(ligma_data_of(&a), ligma_data_of(&b), a_length < b_length ? a_length : b_length);
+    if (order == 0){
+        order = a_length < b_length ? -1 : (a_length > b_length ? 1 : 0);
+    }
+    return order < 0 ? -1 : (order > 0 ? 1 : 0);
+}
+
+void ligma_string_retain(ligma_string s){
+    if (ligma_is_heap(&s) && s.heap.buffer->refcount != LIGMA_BUFFER_IMMORTAL){
+        s.heap.buffer->refcount++;
+    }
+}
+
+void ligma_string_release(ligma_string s){
+    if (ligma_is_heap(&s) && s.heap.buffer->refcount != LIGMA_BUFFER_IMMORTAL && --s.heap.buffer->refcount == 0){
+        ligma_free(s.heap.buffer, sizeof(ligma_buffer) + s.heap.buffer->capacity);
+    }
+}
@@ -0,0 +1,131 @@
+// Check: ParallelLexer against Lexer::tokenize() on crafted sources, split at every chunk size from
+// a single byte up, so chunk boundaries land inside strings, numbers and runs of blank lines
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "Lexer.hpp"
+#include "ParallelLexer.hpp"
+
+struct Case{
+    std::string name;
+    std::string source;
+};
+
+std::vector<Case> crafted_cases(){
+    std::vector<Case> cases;
+    cases.push_back({"strings",
+        "let s: string = \"a long string literal that is wider than a small chunk\";\n"
+        "let t: string = \"escaped \\\" quote and \\\\ backslash \\n newline\";\n"
+        "let u: string = \"\";\n"
+        "let v: string = \"unterminated up to the end of the line\n"
+        "let w: string = \"after the unterminated one\";\n"});
+    cases.push_back({"numbers",
+        "let a: int = 12345678901234567890;\n"
+        "let b: float = 3.14159265358979323846;\n"
+        "for i in 0..100000 do { a = a + 1; }\n"
+        "let c: float = 1.2.3;\n"
+        "let d: int = 0000000000000000000000000000000000000000000042;\n"});
+    cases.push_back({"lines",
+        "\n\n\ndef f(x: int) -> int {\n\n\treturn x;\n}\r\n\r\n"
+        "   \n\t\n"
+        "def main() -> int {\n    let y: int = f(1);\n\n\n    return y;\n}\n\n"});
+    cases.push_back({"no trailing newline", "let a: int = 1;\nlet b: int = 22"});
+    cases.push_back({"one line", "let a: [float; 4] = [1.0, 2.0, 3.0, 4.0]; let m: map[int, float] = map[int, float]();"});
+    cases.push_back({"empty", ""});
+    cases.push_back({"only newlines", "\n\n\n\n\n\n\n\n"});
+    return cases;
+}
+
+// many lines of everything the lexer knows, with a fixed seed
+Case random_case(){
+    static const char* pieces[] = {
+        "let", "def", "return", "if", "else", "while", "for", "in", "do", "true", "false", "x", "long_identifier_2",
+        "int", "float", "string", "map", "vec4f", "0", "42", "3.5", "1.2.3", "0..9", "\"str\"", "\"esc \\\" q\"",
+        "\"open", "+", "-", "*", "/", "^", "%", "<", "<=", ">", ">=", "==", "!=", "!", "=", "->", ":", ";", ",",
+        "(", ")", "{", "}", "[", "]", ".", "@", " ", "  ", "\t", "\n", "\n\n", "\r\n"
+    };
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, std::size(pieces) - 1);
+    std::string source;
+    while (source.size() < 20000){
+        source += pieces[pick(rng)];
+        source += ' ';
+    }
+    return {"random", source};
+}
+
+// what the lexer printed while lexing
+template <typename F>
+std::string captured_output(F lex){
+    std::ostringstream out;
+    std::streambuf* previous = std::cout.rdbuf(out.rdbuf());
+    lex();
+    std::cout.rdbuf(previous);
+    return out.str();
+}
+
+bool check(const Case& test, size_t threads, size_t min_chunk_size){
+    auto source = SourceBuffer::from_string(test.source);
+    TokenBuffer sequential = TokenBuffer(source);
+    TokenBuffer parallel = TokenBuffer(source);
+    captured_output([&](){
+        sequential = Lexer(source).tokenize();
+        parallel = ParallelLexer(source, threads, min_chunk_size).tokenize();
+    });
+
+    size_t difference = parallel.first_difference(sequential);
+    if (difference != sequential.size() || parallel.size() != sequential.size()){
+        std::cout << test.name << " (" << threads << " threads, chunks of " << min_chunk_size << "): token " << difference << " is "
+                  << parallel.token_at(difference).to_string() << " instead of " << sequential.token_at(difference).to_string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// an invalid number in a later chunk is reported at its line in the file
+bool check_diagnostic_line(){
+    std::string source;
+    for (int line = 1; line < 40; line++){
+        source += "let a: int = " + std::to_string(line) + ";\n";
+    }
+    source += "let b: float = 1.2.3;\n";
+
+    auto buffer = SourceBuffer::from_string(source);
+    std::string output = captured_output([&](){ ParallelLexer(buffer, 4, 1).tokenize(); });
+    if (output.find("at line: 40 ") == std::string::npos){
+        std::cout << "diagnostic of a chunk names the wrong line: " << output << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(){
+    std::vector<Case> cases = crafted_cases();
+    cases.push_back(random_case());
+
+    int failures = 0;
+    for (const Case& test : cases){
+        size_t largest = std::max<size_t>(test.source.size(), 1);
+        for (size_t threads : {1, 2, 4}){
+            for (size_t min_chunk_size = 1; min_chunk_size <= largest; min_chunk_size += 1 + min_chunk_size / 8){
+                if (!check(test, threads, min_chunk_size)){
+                    failures++;
+                    break;
+                }
+            }
+        }
+    }
+    if (!check_diagnostic_line()){
+        failures++;
+    }
+
+    if (failures > 0){
+        std::cout << failures << " parallel lexer checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "parallel lexer matches on " << cases.size() << " sources" << std::endl;
+    return 0;
+}
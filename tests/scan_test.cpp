@@ -0,0 +1,126 @@
+// Check: the SSE2/AVX2 scanners against the scalar ones, forced with set_scan_path, on runs that end
+// around the 16 and 32 byte steps, at every start offset and with every byte value ending the run
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Lexer.hpp"
+#include "Scan.hpp"
+
+struct ScanResult{
+    size_t whitespace;
+    int newlines;
+    size_t ident;
+    size_t digits;
+
+    bool operator==(const ScanResult& other) const{
+        return this->whitespace == other.whitespace && this->newlines == other.newlines
+            && this->ident == other.ident && this->digits == other.digits;
+    }
+};
+
+ScanResult scan_all(const std::string& source, size_t pos){
+    ScanFunctions& scan = scan_functions();
+    ScanResult result{0, 0, 0, 0};
+    result.whitespace = scan.whitespace(source.data(), pos, source.size(), result.newlines);
+    result.ident = scan.ident(source.data(), pos, source.size());
+    result.digits = scan.digits(source.data(), pos, source.size());
+    return result;
+}
+
+std::string path_name(ScanPath path){
+    switch (path){
+        case ScanPath::AVX2: return "avx2";
+        case ScanPath::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// runs of `fill` from `offset` up to `length` bytes, ended by `stop` (or by the end of the source)
+std::vector<std::string> run_sources(){
+    static const std::string fills[] = {" ", "\n", " \n\t\r", "\n\n \r\n", "a", "Z_9x", "0", "0123456789"};
+    std::vector<std::string> sources;
+    for (const std::string& fill : fills){
+        for (size_t length = 0; length <= 70; length++){
+            std::string run;
+            for (size_t i = 0; i < length; i++){
+                run += fill[i % fill.size()];
+            }
+            for (int stop = 0; stop < 256; stop++){
+                sources.push_back(run + char(stop) + fill);
+            }
+            sources.push_back(run);
+        }
+    }
+    return sources;
+}
+
+bool check_path(ScanPath path, const std::vector<std::string>& sources){
+    for (const std::string& source : sources){
+        for (size_t offset = 0; offset < 4 && offset <= source.size(); offset++){
+            set_scan_path(ScanPath::SCALAR);
+            ScanResult expected = scan_all(source, offset);
+            set_scan_path(path);
+            ScanResult actual = scan_all(source, offset);
+            if (!(actual == expected)){
+                std::cout << path_name(path) << " differs from scalar on a source of " << source.size() << " bytes at offset " << offset
+                          << ": whitespace " << actual.whitespace << "/" << expected.whitespace
+                          << ", newlines " << actual.newlines << "/" << expected.newlines
+                          << ", ident " << actual.ident << "/" << expected.ident
+                          << ", digits " << actual.digits << "/" << expected.digits << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// the lexer gives the same tokens and line numbers on every path
+bool check_lexer(ScanPath path){
+    std::string source;
+    for (int line = 0; line < 64; line++){
+        source += std::string(line % 37, ' ') + "let identifier_" + std::string(line % 33, 'x') + ": int = "
+                + std::string(1 + line % 35, '7') + ";" + std::string(line % 5, '\n') + "\n";
+    }
+    auto buffer = SourceBuffer::from_string(source);
+
+    set_scan_path(ScanPath::SCALAR);
+    TokenBuffer expected = Lexer(buffer).tokenize();
+    set_scan_path(path);
+    TokenBuffer actual = Lexer(buffer).tokenize();
+
+    size_t difference = actual.first_difference(expected);
+    if (difference != expected.size() || actual.size() != expected.size()){
+        std::cout << path_name(path) << " lexer: token " << difference << " is " << actual.token_at(difference).to_string()
+                  << " instead of " << expected.token_at(difference).to_string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(){
+    std::vector<std::string> sources = run_sources();
+    ScanPath best = detect_scan_path();
+
+    int failures = 0;
+    for (ScanPath path : {ScanPath::SSE2, ScanPath::AVX2}){
+        if (path > best){
+            std::cout << path_name(path) << " is not supported here, skipped" << std::endl;
+            continue;
+        }
+        if (!check_path(path, sources)){
+            failures++;
+        }
+        if (!check_lexer(path)){
+            failures++;
+        }
+    }
+    set_scan_path(best);
+
+    if (failures > 0){
+        std::cout << failures << " scan path checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "scan paths match scalar on " << sources.size() << " sources" << std::endl;
+    return 0;
+}